@@ -0,0 +1,7626 @@
+/**
+ * @file checkers.c
+ * @brief Библиотека игры в шашки: правила, поиск, оценка, консольная партия и сервер
+ * 
+ * Программа реализует классическую игру в шашки с консольным интерфейсом.
+ * Поддерживаются стандартные правила игры, включая превращение в дамки и обязательное взятие.
+ */
+#include "checkers.h"
+
+// Состояние партии хранится отдельно для каждого потока: в серверном режиме
+// рабочие потоки загружают сюда сессию, считают ход и сохраняют ее обратно.
+_Thread_local bool is_player_turn = false;           // Флаг, ход игрока
+_Thread_local bool player_is_white = false;          // Флаг, игрок играет за белых
+char player_piece;                                   // Фишка игрока
+char computer_piece;                                 // Фишка компьютера
+_Thread_local GameState game_state = {12, 12, 0, 0}; // Состояние поля
+
+int rules_variant = RULES_AMERICAN;                  // Выбранные правила
+_Thread_local uint64_t rng_state = 0;                // Генератор случайных чисел партии
+_Thread_local Hod_Info last_hod;                     // Последний сделанный ход
+int replay_fd = -1;                                  // Журнал партии в консольной игре
+int draw_moves = 40;                                 // Ходов каждой стороны без прогресса до ничьей, 0 - без ограничения
+_Thread_local Game_History game_history;             // Позиции партии с последнего необратимого хода
+Search_Options search_options = {8, 0, true, true, false, 0, 1, NULL}; // Ограничения поиска хода компьютера
+Probcut_Model probcut_model = {1.016, 0.6, 26.2};    // Модель ProbCut: --probcut-calibrate 200 --seed 2
+int tt_size_mb = 16;                                 // Размер таблицы переходов потока в МБ, 0 - без таблицы
+Hod_Generator generate_hods = generate_hods_american; // Генератор ходов выбранных правил
+
+_Thread_local char board[BOARD_SIZE][SIZE + 1] = { // Интерфейс поля
+    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
+    {'|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', '8'},
+    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
+    {'|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '7'},
+    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
+    {'|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', '6'},
+    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
+    {'|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '5'},
+    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
+    {'|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', '4'},
+    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
+    {'|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '3'},
+    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
+    {'|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', '2'},
+    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
+    {'|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '1'},
+    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
+    {' ', ' ', 'A', ' ', ' ', ' ', 'B', ' ', ' ', ' ', 'C', ' ', ' ', ' ', 'D', ' ', ' ', ' ', 'E', ' ', ' ', ' ', 'F', ' ', ' ', ' ', 'G', ' ', ' ', ' ', 'H', ' ', ' ', ' ', ' '}};
+
+
+void initialize_board(char board[BOARD_SIZE][SIZE + 1])
+{ // Инициализация поля
+  for (int i = 0; i < BOARD_SIZE; i++)
+  {
+    for (int j = 0; j < SIZE; j++)
+    {
+      if (board[i][j] == '*' || board[i][j] == 'O' || board[i][j] == '0' ||
+          board[i][j] == 'Q' || board[i][j] == 'K')
+      {
+        board[i][j] = '*';
+      }
+    }
+  }
+}
+
+void print_board(const char board[BOARD_SIZE][SIZE + 1])
+{ // Печать интерфейса поля
+  printf("\n");
+  printf("0 - Фишка черного игрока\n");
+  printf("O - Фишка белого игрока\n");
+  printf("W, B - Дамки\n");
+  printf("Текущее состояние доски:\n");
+  printf("Белые: %d (%d дамок), Черные: %d (%d дамок)\n", game_state.count_white, game_state.count_white_king,
+         game_state.count_black, game_state.count_black_king);
+
+  for (int i = 0; i < BOARD_SIZE; i++)
+  {
+    for (int j = 0; j < SIZE; j++)
+      printf("%c", board[i][j]);
+    printf("\n");
+  }
+}
+
+void setup_pieces(char board[BOARD_SIZE][SIZE + 1], bool white_on_bottom)
+{ // Располежение поля в стороны игрока
+  if (white_on_bottom)
+  {
+    for (int i = 11; i < BOARD_SIZE - 1; i += 2)
+    {
+      for (int j = 2; j < SIZE - 2; j += 8)
+      {
+        if (i % 4 == 1)
+        {
+          if (j + 4 < SIZE - 2)
+            board[i][j + 4] = 'O';
+        }
+        else
+          board[i][j] = 'O';
+      }
+    }
+
+    for (int i = 1; i < 6; i += 2)
+    {
+      for (int j = 2; j < SIZE - 2; j += 8)
+      {
+        if (i % 4 == 1)
+        {
+          if (j + 4 < SIZE - 2)
+            board[i][j + 4] = '0';
+        }
+        else
+          board[i][j] = '0';
+      }
+    }
+  }
+  else
+  {
+    for (int i = 11; i < BOARD_SIZE - 1; i += 2)
+    {
+      for (int j = 2; j < SIZE - 2; j += 8)
+      {
+        if (i % 4 == 1)
+        {
+          if (j + 4 < SIZE - 2)
+            board[i][j + 4] = '0';
+        }
+        else
+          board[i][j] = '0';
+      }
+    }
+
+    for (int i = 1; i <= 6; i += 2)
+    {
+      for (int j = 2; j < SIZE - 2; j += 8)
+      {
+        if (i % 4 == 1)
+        {
+          if (j + 4 < SIZE - 2)
+            board[i][j + 4] = 'O';
+        }
+        else
+          board[i][j] = 'O';
+      }
+    }
+  }
+}
+
+// Консольная партия. Стандартный ввод читается построчно через poll, а ход
+// компьютера и подсказка считаются в отдельном потоке поиска, поэтому команды
+// игрока принимаются, пока компьютер думает. Поиск прерывается флагом отмены:
+// search_check_time проверяет его раз в 1024 узла, и search_multipv отдает
+// лучший ход последней законченной итерации.
+
+typedef struct
+{
+  char buffer[CONSOLE_LINE_SIZE];   // Прочитанные и еще не разобранные байты
+  int length;
+  bool eof;
+  char held[CONSOLE_LINE_SIZE];     // Строка, отложенная до хода игрока
+  bool has_held;
+} Console_Input;
+
+typedef struct
+{
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int done_fd;                      // eventfd: поиск закончен
+  bool started;                     // Поток поиска создан
+  bool failed;                      // Поток не создан, поиск идет в вызывающем потоке
+  bool requested;                   // Поток должен начать поиск
+  bool running;                     // Поиск запущен, итог еще не забран
+  bool cancel;                      // Флаг отмены поиска
+  Search_Options options;
+  char side;
+  int lines;
+  char lodic[8][8];                 // Партия на момент запуска поиска
+  GameState game_state;
+  Game_History history;
+  uint64_t rng_state;               // Генератор после поиска
+  Search_Line found[MAX_MULTIPV];
+  Search_Result result;
+  int count;                        // Найдено линий, 0 - ходов нет
+} Console_Search;
+
+typedef struct
+{
+  Undo_Record *records;             // Полуходы партии; после count - отмененные
+  int count;                        // Сделано полуходов
+  int top;                          // Записано полуходов вместе с отмененными
+  int capacity;
+} Console_History;
+
+enum { CONSOLE_GOT_LINE, CONSOLE_GOT_SEARCH, CONSOLE_GOT_EOF };
+
+static Console_Input console_input;
+static Console_Search console_search = {.mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER,
+                                        .done_fd = -1};
+static Console_History console_history; // Ходы партии для undo, redo и анализа
+static bool console_analysis = false;   // Анализ: компьютер не ходит сам
+
+static bool console_take_line(char *line, size_t size){
+  // Забирает отложенную строку или строку из буфера; незаконченная строка
+  // отдается только в конце ввода или если заполнила весь буфер
+  Console_Input *in = &console_input;
+  if (in->has_held)
+  {
+    snprintf(line, size, "%.*s", (int)sizeof(in->held) - 1, in->held);
+    in->has_held = false;
+    return true;
+  }
+  char *end = memchr(in->buffer, '\n', in->length);
+  int n = end != NULL ? (int)(end - in->buffer) : in->length;
+  if (end == NULL && !(in->eof && in->length > 0) && in->length < (int)sizeof(in->buffer))
+    return false;
+  int start = 0, stop = n;
+  while (start < stop && isspace((unsigned char)in->buffer[start]))
+    start++;
+  while (stop > start && isspace((unsigned char)in->buffer[stop - 1]))
+    stop--;
+  size_t len = (size_t)(stop - start) < size - 1 ? (size_t)(stop - start) : size - 1;
+  for (size_t i = 0; i < len; i++)
+    line[i] = tolower((unsigned char)in->buffer[start + i]);
+  line[len] = '\0';
+  int used = end != NULL ? n + 1 : n;
+  in->length -= used;
+  memmove(in->buffer, in->buffer + used, in->length);
+  return true;
+}
+
+static void console_hold_line(const char *line){
+  snprintf(console_input.held, sizeof(console_input.held), "%s", line);
+  console_input.has_held = true;
+}
+
+static int console_wait(char *line, size_t size, bool want_line){
+  // Ждет строку ввода (если want_line) или конец запущенного поиска
+  Console_Input *in = &console_input;
+  Console_Search *cs = &console_search;
+  fflush(stdout);
+  while (true)
+  {
+    if (want_line && console_take_line(line, size))
+      return CONSOLE_GOT_LINE;
+    if (cs->running && cs->failed)
+      return CONSOLE_GOT_SEARCH;
+    struct pollfd fds[2];
+    int n = 0;
+    if (want_line && !in->eof)
+      fds[n++] = (struct pollfd){.fd = STDIN_FILENO, .events = POLLIN};
+    if (cs->running)
+      fds[n++] = (struct pollfd){.fd = cs->done_fd, .events = POLLIN};
+    if (n == 0)
+      return CONSOLE_GOT_EOF;
+    if (poll(fds, n, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      // Итог поиска заберется блокирующим чтением eventfd
+      return cs->running ? CONSOLE_GOT_SEARCH : CONSOLE_GOT_EOF;
+    }
+    if (cs->running && fds[n - 1].revents != 0)
+      return CONSOLE_GOT_SEARCH;
+    if (want_line && !in->eof && fds[0].revents != 0)
+    {
+      ssize_t got = read(STDIN_FILENO, in->buffer + in->length, sizeof(in->buffer) - in->length);
+      if (got > 0)
+        in->length += got;
+      else if (got == 0 || (errno != EINTR && errno != EAGAIN))
+        in->eof = true;
+    }
+  }
+}
+
+bool console_read_line(char *line, size_t size){
+  return console_wait(line, size, true) == CONSOLE_GOT_LINE;
+}
+
+static void console_search_run(Console_Search *cs){
+  // Переносит партию в состояние потока, как session_load. Генератор
+  // вызывающего потока не меняется: ход компьютера забирает его из cs
+  uint64_t saved_rng = rng_state;
+  memcpy(lodic, cs->lodic, sizeof(char) * 8 * 8);
+  game_state = cs->game_state;
+  game_history = cs->history;
+  rng_state = cs->rng_state;
+  cs->count = search_multipv(lodic, cs->side, &cs->options, cs->lines, cs->found, &cs->result);
+  cs->rng_state = rng_state;
+  rng_state = saved_rng;
+}
+
+static void *console_search_main(void *arg){
+  Console_Search *cs = arg;
+  pthread_mutex_lock(&cs->mutex);
+  while (true)
+  {
+    while (!cs->requested)
+      pthread_cond_wait(&cs->cond, &cs->mutex);
+    cs->requested = false;
+    pthread_mutex_unlock(&cs->mutex);
+    console_search_run(cs);
+    // Итог публикуется под мьютексом: console_search_finish берет его после
+    // чтения eventfd, а поток отпускает мьютекс только в ожидании задачи
+    pthread_mutex_lock(&cs->mutex);
+    uint64_t one = 1;
+    if (write(cs->done_fd, &one, sizeof(one)) < 0)
+      perror("eventfd");
+  }
+  return NULL;
+}
+
+static void console_search_start(char side, int lines){
+  // Запускает поиск текущей позиции. Поток поиска один на партию: его
+  // таблица переходов живет между ходами
+  Console_Search *cs = &console_search;
+  if (!cs->started && !cs->failed)
+  {
+    cs->done_fd = eventfd(0, 0);
+    if (cs->done_fd >= 0 && pthread_create(&cs->thread, NULL, console_search_main, cs) == 0)
+      cs->started = true;
+    else
+    {
+      perror("Поток поиска");
+      cs->failed = true;
+    }
+  }
+  memcpy(cs->lodic, lodic, sizeof(char) * 8 * 8);
+  cs->game_state = game_state;
+  cs->history = game_history;
+  cs->rng_state = rng_state;
+  cs->options = search_options;
+  cs->options.cancel = &cs->cancel;
+  cs->side = side;
+  cs->lines = lines;
+  __atomic_store_n(&cs->cancel, false, __ATOMIC_RELAXED);
+  cs->running = true;
+  if (cs->failed)
+  {
+    // Без потока поиск не прерывается, но партия продолжается
+    console_search_run(cs);
+    return;
+  }
+  pthread_mutex_lock(&cs->mutex);
+  cs->requested = true;
+  pthread_cond_signal(&cs->cond);
+  pthread_mutex_unlock(&cs->mutex);
+}
+
+static void console_search_finish(bool cancel){
+  // Забирает итог поиска; с cancel поиск сначала прерывается
+  Console_Search *cs = &console_search;
+  if (!cs->running)
+    return;
+  if (cancel)
+    __atomic_store_n(&cs->cancel, true, __ATOMIC_RELAXED);
+  if (!cs->failed)
+  {
+    uint64_t count;
+    while (read(cs->done_fd, &count, sizeof(count)) < 0 && errno == EINTR)
+      ;
+    pthread_mutex_lock(&cs->mutex);
+    pthread_mutex_unlock(&cs->mutex);
+  }
+  cs->running = false;
+}
+
+static void console_print_hint(bool stopped){
+  const Console_Search *cs = &console_search;
+  printf("\nПодсказка, глубина %d%s:\n", cs->result.depth, stopped ? " (поиск прерван)" : "");
+  for (int k = 0; k < cs->count; k++)
+  {
+    char move[8];
+    format_hod(&cs->found[k].move, move);
+    printf("%d. %s %+d:", k + 1, move, cs->found[k].score);
+    for (int i = 0; i < cs->found[k].pv_length; i++)
+    {
+      format_search_move(cs->found[k].pv[i], move);
+      printf(" %s", move);
+    }
+    printf("\n");
+  }
+}
+
+static bool record_is_player(const Undo_Record *u){
+  return u->piece == '2' || u->piece == '4';
+}
+
+static void console_make_hod(const Hod_Info *h){
+  // Новый ход отбрасывает отмененные полуходы
+  Console_History *ch = &console_history;
+  if (ch->count == ch->capacity)
+  {
+    int capacity = ch->capacity > 0 ? ch->capacity * 2 : 128;
+    Undo_Record *grown = realloc(ch->records, capacity * sizeof(Undo_Record));
+    if (grown == NULL)
+    {
+      // Без памяти ход делается без записи, и отменять больше нечего
+      ch->count = ch->top = 0;
+      make_hod(h);
+      return;
+    }
+    ch->records = grown;
+    ch->capacity = capacity;
+  }
+  make_hod_record(h, &ch->records[ch->count++]);
+  ch->top = ch->count;
+}
+
+static int console_back(int plies){
+  // Отменяет до plies полуходов; ходит сторона последнего отмененного
+  Console_History *ch = &console_history;
+  int done = 0;
+  for (; done < plies && ch->count > 0; done++)
+  {
+    const Undo_Record *u = &ch->records[--ch->count];
+    unmake_hod(u);
+    is_player_turn = record_is_player(u);
+  }
+  return done;
+}
+
+static int console_forward(int plies){
+  // Повторяет до plies отмененных полуходов по их записям
+  Console_History *ch = &console_history;
+  int done = 0;
+  for (; done < plies && ch->count < ch->top; done++)
+  {
+    Undo_Record *u = &ch->records[ch->count++];
+    make_hod_record(&u->hod, u);
+    is_player_turn = !record_is_player(u);
+  }
+  return done;
+}
+
+static int console_undo_plies(){
+  // Полуходов до позиции перед последним ходом игрока, 0 - ходов игрока нет
+  const Console_History *ch = &console_history;
+  for (int i = ch->count - 1; i >= 0; i--)
+    if (record_is_player(&ch->records[i]))
+      return ch->count - i;
+  return 0;
+}
+
+static int console_redo_plies(){
+  // Полуходов до следующего отмененного хода игрока и ответа компьютера
+  const Console_History *ch = &console_history;
+  for (int i = ch->count; i < ch->top; i++)
+    if (record_is_player(&ch->records[i]))
+      return (i + 1 < ch->top ? i + 2 : i + 1) - ch->count;
+  return 0;
+}
+
+static bool console_is_navigation(const char *line){
+  char word[16];
+  if (sscanf(line, "%15s", word) != 1)
+    return false;
+  return strcmp(word, "undo") == 0 || strcmp(word, "redo") == 0 || strcmp(word, "back") == 0 ||
+         strcmp(word, "forward") == 0 || strcmp(word, "play") == 0;
+}
+
+static int console_navigate(const char *line){
+  // Команды undo, redo, back [N], forward [N] и play. Возвращает 1, если
+  // позиция или режим изменились, 0 - если делать нечего, -1 - не команда.
+  // back и forward включают анализ: компьютер не ходит, пока не введено play
+  char word[16];
+  int n = 1;
+  if (!console_is_navigation(line) || sscanf(line, "%15s %d", word, &n) < 1)
+    return -1;
+  if (strcmp(word, "play") == 0)
+  {
+    if (!console_analysis)
+    {
+      printf("Партия и так идет\n");
+      return 0;
+    }
+    console_analysis = false;
+    printf("\nПартия продолжается\n");
+    return 1;
+  }
+  bool back = strcmp(word, "undo") == 0 || strcmp(word, "back") == 0;
+  int plies = n > 0 ? n : 1;
+  if (strcmp(word, "undo") == 0)
+    plies = console_undo_plies();
+  else if (strcmp(word, "redo") == 0)
+    plies = console_redo_plies();
+  else
+    console_analysis = true;
+  int done = back ? console_back(plies) : console_forward(plies);
+  if (done == 0)
+  {
+    printf(back ? "Отменять нечего\n" : "Повторять нечего\n");
+    return 0;
+  }
+  replay_write(replay_fd, "%s %d\n", back ? "undo" : "redo", done);
+  printf("\n%s: полуход %d из %d%s\n", back ? "Ходы отменены" : "Ходы повторены", console_history.count,
+         console_history.top, console_analysis ? ", анализ (play - продолжить партию)" : "");
+  return 1;
+}
+
+static void redraw_board(char board[BOARD_SIZE][SIZE + 1]){
+  for (short x = 0; x < 8; x++)
+    for (short y = 0; y < 8; y++)
+    {
+      short bx, by;
+      reverse_graph_koordinaty(x, y, &bx, &by);
+      board[by][bx] = piece_symbol(lodic[y][x], player_is_white);
+    }
+  print_board(board);
+}
+
+void play_game(char board[BOARD_SIZE][SIZE + 1]){
+  int action = CONSOLE_MOVED;
+  while (true)
+  {
+    print_turn();
+
+    // В анализе законченную партию можно смотреть дальше
+    if (check_game_over() && !console_analysis)
+      break;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    bool forced = false;
+    if (is_player_turn || console_analysis)
+      action = player_move(board);
+    else
+      action = computer_think(board, &forced);
+    if (action == CONSOLE_NAVIGATE)
+    {
+      redraw_board(board);
+      continue;
+    }
+    if (action != CONSOLE_MOVED)
+      break;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    replay_write_hod(replay_fd, is_player_turn ? "player" : (forced ? "forced" : "computer"), &last_hod,
+                     (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000);
+
+    switch_turn();
+    redraw_board(board);
+  }
+  int result = game_result();
+  if (action == CONSOLE_RESIGN)
+  {
+    result = player_is_white ? 2 : 1;
+    printf("\nВы сдались. %s победили.\n", player_is_white ? "Черные" : "Белые");
+    replay_write(replay_fd, "resign\n");
+  }
+  replay_write(replay_fd, "result %s\n",
+               result == 1 ? "white" : (result == 2 ? "black" : (result == 3 ? "draw" : "none")));
+  printf("Конец. Парам-парам-пам");
+}
+
+int player_move(char board[BOARD_SIZE][SIZE + 1]){
+  // В анализе или после конца партии принимаются только команды
+  bool can_move = is_player_turn && game_result() == 0;
+  if (can_move)
+    printf("\nВаш ход. Введите координаты фишки (например, B3) или команду (help - список команд): ");
+  else
+    printf("\nАнализ. Введите команду (help - список команд): ");
+
+  Position where;
+  Hod_List hods;
+  Hod_Info options[MAX_HODS];
+  int option_count = 0; // 0 - фишка еще не выбрана
+  char line[CONSOLE_LINE_SIZE];
+
+  bool must_kill = false;
+  if (can_move)
+  {
+    generate_hods(lodic, '2', &hods);
+    must_kill = HOD_CAPTURE(hods.hods[0]) != 0; // Если можно рубить, в списке только взятия
+  }
+
+  while (true)
+  {
+    int got = console_wait(line, sizeof(line), true);
+    if (got == CONSOLE_GOT_SEARCH)
+    {
+      console_search_finish(false);
+      console_print_hint(false);
+      printf(!can_move ? "Введите команду: " : (option_count == 0 ? "Введите координаты фишки: " : "Введите номер хода:\n"));
+      continue;
+    }
+    // Любая строка прерывает подсказку и показывает найденное к этому моменту
+    if (console_search.running)
+    {
+      console_search_finish(true);
+      console_print_hint(true);
+    }
+    if (got == CONSOLE_GOT_EOF || strcmp(line, "quit") == 0)
+      return CONSOLE_QUIT;
+    if (line[0] == '\0')
+      continue;
+    if (strcmp(line, "resign") == 0)
+      return CONSOLE_RESIGN;
+    if (strcmp(line, "help") == 0)
+    {
+      printf("hint - подсказка, undo - вернуть свой ход, redo - повторить его, back N и forward N - перейти по\n"
+             "партии на N полуходов (анализ), play - продолжить партию с текущей позиции, resign - сдаться,\n"
+             "quit - выйти\n");
+      continue;
+    }
+    if (strcmp(line, "hint") == 0)
+    {
+      printf("Ищем подсказку, любая строка прерывает поиск\n");
+      console_search_start(is_player_turn ? '2' : '1', CONSOLE_HINT_LINES);
+      continue;
+    }
+    int navigated = console_navigate(line);
+    if (navigated > 0)
+      return CONSOLE_NAVIGATE;
+    if (navigated == 0)
+      continue;
+    if (!can_move)
+    {
+      printf("Сейчас не ваш ход: play - продолжить партию, help - список команд\n");
+      continue;
+    }
+
+    // Номер хода для выбранной фишки; координаты выбирают другую фишку
+    if (option_count > 0 && isdigit((unsigned char)line[0]))
+    {
+      char *end;
+      long vsbor = strtol(line, &end, 10);
+      if (*end != '\0' || vsbor < 1 || vsbor > option_count)
+      {
+        printf("Ошибка ввода\nВведите номер хода:\n");
+        continue;
+      }
+      console_make_hod(&options[vsbor - 1]);
+      console_analysis = false;
+      return CONSOLE_MOVED;
+    }
+
+    if (strlen(line) != 2)
+    {
+      printf("Ошибка ввода. Попробуйте еще раз: ");
+      continue;
+    }
+    char x = toupper((unsigned char)line[0]), y = line[1];
+
+    if (!koordinaty(x, y, &where.x, &where.y, &where.x_8, &where.y_8))
+    {
+      printf("Неверные координаты! Попробуйте еще раз: ");
+      continue;
+    }
+
+    char piece = board[where.y][where.x];
+    if ((player_is_white && (piece != 'O' && piece != 'W')) ||
+        (!player_is_white && (piece != '0' && piece != 'B')))
+    {
+      printf("Это не ваша фишка! Попробуйте еще раз: ");
+      continue;
+    }
+
+    option_count = 0;
+    for (int i = 0; i < hods.count; i++)
+      if (HOD_FROM(hods.hods[i]) == SQ_INDEX(where.x_8, where.y_8))
+        options[option_count++] = hod_info(&hods, hods.hods[i]);
+    if (option_count == 0)
+    {
+      if (must_kill)
+        printf("Вы обязаны рубить! Пожалуйста, выберите фишку, которая рубит фишку протвиника в этом ходу\n");
+      else
+        printf("Этой фишкой походить нельзя. Выберите другую: ");
+      continue;
+    }
+
+    short big_x = 0, big_y = 0;
+    for (int i = 0; i < option_count; i++)
+    {
+      reverse_graph_koordinaty(options[i].to_x, options[i].to_y, &big_x, &big_y);
+      light(board, big_x, big_y, true);
+    }
+    highlight_piece(where.x, where.y, board);
+
+    printf("\nМожно походить в:\n");
+    char out_x = 0, out_y = 0;
+    for (int i = 0; i < option_count; i++)
+    {
+      Hod_Info *h = &options[i];
+      reverse_graph_out_koordinaty(h->to_x, h->to_y, &out_x, &out_y);
+      printf("%d. %c%c", i + 1, out_x, out_y);
+      if (h->kills > 0)
+      {
+        printf(" (рубит:");
+        for (uint32_t rest = h->captured; rest != 0; rest &= rest - 1)
+        {
+          int sq = __builtin_ctz(rest);
+          reverse_graph_out_koordinaty(SQ_X(sq), SQ_Y(sq), &out_x, &out_y);
+          printf(" %c%c", out_x, out_y);
+        }
+        printf(")");
+      }
+      printf("\n");
+      reverse_graph_koordinaty(h->to_x, h->to_y, &big_x, &big_y);
+      light(board, big_x, big_y, false);
+    }
+    printf("Введите номер хода:\n");
+  }
+}
+
+int computer_think(char board[BOARD_SIZE][SIZE + 1], bool *forced){
+  (void)board;
+  char line[CONSOLE_LINE_SIZE];
+  bool read_input = true;
+  *forced = false;
+  console_search_start('1', 1);
+  printf("Компьютер думает (move - сходить сейчас, undo, back N, resign, quit)\n");
+  while (console_search.running)
+  {
+    if (console_wait(line, sizeof(line), read_input) == CONSOLE_GOT_SEARCH)
+      break;
+    if (strcmp(line, "move") == 0 || strcmp(line, "now") == 0 || strcmp(line, "move now") == 0)
+    {
+      console_search_finish(true);
+      *forced = true;
+    }
+    else if (console_is_navigation(line))
+    {
+      // Отмененный поиск не сдвигает генератор партии, поэтому, если
+      // переходить некуда, поиск просто начинается заново
+      console_search_finish(true);
+      if (console_navigate(line) > 0)
+        return CONSOLE_NAVIGATE;
+      console_search_start('1', 1);
+    }
+    else if (strcmp(line, "resign") == 0 || strcmp(line, "quit") == 0)
+    {
+      console_search_finish(true);
+      return line[0] == 'r' ? CONSOLE_RESIGN : CONSOLE_QUIT;
+    }
+    else if (strcmp(line, "hint") == 0)
+      printf("Подсказка доступна на вашем ходу\n");
+    else if (line[0] != '\0')
+    {
+      // Ход игрока, набранный заранее, ждет своей очереди; пока он не
+      // разобран, ввод не читается, чтобы не менять порядок строк
+      console_hold_line(line);
+      read_input = false;
+    }
+  }
+  console_search_finish(false);
+
+  const Console_Search *cs = &console_search;
+  if (cs->count == 0)
+    return CONSOLE_QUIT;
+  // Генератор партии продвигается только сыгранным ходом: прерванный
+  // отменой поиск не меняет дальнейших ходов компьютера
+  rng_state = cs->rng_state;
+  console_make_hod(&cs->result.best);
+  if (*forced)
+    printf("Поиск прерван, ход по глубине %d\n", cs->result.depth);
+  return CONSOLE_MOVED;
+}
+
+bool reverse_graph_out_koordinaty(short i_x, short i_y, char *x, char *y){
+  // Вычисляем координаты lodic из графических координат
+  *x = 'A' + i_x;
+  *y = '8' - i_y;
+  return true;
+}
+
+void reverse_graph_koordinaty(short i_x, short i_y, short *x, short *y){
+  *x = (i_x * 4) + 2;
+  *y = 1 + (i_y * 2);
+}
+
+_Thread_local char lodic[8][8] = { // для просчета ходов.
+    {' ', '1', ' ', '1', ' ', '1', ' ', '1'},
+    {'1', ' ', '1', ' ', '1', ' ', '1', ' '},
+    {' ', '1', ' ', '1', ' ', '1', ' ', '1'},
+    {'0', ' ', '0', ' ', '0', ' ', '0', ' '},
+    {' ', '0', ' ', '0', ' ', '0', ' ', '0'},
+    {'2', ' ', '2', ' ', '2', ' ', '2', ' '},
+    {' ', '2', ' ', '2', ' ', '2', ' ', '2'},
+    {'2', ' ', '2', ' ', '2', ' ', '2', ' '}};
+
+// Генерация ходов. Правила варианта передаются в шаблон константами, и каждый
+// вариант собирается в отдельную функцию без проверок правил во внутреннем цикле.
+
+// Таблицы лучей: для каждой темной клетки и направления - клетки подряд до
+// края доски, в конце -1. Первая клетка луча - соседняя (через нее бьют),
+// вторая - поле приземления короткого взятия. Таблицы считаются
+// препроцессором при компиляции, поэтому во внутренних циклах нет проверок
+// границ доски: луч кончается на -1.
+#define DIR_DX(d) (((d) & 1) ? 1 : -1)   /**< Шаг направления по x: 0, 2 - влево, 1, 3 - вправо */
+#define DIR_DY(d) (((d) & 2) ? 1 : -1)   /**< Шаг направления по y: 0, 1 - вверх, 2, 3 - вниз */
+#define RAY_X(sq, d, n) (SQ_X(sq) + DIR_DX(d) * (n))
+#define RAY_Y(sq, d, n) (SQ_Y(sq) + DIR_DY(d) * (n))
+#define RAY_SQ(sq, d, n)                                                                                     \
+  ((n) < 8 && RAY_X(sq, d, n) >= 0 && RAY_X(sq, d, n) < 8 && RAY_Y(sq, d, n) >= 0 && RAY_Y(sq, d, n) < 8 \
+       ? SQ_INDEX(RAY_X(sq, d, n), RAY_Y(sq, d, n))                                                          \
+       : -1)
+#define RAY(sq, d) {RAY_SQ(sq, d, 1), RAY_SQ(sq, d, 2), RAY_SQ(sq, d, 3), RAY_SQ(sq, d, 4), \
+                    RAY_SQ(sq, d, 5), RAY_SQ(sq, d, 6), RAY_SQ(sq, d, 7), -1}
+#define RAYS(sq) {RAY(sq, 0), RAY(sq, 1), RAY(sq, 2), RAY(sq, 3)}
+#define RAYS4(sq) RAYS(sq), RAYS(sq + 1), RAYS(sq + 2), RAYS(sq + 3)
+#define RAYS16(sq) RAYS4(sq), RAYS4(sq + 4), RAYS4(sq + 8), RAYS4(sq + 12)
+#define CELL(sq) (SQ_Y(sq) * 8 + SQ_X(sq))
+#define CELLS4(sq) CELL(sq), CELL(sq + 1), CELL(sq + 2), CELL(sq + 3)
+#define CELLS16(sq) CELLS4(sq), CELLS4(sq + 4), CELLS4(sq + 8), CELLS4(sq + 12)
+
+static const signed char sq_ray[SQUARES][4][8] = {RAYS16(0), RAYS16(16)}; // Лучи клеток по направлениям
+static const unsigned char sq_cell[SQUARES] = {CELLS16(0), CELLS16(16)};  // Смещение клетки в lodic
+
+/**
+ * @struct Gen_Context
+ * @brief Общие данные одного вызова генератора
+ */
+typedef struct
+{
+  char *cells;        /**< Доска построчно; ходящая фишка на время поиска взятий снята */
+  char man;           /**< Простая фишка ходящей стороны */
+  char king;          /**< Дамка ходящей стороны */
+  char enemy_man;     /**< Простая фишка противника */
+  char enemy_king;    /**< Дамка противника */
+  short forward;      /**< Направление хода простых по y */
+  short last_row;     /**< Строка превращения в дамку */
+  short from;         /**< Начальная клетка текущей фишки */
+  bool from_king;     /**< Текущая фишка - дамка */
+  Hod_List *list;     /**< Список, в который пишутся ходы */
+} Gen_Context;
+
+typedef int (*Capture_Step)(Gen_Context *g, int sq, bool king, uint32_t captured);
+
+static void record_hod(Gen_Context *g, int to, bool king, uint32_t captured){
+  Hod_List *list = g->list;
+  // Одно и то же взятие разными путями дает один ход
+  if (captured != 0)
+    for (int i = list->count - 1; i >= 0; i--)
+      if (HOD_FROM(list->hods[i]) == g->from && HOD_TO(list->hods[i]) == to &&
+          list->captured[HOD_CAPTURE(list->hods[i])] == captured)
+        return;
+  if (list->count == MAX_HODS)
+    return;
+  int capture = 0;
+  if (captured != 0)
+  {
+    capture = list->capture_count++;
+    list->captured[capture] = captured;
+  }
+  list->hods[list->count++] = HOD_PACK(g->from, to, !g->from_king && (king || SQ_Y(to) == g->last_row), capture);
+}
+
+// Взятые фишки остаются на доске до конца хода: их нельзя перепрыгнуть дважды.
+// Обход дешевле поиска в кэше цепочек: ключ по содержимому прочитанных клеток
+// проверяется столько же, сколько идет сам обход (см. README)
+static inline __attribute__((always_inline)) int capture_step_template(Gen_Context *g, int sq, bool king, uint32_t captured,
+                                                                       bool flying, bool men_back, int promotion, Capture_Step self){
+  int found = 0;
+  for (int d = 0; d < 4; d++)
+  {
+    if (!king && !men_back && DIR_DY(d) != g->forward)
+      continue;
+    const signed char *ray = sq_ray[sq][d];
+    int k = 0;
+    if (flying && king)
+      while (ray[k] >= 0 && g->cells[sq_cell[ray[k]]] == '0')
+        k++;
+    int victim = ray[k];
+    if (victim < 0)
+      continue;
+    char piece = g->cells[sq_cell[victim]];
+    uint32_t bit = 1u << victim;
+    if ((piece != g->enemy_man && piece != g->enemy_king) || (captured & bit))
+      continue;
+
+    int landing[7];
+    int landings = 0;
+    for (k++; ray[k] >= 0 && g->cells[sq_cell[ray[k]]] == '0'; k++)
+    {
+      landing[landings++] = ray[k];
+      if (!(flying && king))
+        break;
+    }
+
+    // Если с какой-то клетки приземления можно бить дальше, бить обязательно
+    int continued = 0;
+    for (int i = 0; i < landings; i++)
+    {
+      bool promoted = !king && SQ_Y(landing[i]) == g->last_row;
+      if (promoted && promotion == PROMOTE_END_MOVE)
+        continue;
+      continued += self(g, landing[i], king || (promoted && promotion == PROMOTE_CONTINUE_KING), captured | bit);
+    }
+    if (continued == 0)
+      for (int i = 0; i < landings; i++)
+        record_hod(g, landing[i], king, captured | bit);
+    found += continued > 0 ? continued : landings;
+  }
+  return found;
+}
+
+static inline __attribute__((always_inline)) int generate_hods_template(char lodic[8][8], char side, Hod_List *list,
+                                                                        bool flying, Capture_Step capture_step){
+  Gen_Context g;
+  g.cells = &lodic[0][0];
+  g.man = side;
+  g.king = side + 2;
+  g.enemy_man = side == '1' ? '2' : '1';
+  g.enemy_king = g.enemy_man + 2;
+  g.forward = side == '1' ? 1 : -1;
+  g.last_row = side == '1' ? 7 : 0;
+  g.list = list;
+  list->count = 0;
+  list->capture_count = 1;
+  list->captured[0] = 0;
+
+  for (int sq = 0; sq < SQUARES; sq++)
+  {
+    char *cell = &g.cells[sq_cell[sq]];
+    char piece = *cell;
+    if (piece != g.man && piece != g.king)
+      continue;
+    g.from = sq;
+    g.from_king = piece == g.king;
+    *cell = '0';
+    capture_step(&g, sq, g.from_king, 0);
+    *cell = piece;
+  }
+  if (list->count > 0)
+    return list->count;
+
+  for (int sq = 0; sq < SQUARES; sq++)
+  {
+    char piece = g.cells[sq_cell[sq]];
+    if (piece != g.man && piece != g.king)
+      continue;
+    g.from = sq;
+    g.from_king = piece == g.king;
+    for (int d = 0; d < 4; d++)
+    {
+      if (!g.from_king && DIR_DY(d) != g.forward)
+        continue;
+      for (const signed char *ray = sq_ray[sq][d]; *ray >= 0 && g.cells[sq_cell[*ray]] == '0'; ray++)
+      {
+        record_hod(&g, *ray, g.from_king, 0);
+        if (!(flying && g.from_king))
+          break;
+      }
+    }
+  }
+  return list->count;
+}
+
+#define DEFINE_HOD_GENERATOR(name, flying, men_back, promotion)                                           \
+  static int capture_step_##name(Gen_Context *g, int sq, bool king, uint32_t captured){                   \
+    return capture_step_template(g, sq, king, captured, flying, men_back, promotion, capture_step_##name);   \
+  }                                                                                                         \
+  int generate_hods_##name(char lodic[8][8], char side, Hod_List *list){                                  \
+    return generate_hods_template(lodic, side, list, flying, capture_step_##name);                         \
+  }
+
+DEFINE_HOD_GENERATOR(american, false, false, PROMOTE_END_MOVE)
+DEFINE_HOD_GENERATOR(russian, true, true, PROMOTE_CONTINUE_KING)
+DEFINE_HOD_GENERATOR(pool, true, true, PROMOTE_AT_END)
+
+bool select_rules(const char *name){
+  if (strcmp(name, "american") == 0)
+  {
+    rules_variant = RULES_AMERICAN;
+    generate_hods = generate_hods_american;
+  }
+  else if (strcmp(name, "russian") == 0)
+  {
+    rules_variant = RULES_RUSSIAN;
+    generate_hods = generate_hods_russian;
+  }
+  else if (strcmp(name, "pool") == 0)
+  {
+    rules_variant = RULES_POOL;
+    generate_hods = generate_hods_pool;
+  }
+  else
+    return false;
+  return true;
+}
+
+void initial_position(char lodic[8][8]){
+  for (int y = 0; y < 8; y++)
+    for (int x = 0; x < 8; x++)
+      lodic[y][x] = (x + y) % 2 == 0 ? ' ' : (y < 3 ? '1' : (y > 4 ? '2' : '0'));
+}
+
+void count_pieces(char lodic[8][8], GameState *gs){
+  int men[2] = {0, 0}, kings[2] = {0, 0}; // [0] - компьютер, [1] - игрок
+  for (int y = 0; y < 8; y++)
+    for (int x = 0; x < 8; x++)
+    {
+      char cell = lodic[y][x];
+      if (cell == '1' || cell == '2')
+        men[cell - '1']++;
+      else if (cell == '3' || cell == '4')
+        kings[cell - '3']++;
+    }
+  int white = player_is_white ? 1 : 0;
+  gs->count_white = men[white];
+  gs->count_white_king = kings[white];
+  gs->count_black = men[!white];
+  gs->count_black_king = kings[!white];
+}
+
+uint64_t perft(char lodic[8][8], char side, int depth){
+  Hod_List hods;
+  int count = generate_hods(lodic, side, &hods);
+  if (depth <= 1)
+    return count;
+  uint64_t total = 0;
+  for (int i = 0; i < count; i++)
+  {
+    char next[8][8];
+    memcpy(next, lodic, sizeof(char) * 8 * 8);
+    apply_hod(next, &hods, hods.hods[i]);
+    total += perft(next, side == '1' ? '2' : '1', depth - 1);
+  }
+  return total;
+}
+
+bool koordinaty(char x, char y, short *i_x, short *i_y, short *i_x_8, short *i_y_8){ // Расположение фишки на поле
+  if (x < 'A' || x > 'H' || y < '1' || y > '8')
+    return false;
+
+  short in_x = (short)(x - 'A');
+
+  short in_y = (short)(y - '0');
+
+  *i_x_8 = in_x;
+  *i_y_8 = 8 - in_y;
+  reverse_graph_koordinaty(*i_x_8, *i_y_8, i_x, i_y);
+
+  return true;
+}
+
+void print_turn(){ // Печать флага чей сейчас ход
+  printf("\nСейчас ход: %s\n", is_player_turn ? "игрока" : "компьютера");
+}
+
+void switch_turn(){ // Поменять ход
+  is_player_turn = !is_player_turn;
+}
+
+void highlight_piece(short x, short y, char board[BOARD_SIZE][SIZE + 1]){ // Выделить клетку
+  if (x > 1)
+    board[y][x - 1] = '#';
+  if (x < SIZE - 2)
+    board[y][x + 1] = '#';
+  print_board(board);
+
+  if (x > 1)
+    board[y][x - 1] = ' ';
+  if (x < SIZE - 2)
+    board[y][x + 1] = ' ';
+}
+
+bool check_game_over(){ // Проверка оканчания игры
+  int result = game_result();
+  if (result == 2)
+  {
+    if (game_state.count_white + game_state.count_white_king == 0)
+      printf("\nЧерные победили! У белых не осталось фишек.\n");
+    else
+      printf("\nЧерные победили! Белым некуда ходить.\n");
+    return true;
+  }
+
+  if (result == 1)
+  {
+    if (game_state.count_black + game_state.count_black_king == 0)
+      printf("\nБелые победили! У черных не осталось фишек.\n");
+    else
+      printf("\nБелые победили! Черным некуда ходить.\n");
+    return true;
+  }
+
+  if (result == 3)
+  {
+    if (history_draw(&game_history) == 1)
+      printf("\nНичья! Позиция повторилась три раза.\n");
+    else
+      printf("\nНичья! %d ходов без взятий и ходов простыми фишками.\n", draw_moves);
+    return true;
+  }
+
+  return false;
+}
+
+int game_result(){ // Исход партии: 0 - продолжается, 1 - белые, 2 - черные, 3 - ничья
+  if (game_state.count_white + game_state.count_white_king == 0)
+    return 2;
+  if (game_state.count_black + game_state.count_black_king == 0)
+    return 1;
+  if (history_draw(&game_history) != 0)
+    return 3;
+  // Сторона, которой некуда ходить, проигрывает
+  Hod_List hods;
+  if (generate_hods(lodic, is_player_turn ? '2' : '1', &hods) == 0)
+    return is_player_turn == player_is_white ? 2 : 1;
+  return 0;
+}
+
+char piece_symbol(char cell, bool white_on_bottom){
+  if (white_on_bottom)
+    return (cell == '0' ? '*' : (cell == '1' ? '0' : (cell == '2' ? 'O' : (cell == '3' ? 'B' : (cell == '4' ? 'W' : ' ')))));
+  return (cell == '0' ? '*' : (cell == '1' ? 'O' : (cell == '2' ? '0' : (cell == '3' ? 'W' : (cell == '4' ? 'B' : ' ')))));
+}
+
+void wash_piece(char board[BOARD_SIZE][SIZE + 1], short x, short y){
+  board[y][x] = '*';
+}
+
+void light(char board[BOARD_SIZE][SIZE + 1], short x, short y, bool not_chose){
+
+  if (not_chose)
+  {
+    board[y][x - 1] = '(';
+    board[y][x + 1] = ')';
+  }
+  else
+  {
+    board[y][x - 1] = ' ';
+    board[y][x + 1] = ' ';
+  }
+}
+
+bool computer_move(char board[BOARD_SIZE][SIZE + 1]){
+  (void)board; // Ход делается в lodic, поле перерисовывается отдельно
+  Hod_Info best;
+  if (computer_best_move(&best) == -SEARCH_INFINITY)
+    return false;
+  make_hod(&best);
+  return true;
+  // for (short x = 0; x < 8; x++)
+  //   for (short y = 0; y < 8; y++)
+  //   {
+  //     short bx, by;
+  //     reverse_graph_koordinaty(x, y, &bx, &by);
+  //     board[by][bx] = (lodic[y][x] == '0' ? '*' : (lodic[y][x] == '1' ? '0' : (lodic[y][x] == '2' ? 'O' : ' ')));
+  //   }
+}
+
+int computer_best_move(Hod_Info *best){
+  Search_Result result;
+  if (!search_position(lodic, '1', &search_options, &result))
+    return -SEARCH_INFINITY;
+  *best = result.best;
+  return result.score;
+}
+
+int evaluate_board_pc(char lodic[8][8], bool is_white){
+  int score = 0;
+  int our_count = is_white ? game_state.count_white : game_state.count_black;
+  int opponent_count = is_white ? game_state.count_black : game_state.count_white;
+  int inc = (our_count - opponent_count) * 10;
+  score += inc > 0 ? inc : 0;
+  our_count = is_white ? game_state.count_white_king : game_state.count_black_king;
+  opponent_count = is_white ? game_state.count_black_king : game_state.count_white_king;
+  inc = (our_count - opponent_count) * 15;
+  score += inc > 0 ? inc : 0;
+  score += (lodic[3][4] == '1') * 2;
+  score += (lodic[4][3] == '1') * 2;
+  score += (lodic[3][3] == '1') * 2;
+  score += (lodic[4][4] == '1') * 2;
+  return score;
+}
+
+int format_position(char lodic[8][8], bool white_on_bottom, char *out){
+  int len = 0;
+  for (int y = 0; y < 8; y++)
+  {
+    out[len++] = '8' - y;
+    for (int x = 0; x < 8; x++)
+    {
+      out[len++] = ' ';
+      out[len++] = piece_symbol(lodic[y][x], white_on_bottom);
+    }
+    out[len++] = '\n';
+  }
+  memcpy(out + len, "  A B C D E F G H\n", 18);
+  len += 18;
+  out[len] = '\0';
+  return len;
+}
+
+bool apply_player_move(short from_x, short from_y, short to_x, short to_y, uint32_t captured){
+  Hod_List hods;
+  generate_hods(lodic, '2', &hods);
+  int i = find_hod(&hods, from_x, from_y, to_x, to_y, captured);
+  if (i < 0)
+    return false;
+  Hod_Info h = hod_info(&hods, hods.hods[i]);
+  make_hod(&h);
+  return true;
+}
+
+void format_hod(const Hod_Info *h, char *out){
+  reverse_graph_out_koordinaty(h->from_x, h->from_y, &out[0], &out[1]);
+  out[2] = h->kills > 0 ? ':' : '-';
+  reverse_graph_out_koordinaty(h->to_x, h->to_y, &out[3], &out[4]);
+  out[5] = '\0';
+}
+
+int find_hod(const Hod_List *list, short from_x, short from_y, short to_x, short to_y, uint32_t captured){
+  int from = SQ_INDEX(from_x, from_y);
+  int to = SQ_INDEX(to_x, to_y);
+  for (int i = 0; i < list->count; i++)
+    if (HOD_FROM(list->hods[i]) == from && HOD_TO(list->hods[i]) == to &&
+        (captured == HOD_ANY_CAPTURE || list->captured[HOD_CAPTURE(list->hods[i])] == captured))
+      return i;
+  return -1;
+}
+
+Hod_Info hod_info(const Hod_List *list, Hod h){
+  Hod_Info info;
+  info.from_x = SQ_X(HOD_FROM(h));
+  info.from_y = SQ_Y(HOD_FROM(h));
+  info.to_x = SQ_X(HOD_TO(h));
+  info.to_y = SQ_Y(HOD_TO(h));
+  info.captured = list->captured[HOD_CAPTURE(h)];
+  info.kills = (short)__builtin_popcount(info.captured);
+  info.promotes = HOD_PROMOTES(h);
+  return info;
+}
+
+void apply_hod(char lodic[8][8], const Hod_List *list, Hod h){
+  int from = HOD_FROM(h);
+  int to = HOD_TO(h);
+  char piece = lodic[SQ_Y(from)][SQ_X(from)];
+  lodic[SQ_Y(from)][SQ_X(from)] = '0';
+  for (uint32_t rest = list->captured[HOD_CAPTURE(h)]; rest != 0; rest &= rest - 1)
+  {
+    int sq = __builtin_ctz(rest);
+    lodic[SQ_Y(sq)][SQ_X(sq)] = '0';
+  }
+  // Дамка на один больше простой того же цвета: '1' -> '3', '2' -> '4'
+  lodic[SQ_Y(to)][SQ_X(to)] = HOD_PROMOTES(h) ? piece + 2 : piece;
+}
+
+// Серверный режим: один поток обслуживает сокеты через epoll, ходы компьютера
+// считаются в ограниченном пуле потоков. Сессия попадает в пул целиком и до
+// возврата из него не трогается потоком событий.
+
+static Session *job_queue[SERVER_QUEUE_SIZE]; // Кольцевая очередь задач пула
+static int job_head = 0;
+static int job_count = 0;
+static bool server_stopping = false;
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+static Session *done_list = NULL;             // Сессии с готовым ходом компьютера
+static pthread_mutex_t done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int done_event_fd = -1;
+
+static bool job_queue_push(Session *s){
+  pthread_mutex_lock(&job_mutex);
+  if (job_count == SERVER_QUEUE_SIZE)
+  {
+    pthread_mutex_unlock(&job_mutex);
+    return false;
+  }
+  job_queue[(job_head + job_count) % SERVER_QUEUE_SIZE] = s;
+  job_count++;
+  pthread_cond_signal(&job_cond);
+  pthread_mutex_unlock(&job_mutex);
+  return true;
+}
+
+static Session *job_queue_pop(){
+  pthread_mutex_lock(&job_mutex);
+  while (job_count == 0 && !server_stopping)
+    pthread_cond_wait(&job_cond, &job_mutex);
+  Session *s = NULL;
+  if (job_count > 0)
+  {
+    s = job_queue[job_head];
+    job_head = (job_head + 1) % SERVER_QUEUE_SIZE;
+    job_count--;
+  }
+  pthread_mutex_unlock(&job_mutex);
+  return s;
+}
+
+static void session_load(Session *s){
+  // Переносит партию сессии в состояние текущего потока
+  memcpy(lodic, s->lodic, sizeof(char) * 8 * 8);
+  game_state = s->game_state;
+  game_history = s->history;
+  player_is_white = s->player_is_white;
+  is_player_turn = s->is_player_turn;
+  rng_state = s->rng_state;
+}
+
+static void session_store(Session *s){
+  memcpy(s->lodic, lodic, sizeof(char) * 8 * 8);
+  s->game_state = game_state;
+  s->history = game_history;
+  s->rng_state = rng_state;
+}
+
+static void session_done(Session *s){
+  // Возвращает сессию потоку событий
+  pthread_mutex_lock(&done_mutex);
+  s->next_done = done_list;
+  done_list = s;
+  pthread_mutex_unlock(&done_mutex);
+  uint64_t one = 1;
+  if (write(done_event_fd, &one, sizeof(one)) < 0)
+    perror("eventfd");
+}
+
+// Самый длинный ответ hint: строки "HINT 8 A1-B2 -30000" с вариантами по
+// " A1-B2" на полуход и "OK depth 63"
+_Static_assert(SERVER_HINT_LINES * (20 + 6 * SERVER_HINT_PV) + 12 < SERVER_HINT_SIZE &&
+                   SERVER_HINT_SIZE < SERVER_OUT_SIZE,
+               "ответ hint должен помещаться в буфер сессии");
+
+static void session_hint(Session *s){
+  // Подсказка не расходует генератор партии, иначе следующий ход компьютера
+  // зависел бы от того, просил ли игрок подсказку
+  Search_Line lines[SERVER_HINT_LINES];
+  Search_Result result;
+  int count = search_multipv(lodic, '2', &search_options, s->hint_lines, lines, &result);
+  rng_state = s->rng_state;
+  // Ответ собирается целиком в поле сессии, как ход компьютера в
+  // computer_hod: выходной буфер принадлежит потоку событий
+  char *reply = s->hint_reply;
+  size_t size = sizeof(s->hint_reply);
+  int len = 0;
+  for (int k = 0; k < count; k++)
+  {
+    char move[8];
+    format_hod(&lines[k].move, move);
+    len += snprintf(reply + len, size - len, "HINT %d %s %d", k + 1, move, lines[k].score);
+    for (int i = 0; i < lines[k].pv_length && i < SERVER_HINT_PV; i++)
+    {
+      format_search_move(lines[k].pv[i], move);
+      len += snprintf(reply + len, size - len, " %s", move);
+    }
+    len += snprintf(reply + len, size - len, "\n");
+  }
+  snprintf(reply + len, size - len, "OK depth %d\n", result.depth);
+}
+
+static void *search_worker(void *arg){
+  (void)arg;
+  Session *s;
+  while ((s = job_queue_pop()) != NULL)
+  {
+    // Загружаем сессию в состояние потока и считаем ход как в обычной игре
+    session_load(s);
+    if (s->hint_lines > 0)
+    {
+      session_hint(s);
+      session_done(s);
+      continue;
+    }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    s->computer_moved = computer_move(board);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (s->computer_moved)
+    {
+      format_hod(&last_hod, s->computer_hod);
+      replay_write_hod(s->log_fd, "computer", &last_hod,
+                       (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000);
+    }
+    session_store(s);
+    session_done(s);
+  }
+  return NULL;
+}
+
+// false - текст не поместился в буфер и не добавлен
+static bool session_printf(Session *s, const char *fmt, ...){
+  if (s->out_off > 0 && s->out_off == s->out_len)
+    s->out_off = s->out_len = 0;
+  else if (s->out_off > SERVER_OUT_SIZE / 2)
+  {
+    memmove(s->out_buf, s->out_buf + s->out_off, s->out_len - s->out_off);
+    s->out_len -= s->out_off;
+    s->out_off = 0;
+  }
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(s->out_buf + s->out_len, SERVER_OUT_SIZE - s->out_len, fmt, args);
+  va_end(args);
+  if (n < 0 || s->out_len + n >= SERVER_OUT_SIZE)
+    return false;
+  s->out_len += n;
+  return true;
+}
+
+static void session_print_position(Session *s){
+  char text[256];
+  format_position(s->lodic, s->player_is_white, text);
+  session_printf(s, "%s", text);
+}
+
+static void session_report_result(Session *s){
+  session_load(s);
+  int result = game_result();
+  if (result != 0)
+  {
+    const char *winner = result == 1 ? "white" : (result == 2 ? "black" : "draw");
+    session_printf(s, "GAMEOVER %s\n", winner);
+    replay_write(s->log_fd, "result %s\n", winner);
+    s->started = false;
+  }
+  else
+    session_printf(s, "TURN %s\n", s->is_player_turn ? "you" : "computer");
+}
+
+static void session_request_search(Session *s){
+  s->busy = true;
+  if (!job_queue_push(s))
+  {
+    s->busy = false;
+    session_printf(s, "ERR сервер перегружен, повторите команду позже\n");
+  }
+}
+
+static void session_flush(int epoll_fd, Session *s){
+  while (s->out_off < s->out_len)
+  {
+    ssize_t n = send(s->fd, s->out_buf + s->out_off, s->out_len - s->out_off, MSG_NOSIGNAL);
+    if (n < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      s->out_off = s->out_len;
+      return;
+    }
+    s->out_off += n;
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLRDHUP | (s->out_off < s->out_len ? EPOLLOUT : 0);
+  ev.data.ptr = s;
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, s->fd, &ev);
+}
+
+static uint64_t server_seed_state = 0;       // Источник зерен новых сессий
+static const char *server_record_dir = NULL; // Каталог журналов сессий
+static unsigned long server_log_counter = 0;
+
+static uint64_t server_next_seed(){
+  // splitmix64 над отдельным состоянием: зерна сессий зависят только от
+  // зерна сервера и порядка команд new
+  uint64_t z = (server_seed_state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static void session_open_log(Session *s){
+  if (s->log_fd >= 0)
+    close(s->log_fd);
+  s->log_fd = -1;
+  if (server_record_dir == NULL)
+    return;
+  char path[512];
+  snprintf(path, sizeof(path), "%s/session-%lu-%llu.log", server_record_dir, ++server_log_counter,
+           (unsigned long long)s->seed);
+  s->log_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (s->log_fd < 0)
+    perror(path);
+  replay_write_header(s->log_fd, s->seed, s->player_is_white);
+}
+
+static void session_command(Session *s, char *line){
+  char cmd[16] = {0}, arg1[16] = {0}, arg2[16] = {0};
+  int args = sscanf(line, "%15s %15s %15s", cmd, arg1, arg2);
+  if (args <= 0)
+    return;
+  for (int i = 0; cmd[i]; i++)
+    cmd[i] = tolower(cmd[i]);
+
+  if (s->busy && strcmp(cmd, "quit") != 0)
+  {
+    session_printf(s, "ERR компьютер думает\n");
+    return;
+  }
+
+  if (strcmp(cmd, "new") == 0)
+  {
+    for (int i = 0; arg1[i]; i++)
+      arg1[i] = tolower(arg1[i]);
+    if (strcmp(arg1, "white") != 0 && strcmp(arg1, "black") != 0)
+    {
+      session_printf(s, "ERR укажите цвет: new white или new black [зерно]\n");
+      return;
+    }
+    // Начальная расстановка всегда одинакова: фишки компьютера сверху
+    initial_position(s->lodic);
+    s->game_state = (GameState){12, 12, 0, 0};
+    s->player_is_white = strcmp(arg1, "white") == 0;
+    s->is_player_turn = s->player_is_white;
+    history_reset(&s->history, position_hash(s->lodic, s->is_player_turn ? '2' : '1'));
+    s->started = true;
+    if (args >= 3)
+      s->seed = strtoull(arg2, NULL, 10);
+    else
+      s->seed = server_next_seed();
+    rng_seed(s->seed);
+    s->rng_state = rng_state;
+    session_open_log(s);
+    session_printf(s, "OK seed %llu\n", (unsigned long long)s->seed);
+    session_print_position(s);
+    session_report_result(s);
+    if (!s->is_player_turn)
+      session_request_search(s);
+  }
+  else if (strcmp(cmd, "move") == 0)
+  {
+    short from_x, from_y, to_x, to_y, gx, gy;
+    if (!s->started || !s->is_player_turn)
+    {
+      session_printf(s, "ERR сейчас не ваш ход\n");
+      return;
+    }
+    if (args < 3 || strlen(arg1) != 2 || strlen(arg2) != 2 ||
+        !koordinaty(toupper(arg1[0]), arg1[1], &gx, &gy, &from_x, &from_y) ||
+        !koordinaty(toupper(arg2[0]), arg2[1], &gx, &gy, &to_x, &to_y))
+    {
+      session_printf(s, "ERR формат хода: move B3 C4\n");
+      return;
+    }
+    session_load(s);
+    if (!apply_player_move(from_x, from_y, to_x, to_y, HOD_ANY_CAPTURE))
+    {
+      session_printf(s, "ERR недопустимый ход\n");
+      return;
+    }
+    replay_write_hod(s->log_fd, "player", &last_hod, 0);
+    session_store(s);
+    s->is_player_turn = false;
+    session_printf(s, "OK\n");
+    session_report_result(s);
+    if (s->started)
+      session_request_search(s);
+  }
+  else if (strcmp(cmd, "hint") == 0)
+  {
+    if (!s->started || !s->is_player_turn)
+    {
+      session_printf(s, "ERR сейчас не ваш ход\n");
+      return;
+    }
+    int lines = args >= 2 ? atoi(arg1) : 1;
+    s->hint_lines = lines < 1 ? 1 : (lines > SERVER_HINT_LINES ? SERVER_HINT_LINES : lines);
+    session_request_search(s);
+    if (!s->busy)
+      s->hint_lines = 0;
+  }
+  else if (strcmp(cmd, "board") == 0)
+  {
+    if (!s->started)
+      session_printf(s, "ERR партия не начата\n");
+    else
+      session_print_position(s);
+  }
+  else if (strcmp(cmd, "quit") == 0)
+  {
+    session_printf(s, "BYE\n");
+    s->in_len = -1;
+  }
+  else
+    session_printf(s, "ERR команды: new white|black [зерно], move B3 C4, hint [N], board, quit\n");
+}
+
+static void session_close(int epoll_fd, Session *s, int *sessions){
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+  close(s->fd);
+  s->fd = -1;
+  (*sessions)--;
+  // Сессию из пула освободит поток событий, когда поиск закончится
+  if (!s->busy)
+  {
+    if (s->log_fd >= 0)
+      close(s->log_fd);
+    free(s);
+  }
+}
+
+static int server_listen(const char *address){
+  int fd;
+  if (strchr(address, '/') != NULL)
+  {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(address) >= sizeof(addr.sun_path))
+    {
+      printf("Слишком длинный путь сокета: %s\n", address);
+      return -1;
+    }
+    strcpy(addr.sun_path, address);
+    unlink(address);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+      perror("bind");
+      return -1;
+    }
+  }
+  else
+  {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const char *port = strrchr(address, ':');
+    if (port != NULL)
+    {
+      char host[64];
+      int host_len = (int)(port - address);
+      if (host_len >= (int)sizeof(host))
+        host_len = sizeof(host) - 1;
+      memcpy(host, address, host_len);
+      host[host_len] = '\0';
+      if (inet_pton(AF_INET, host, &addr.sin_addr) != 1)
+      {
+        printf("Неверный адрес: %s\n", address);
+        return -1;
+      }
+      port++;
+    }
+    else
+      port = address;
+    addr.sin_port = htons((unsigned short)atoi(port));
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int yes = 1;
+    if (fd >= 0)
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+      perror("bind");
+      return -1;
+    }
+  }
+  if (listen(fd, 512) < 0)
+  {
+    perror("listen");
+    return -1;
+  }
+  return fd;
+}
+
+int run_server(const char *address, int workers, int max_sessions, uint64_t seed, const char *record_dir){
+  server_seed_state = seed;
+  server_record_dir = record_dir;
+  int listen_fd = server_listen(address);
+  if (listen_fd < 0)
+    return 1;
+  // SIGINT и SIGTERM приходят через signalfd, чтобы сервер останавливался
+  // обычным путем и успевал сохранить кэш анализа. Маску наследуют потоки пула
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+  int signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK);
+  int epoll_fd = epoll_create1(0);
+  done_event_fd = eventfd(0, EFD_NONBLOCK);
+  if (epoll_fd < 0 || done_event_fd < 0 || signal_fd < 0)
+  {
+    perror("epoll");
+    return 1;
+  }
+
+  // Метки для сокета прослушивания, уведомлений пула и сигналов
+  static int listen_tag, done_tag, signal_tag;
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = &listen_tag;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+  ev.data.ptr = &done_tag;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, done_event_fd, &ev);
+  ev.data.ptr = &signal_tag;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev);
+
+  pthread_t *threads = malloc(sizeof(pthread_t) * workers);
+  for (int i = 0; i < workers; i++)
+    pthread_create(&threads[i], NULL, search_worker, NULL);
+
+  printf("Сервер слушает %s: потоков поиска %d, сессий до %d, зерно %llu\n", address, workers, max_sessions,
+         (unsigned long long)seed);
+  fflush(stdout);
+
+  int sessions = 0;
+  struct epoll_event events[256];
+  bool running = true;
+  while (running)
+  {
+    int n = epoll_wait(epoll_fd, events, 256, -1);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("epoll_wait");
+      break;
+    }
+    for (int i = 0; i < n; i++)
+    {
+      if (events[i].data.ptr == &signal_tag)
+      {
+        printf("Сервер остановлен сигналом\n");
+        running = false;
+        break;
+      }
+
+      if (events[i].data.ptr == &listen_tag)
+      {
+        int fd;
+        while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0)
+        {
+          Session *s = sessions < max_sessions ? calloc(1, sizeof(Session)) : NULL;
+          if (s == NULL)
+          {
+            close(fd);
+            continue;
+          }
+          s->fd = fd;
+          s->log_fd = -1;
+          sessions++;
+          ev.events = EPOLLIN | EPOLLRDHUP;
+          ev.data.ptr = s;
+          epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+          session_printf(s, "SHASHKI команды: new white|black [зерно], move B3 C4, hint [N], board, quit\n");
+          session_flush(epoll_fd, s);
+        }
+        continue;
+      }
+
+      if (events[i].data.ptr == &done_tag)
+      {
+        uint64_t count;
+        if (read(done_event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+          perror("eventfd");
+        pthread_mutex_lock(&done_mutex);
+        Session *list = done_list;
+        done_list = NULL;
+        pthread_mutex_unlock(&done_mutex);
+        while (list != NULL)
+        {
+          Session *s = list;
+          list = s->next_done;
+          s->busy = false;
+          if (s->fd < 0)
+          {
+            if (s->log_fd >= 0)
+              close(s->log_fd);
+            free(s);
+            continue;
+          }
+          if (s->hint_lines > 0)
+          {
+            // Клиент ждет строку OK, и обрезанный ответ хуже явной ошибки
+            if (!session_printf(s, "%s", s->hint_reply))
+              session_printf(s, "ERR ответ не помещается в буфер, прочитайте прежние ответы\n");
+            s->hint_lines = 0;
+          }
+          else if (s->computer_moved)
+          {
+            session_printf(s, "COMPUTER %s\n", s->computer_hod);
+            session_print_position(s);
+            s->is_player_turn = true;
+            session_report_result(s);
+          }
+          else
+          {
+            session_printf(s, "GAMEOVER %s\n", s->player_is_white ? "white" : "black");
+            replay_write(s->log_fd, "result %s\n", s->player_is_white ? "white" : "black");
+            s->started = false;
+          }
+          session_flush(epoll_fd, s);
+        }
+        continue;
+      }
+
+      Session *s = events[i].data.ptr;
+      if (events[i].events & EPOLLIN)
+      {
+        while (s->in_len >= 0)
+        {
+          ssize_t got = recv(s->fd, s->in_buf + s->in_len, SERVER_LINE_SIZE - 1 - s->in_len, 0);
+          if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+          {
+            s->in_len = -1;
+            break;
+          }
+          if (got < 0)
+            break;
+          s->in_len += got;
+          s->in_buf[s->in_len] = '\0';
+          char *line = s->in_buf, *end;
+          while (s->in_len >= 0 && (end = strchr(line, '\n')) != NULL)
+          {
+            *end = '\0';
+            session_command(s, line);
+            line = end + 1;
+          }
+          if (s->in_len < 0)
+            break;
+          s->in_len -= (int)(line - s->in_buf);
+          memmove(s->in_buf, line, s->in_len + 1);
+          if (s->in_len == SERVER_LINE_SIZE - 1)
+          {
+            session_printf(s, "ERR слишком длинная команда\n");
+            s->in_len = 0;
+          }
+        }
+        session_flush(epoll_fd, s);
+      }
+      if (events[i].events & EPOLLOUT)
+        session_flush(epoll_fd, s);
+      if (s->in_len < 0 || (events[i].events & (EPOLLERR | EPOLLHUP)))
+        session_close(epoll_fd, s, &sessions);
+    }
+  }
+
+  pthread_mutex_lock(&job_mutex);
+  server_stopping = true;
+  pthread_cond_broadcast(&job_cond);
+  pthread_mutex_unlock(&job_mutex);
+  for (int i = 0; i < workers; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+  close(listen_fd);
+  close(epoll_fd);
+  close(signal_fd);
+  return 0;
+}
+
+// Пакетная оценка позиций
+
+void pack_position(char lodic[8][8], uint32_t masks[4]){
+  // Младшие три бита символа клетки - ее код: '1' = 001, '2' = 010,
+  // '3' = 011, '4' = 100, пустые '0' и ' ' дают 000. Биты кода собираются в
+  // три маски, из которых фишки получаются логикой
+  uint32_t bits[3] = {0, 0, 0};
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  // Строка читается одним словом: темные клетки - байты через один, нужный
+  // бит каждого из них умножение переносит в четыре старших бита слова
+  for (int y = 0; y < 8; y++)
+  {
+    uint64_t row;
+    memcpy(&row, lodic[y], sizeof(row));
+    uint64_t dark = y % 2 == 0 ? 0x0100010001000100ull : 0x0001000100010001ull;
+    uint64_t gather = y % 2 == 0 ? 0x0010002000400080ull : 0x1000200040008000ull;
+    for (int k = 0; k < 3; k++)
+      bits[k] |= (uint32_t)((((row >> k) & dark) * gather) >> 60) << (4 * y);
+  }
+#else
+  for (int sq = 0; sq < SQUARES; sq++)
+  {
+    uint32_t code = (uint32_t)lodic[SQ_Y(sq)][SQ_X(sq)];
+    for (int k = 0; k < 3; k++)
+      bits[k] |= ((code >> k) & 1) << sq;
+  }
+#endif
+  masks[0] = bits[0] & ~bits[1];
+  masks[1] = bits[0] & bits[1];
+  masks[2] = bits[1] & ~bits[0];
+  masks[3] = bits[2];
+}
+
+void unpack_position(const uint32_t masks[4], char lodic[8][8]){
+  for (int y = 0; y < 8; y++)
+    for (int x = 0; x < 8; x++)
+      lodic[y][x] = (x + y) % 2 == 0 ? ' ' : '0';
+  for (int sq = 0; sq < SQUARES; sq++)
+  {
+    uint32_t bit = 1u << sq;
+    if (masks[0] & bit)
+      lodic[SQ_Y(sq)][SQ_X(sq)] = '1';
+    else if (masks[1] & bit)
+      lodic[SQ_Y(sq)][SQ_X(sq)] = '3';
+    else if (masks[2] & bit)
+      lodic[SQ_Y(sq)][SQ_X(sq)] = '2';
+    else if (masks[3] & bit)
+      lodic[SQ_Y(sq)][SQ_X(sq)] = '4';
+  }
+}
+
+// Оценка по маскам темных клеток. Все слагаемые - количества фишек в
+// группах клеток, умноженные на веса, поэтому одна и та же формула
+// считается для одной позиции и для вектора позиций. Бит sq маски - клетка
+// SQ_INDEX: четыре клетки строки подряд, строка y занимает биты 4y..4y+3.
+#define MASK_EVEN_ROWS 0x0F0F0F0Fu     /**< Клетки строк 0, 2, 4, 6 */
+#define MASK_ODD_ROWS 0xF0F0F0F0u      /**< Клетки строк 1, 3, 5, 7 */
+#define MASK_FIRST 0x11111111u         /**< Первые клетки строк */
+#define MASK_LAST 0x88888888u          /**< Последние клетки строк */
+#define MASK_ROW(y) (0xFu << 4 * (y))  /**< Клетки строки y */
+#define MASK_ROW_BIT1 0xFF00FF00u      /**< Клетки строк, номер которых содержит 2 */
+#define MASK_ROW_BIT2 0xFFFF0000u      /**< Клетки строк, номер которых содержит 4 */
+#define EVAL_RUNAWAY 30                /**< Надбавка простой, которой ничто не мешает дойти до дамки */
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(__POPCNT__)
+#define EVAL_DISPATCH __attribute__((target_clones("popcnt", "default")))
+#else
+#define EVAL_DISPATCH
+#endif
+
+// Клетки, с которых простая '1' (идет вниз) или '2' (идет вверх) ходит на
+// клетку из m. Соседи снизу: sq + 4 и sq + 5 в четной строке, sq + 3 и
+// sq + 4 в нечетной; крайние клетки строк теряют одного соседа
+#define BEHIND_DOWN(m) \
+  (((m) >> 4) | (((m) >> 5) & (MASK_EVEN_ROWS & ~MASK_LAST)) | (((m) >> 3) & (MASK_ODD_ROWS & ~MASK_FIRST)))
+#define BEHIND_UP(m) \
+  (((m) << 4) | (((m) << 3) & (MASK_EVEN_ROWS & ~MASK_LAST)) | (((m) << 5) & (MASK_ODD_ROWS & ~MASK_FIRST)))
+
+// Оценка за сторону '1' - '3': материал, продвижение простых (4 за строку,
+// сумма номеров строк собирается из трех масок), простые на своей первой
+// строке (10), фигуры в центре (20) и убегающие простые - на предпоследней
+// строке со свободным полем превращения или за строку до нее со свободным
+// путем из двух ходов. Тип T - маска или вектор масок, POP - подсчет битов
+#define EVAL_MASKS(T, POP, tm, tk, bm, bk)                                                                        \
+  ({                                                                                                              \
+    T empty_ = ~((tm) | (tk) | (bm) | (bk));                                                                      \
+    T down_ = BEHIND_DOWN(empty_ & MASK_ROW(7));                                                                  \
+    T up_ = BEHIND_UP(empty_ & MASK_ROW(0));                                                                      \
+    T top_run_ = ((tm) & MASK_ROW(6) & down_) | ((tm) & MASK_ROW(5) & BEHIND_DOWN(empty_ & MASK_ROW(6) & down_)); \
+    T bottom_run_ = ((bm) & MASK_ROW(1) & up_) | ((bm) & MASK_ROW(2) & BEHIND_UP(empty_ & MASK_ROW(1) & up_));   \
+    (POP(tm) - POP(bm)) * 100 + (POP(tk) - POP(bk)) * 150 +                                                       \
+        (POP((tm) & MASK_ODD_ROWS) + POP((tm) & MASK_ROW_BIT1) * 2 + POP((tm) & MASK_ROW_BIT2) * 4 +              \
+         POP((bm) & MASK_ODD_ROWS) + POP((bm) & MASK_ROW_BIT1) * 2 + POP((bm) & MASK_ROW_BIT2) * 4 - POP(bm) * 7) * 4 + \
+        (POP((tm) & MASK_ROW(0)) - POP((bm) & MASK_ROW(7))) * 10 +                                                \
+        (POP(((tm) | (tk)) & CENTER_MASK) - POP(((bm) | (bk)) & CENTER_MASK)) * 20 +                             \
+        (POP(top_run_) - POP(bottom_run_)) * EVAL_RUNAWAY;                                                        \
+  })
+
+// Без -mpopcnt __builtin_popcount - вызов библиотечной функции, поэтому
+// скалярная оценка собирается в двух вариантах и выбирается при загрузке
+EVAL_DISPATCH int evaluate_masks(const uint32_t masks[4]){
+  return EVAL_MASKS(uint32_t, __builtin_popcount, masks[0], masks[1], masks[2], masks[3]);
+}
+
+// Векторные ядра: 4 позиции за раз (SSE2 на x86-64, NEON на ARM) и 8 позиций
+// на AVX2. Подсчет битов сделан сложением по парам, поэтому он одинаково
+// работает в каждой полосе вектора. Ядро AVX2 собирается с атрибутом target
+// и выбирается во время работы, если процессор его поддерживает.
+#define VEC_LANES 8   /**< Наибольшая ширина ядра: границы частей пакета кратны ей */
+
+#define DEFINE_EVAL_KERNEL(name, lanes, target)                                                       \
+  typedef uint32_t name##_u32 __attribute__((vector_size(lanes * 4)));                                \
+  typedef int32_t name##_i32 __attribute__((vector_size(lanes * 4)));                                 \
+  target static inline name##_i32 name##_popcount(name##_u32 v){                                     \
+    v = v - ((v >> 1) & 0x55555555u);                                                                 \
+    v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);                                                \
+    v = (v + (v >> 4)) & 0x0F0F0F0Fu;                                                                 \
+    return (name##_i32)((v * 0x01010101u) >> 24);                                                     \
+  }                                                                                                   \
+  target static void evaluate_kernel_##name(const PositionBatch *batch, size_t begin, size_t end){   \
+    size_t i = begin;                                                                                 \
+    for (; i + lanes <= end; i += lanes)                                                              \
+    {                                                                                                 \
+      name##_u32 tm, tk, bm, bk;                                                                      \
+      memcpy(&tm, batch->our_men + i, sizeof(tm));                                                    \
+      memcpy(&tk, batch->our_kings + i, sizeof(tk));                                                  \
+      memcpy(&bm, batch->their_men + i, sizeof(bm));                                                  \
+      memcpy(&bk, batch->their_kings + i, sizeof(bk));                                                \
+      name##_i32 score = EVAL_MASKS(name##_u32, name##_popcount, tm, tk, bm, bk);                    \
+      memcpy(batch->scores + i, &score, sizeof(score));                                               \
+    }                                                                                                 \
+    for (; i < end; i++)                                                                              \
+    {                                                                                                 \
+      uint32_t masks[4] = {batch->our_men[i], batch->our_kings[i], batch->their_men[i], batch->their_kings[i]}; \
+      batch->scores[i] = evaluate_masks(masks);                                                       \
+    }                                                                                                 \
+  }
+
+DEFINE_EVAL_KERNEL(vec4, 4, )
+#if defined(__x86_64__) || defined(__i386__)
+DEFINE_EVAL_KERNEL(avx2, 8, __attribute__((target("avx2"))))
+#endif
+
+static void evaluate_kernel_scalar(const PositionBatch *batch, size_t begin, size_t end){
+  for (size_t i = begin; i < end; i++)
+  {
+    uint32_t masks[4] = {batch->our_men[i], batch->our_kings[i], batch->their_men[i], batch->their_kings[i]};
+    batch->scores[i] = evaluate_masks(masks);
+  }
+}
+
+typedef void (*Eval_Kernel)(const PositionBatch *batch, size_t begin, size_t end);
+
+typedef struct
+{
+  const char *name;
+  Eval_Kernel run;
+} Eval_Kernel_Info;
+
+static const Eval_Kernel_Info eval_kernels[] = {
+    {"scalar", evaluate_kernel_scalar},
+    {"vec4", evaluate_kernel_vec4},
+#if defined(__x86_64__) || defined(__i386__)
+    {"avx2", evaluate_kernel_avx2},
+#endif
+};
+
+static bool eval_kernel_supported(const Eval_Kernel_Info *kernel){
+#if defined(__x86_64__) || defined(__i386__)
+  if (strcmp(kernel->name, "avx2") == 0)
+    return __builtin_cpu_supports("avx2");
+#endif
+  (void)kernel;
+  return true;
+}
+
+// Ядра перечислены от медленного к быстрому: берется последнее доступное
+static const Eval_Kernel_Info *eval_kernel_best(){
+  const Eval_Kernel_Info *best = &eval_kernels[0];
+  for (size_t k = 0; k < sizeof(eval_kernels) / sizeof(eval_kernels[0]); k++)
+    if (eval_kernel_supported(&eval_kernels[k]))
+      best = &eval_kernels[k];
+  return best;
+}
+
+static inline int popcount32(uint32_t v){
+  return __builtin_popcount(v);
+}
+
+static void evaluate_batch_shallow(const PositionBatch *batch, size_t begin, size_t end, int depth){
+  // Позиции пакета не связаны с партией: повторений до корня нет
+  Search_Options options = search_options;
+  options.depth = depth;
+  options.time_ms = 0;
+  options.max_nodes = 0;
+  game_history.count = 0;
+  rng_seed(0);
+  for (size_t i = begin; i < end; i++)
+  {
+    uint32_t masks[4] = {batch->our_men[i], batch->our_kings[i], batch->their_men[i], batch->their_kings[i]};
+    unpack_position(masks, lodic);
+    Search_Result result;
+    batch->scores[i] = search_position(lodic, '1', &options, &result) ? result.score : -SEARCH_INFINITY;
+  }
+}
+
+typedef struct
+{
+  const PositionBatch *batch;
+  size_t begin;
+  size_t end;
+  int depth;
+} BatchTask;
+
+static void *evaluate_batch_thread(void *arg){
+  BatchTask *task = arg;
+  if (task->depth == 0)
+    eval_kernel_best()->run(task->batch, task->begin, task->end);
+  else
+    evaluate_batch_shallow(task->batch, task->begin, task->end, task->depth);
+  return NULL;
+}
+
+void evaluate_batch(PositionBatch *batch, int depth, int threads){
+  if (threads <= 0)
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  // Мелкие пакеты дешевле посчитать в одном потоке, чем запускать новые
+  size_t min_chunk = depth == 0 ? 65536 : 256;
+  if ((size_t)threads > batch->count / min_chunk)
+    threads = (int)(batch->count / min_chunk);
+  if (threads <= 1)
+  {
+    BatchTask task = {batch, 0, batch->count, depth};
+    evaluate_batch_thread(&task);
+    return;
+  }
+
+  pthread_t *ids = malloc(sizeof(pthread_t) * threads);
+  BatchTask *tasks = malloc(sizeof(BatchTask) * threads);
+  size_t chunk = (batch->count + threads - 1) / threads;
+  chunk = (chunk + VEC_LANES - 1) / VEC_LANES * VEC_LANES;
+  for (int t = 0; t < threads; t++)
+  {
+    tasks[t].batch = batch;
+    tasks[t].begin = chunk * t < batch->count ? chunk * t : batch->count;
+    tasks[t].end = tasks[t].begin + chunk < batch->count ? tasks[t].begin + chunk : batch->count;
+    tasks[t].depth = depth;
+    pthread_create(&ids[t], NULL, evaluate_batch_thread, &tasks[t]);
+  }
+  for (int t = 0; t < threads; t++)
+    pthread_join(ids[t], NULL);
+  free(ids);
+  free(tasks);
+}
+
+bool bench_evaluate_batch(size_t count, int threads){
+  if (count == 0)
+    count = 1;
+  PositionBatch batch;
+  batch.count = count;
+  batch.our_men = malloc(sizeof(uint32_t) * count);
+  batch.our_kings = malloc(sizeof(uint32_t) * count);
+  batch.their_men = malloc(sizeof(uint32_t) * count);
+  batch.their_kings = malloc(sizeof(uint32_t) * count);
+  batch.scores = malloc(sizeof(int32_t) * count);
+
+  // Случайные, но непересекающиеся расстановки
+  uint32_t seed = 12345;
+  for (size_t i = 0; i < count; i++)
+  {
+    uint32_t parts[4] = {0, 0, 0, 0};
+    for (int sq = 0; sq < SQUARES; sq++)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      int kind = seed >> 29;
+      if (kind < 4)
+        parts[kind] |= 1u << sq;
+    }
+    batch.our_men[i] = parts[0];
+    batch.our_kings[i] = parts[1];
+    batch.their_men[i] = parts[2];
+    batch.their_kings[i] = parts[3];
+  }
+
+  // Каждое ядро в одном потоке; результат сверяется со скалярной оценкой
+  struct timespec start, finish;
+  size_t total_mismatches = 0;
+  int32_t *expected = malloc(sizeof(int32_t) * count);
+  evaluate_kernel_scalar(&batch, 0, count);
+  memcpy(expected, batch.scores, sizeof(int32_t) * count);
+  for (size_t k = 0; k < sizeof(eval_kernels) / sizeof(eval_kernels[0]); k++)
+  {
+    if (!eval_kernel_supported(&eval_kernels[k]))
+    {
+      printf("Ядро %-8s не поддерживается процессором\n", eval_kernels[k].name);
+      continue;
+    }
+    memset(batch.scores, 0, sizeof(int32_t) * count);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    eval_kernels[k].run(&batch, 0, count);
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    double seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; i++)
+      mismatches += batch.scores[i] != expected[i];
+    total_mismatches += mismatches;
+    printf("Ядро %-8s %7.1f млн позиций/с, расхождений: %zu\n", eval_kernels[k].name,
+           seconds > 0 ? count / seconds / 1e6 : 0.0, mismatches);
+  }
+
+  // Оценки по доске: прежняя evaluate_board_pc и evaluate_position поиска,
+  // которая сверяется с ядрами
+  size_t boards = count < (1u << 20) ? count : (1u << 20);
+  char (*positions)[8][8] = malloc(sizeof(char) * 8 * 8 * boards);
+  for (size_t i = 0; i < boards; i++)
+  {
+    uint32_t masks[4] = {batch.our_men[i], batch.our_kings[i], batch.their_men[i], batch.their_kings[i]};
+    unpack_position(masks, positions[i]);
+  }
+  player_is_white = false;
+  volatile long sink = 0;   // Не дает компилятору выбросить замеряемые вызовы
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < boards; i++)
+  {
+    game_state.count_white = popcount32(batch.our_men[i]);
+    game_state.count_white_king = popcount32(batch.our_kings[i]);
+    game_state.count_black = popcount32(batch.their_men[i]);
+    game_state.count_black_king = popcount32(batch.their_kings[i]);
+    sink += evaluate_board_pc(positions[i], true);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  double seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+  printf("evaluate_board_pc  %7.1f млн позиций/с\n", seconds > 0 ? boards / seconds / 1e6 : 0.0);
+  size_t mismatches = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < boards; i++)
+  {
+    int score = evaluate_position(positions[i], '1');
+    sink += score;
+    mismatches += score != expected[i];
+  }
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+  printf("evaluate_position  %7.1f млн позиций/с, расхождений: %zu\n", seconds > 0 ? boards / seconds / 1e6 : 0.0,
+         mismatches);
+  total_mismatches += mismatches;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  evaluate_batch(&batch, 0, threads);
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+  printf("Оценено позиций: %zu за %.3f с (%.1f млн/с), ядро %s\n", count, seconds,
+         seconds > 0 ? count / seconds / 1e6 : 0.0, eval_kernel_best()->name);
+
+  free(positions);
+  free(expected);
+  free(batch.our_men);
+  free(batch.our_kings);
+  free(batch.their_men);
+  free(batch.their_kings);
+  free(batch.scores);
+  return total_mismatches == 0;
+}
+
+// Нейросетевая оценка (--nnue). Входы - фишки с точки зрения каждой
+// стороны: своя сторона всегда внизу, доска стороны '1' повернута на 180
+// градусов. Первый слой считается для обеих сторон в накопителе int16,
+// который поиск обновляет на ходу только по изменившимся клеткам. Дальше
+// выходы своей и чужой стороны, ограниченные 0..127, идут во второй слой с
+// весами int8 и через него в один выход. Сложение векторов накопителя и
+// свертки второго слоя собираются для AVX2 и без него и выбираются при
+// загрузке, как ядра пакетной оценки.
+#define NNUE_MAGIC 0x31304555554E4843ull // "CHNNUE01"
+#define NNUE_VECS (NNUE_HIDDEN / 16)     // Векторов по 16 значений int16 на сторону
+#if defined(__x86_64__) || defined(__i386__)
+#define NNUE_DISPATCH __attribute__((target_clones("avx2", "default")))
+#else
+#define NNUE_DISPATCH
+#endif
+
+typedef int16_t Nnue_Vec __attribute__((vector_size(32)));
+
+typedef struct
+{
+  Nnue_Vec w1[NNUE_FEATURES][NNUE_VECS]; // Первый слой, масштаб NNUE_QA
+  Nnue_Vec b1[NNUE_VECS];
+  int8_t w2[NNUE_L2][2 * NNUE_HIDDEN];   // Второй слой: входы своей стороны, затем чужой; масштаб NNUE_QB
+  int32_t b2[NNUE_L2];                   // Масштаб NNUE_QA * NNUE_QB
+  int16_t w3[NNUE_L2];                   // Выход, масштаб NNUE_QB
+  int32_t b3;                            // Масштаб NNUE_QA * NNUE_QB
+} Nnue_Net;
+
+// Первый слой позиции для стороны '1' (v[0]) и стороны '2' (v[1])
+typedef struct
+{
+  Nnue_Vec v[2][NNUE_VECS];
+} Nnue_Accumulator;
+
+typedef struct
+{
+  uint64_t magic;
+  uint32_t features, hidden, l2, reserved;
+} Nnue_Header;
+
+static Nnue_Net *nnue_net; // NULL - ручная оценка
+static char nnue_name[64]; // Имя файла загруженных весов, для журнала партии
+static uint64_t nnue_sum;  // FNV-1a загруженных весов: журнал сверяет сеть по ней, а не по имени
+
+// Вход сети для фишки piece на клетке sq с точки зрения стороны view
+// (0 - сторона '1', 1 - сторона '2'): свои простые, свои дамки, чужие
+// простые, чужие дамки по 32 клетки
+static inline int nnue_feature(int view, char piece, int sq){
+  int code = piece - '0';
+  bool own = (code & 1) == (view == 0);
+  return ((own ? 0 : 2) + (code >= 3)) * SQUARES + (view == 0 ? SQUARES - 1 - sq : sq);
+}
+
+bool nnue_load(const char *path){
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+  {
+    fprintf(stderr, "Не удалось открыть веса сети %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  Nnue_Net *net = aligned_alloc(64, (sizeof(Nnue_Net) + 63) & ~(size_t)63);
+  Nnue_Header header;
+  bool ok = net != NULL && fread(&header, sizeof(header), 1, f) == 1 && header.magic == NNUE_MAGIC &&
+            header.features == NNUE_FEATURES && header.hidden == NNUE_HIDDEN && header.l2 == NNUE_L2 &&
+            fread(net, sizeof(Nnue_Net), 1, f) == 1 && fgetc(f) == EOF;
+  fclose(f);
+  if (!ok)
+  {
+    fprintf(stderr, "Файл %s не содержит весов сети %dx%dx%d\n", path, NNUE_FEATURES, NNUE_HIDDEN, NNUE_L2);
+    free(net);
+    return false;
+  }
+  uint64_t sum = 0xCBF29CE484222325ull;
+  for (size_t i = 0; i < sizeof(Nnue_Net); i++)
+    sum = (sum ^ ((const unsigned char *)net)[i]) * 0x100000001B3ull;
+  const char *name = strrchr(path, '/');
+  snprintf(nnue_name, sizeof(nnue_name), "%s", name != NULL ? name + 1 : path);
+  nnue_sum = sum;
+  free(nnue_net);
+  nnue_net = net;
+  return true;
+}
+
+static bool nnue_save(const Nnue_Net *net, const char *path){
+  FILE *f = fopen(path, "wb");
+  if (f == NULL)
+    return false;
+  Nnue_Header header = {NNUE_MAGIC, NNUE_FEATURES, NNUE_HIDDEN, NNUE_L2, 0};
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(net, sizeof(Nnue_Net), 1, f) == 1;
+  return fclose(f) == 0 && ok;
+}
+
+NNUE_DISPATCH static void nnue_refresh(const Nnue_Net *net, Nnue_Accumulator *acc, char lodic[8][8]){
+  for (int view = 0; view < 2; view++)
+  {
+    memcpy(acc->v[view], net->b1, sizeof(net->b1));
+    for (int sq = 0; sq < SQUARES; sq++)
+    {
+      char piece = lodic[SQ_Y(sq)][SQ_X(sq)];
+      if (piece >= '1' && piece <= '4')
+      {
+        const Nnue_Vec *w = net->w1[nnue_feature(view, piece, sq)];
+        for (int k = 0; k < NNUE_VECS; k++)
+          acc->v[view][k] += w[k];
+      }
+    }
+  }
+}
+
+// Накопитель позиции после хода h: меняются только клетка хода, клетка
+// назначения и взятые фишки. lodic - доска до хода
+NNUE_DISPATCH static void nnue_update(const Nnue_Net *net, Nnue_Accumulator *dst, const Nnue_Accumulator *src,
+                                      char lodic[8][8], const Hod_List *list, Hod h){
+  int from = HOD_FROM(h), to = HOD_TO(h);
+  char piece = lodic[SQ_Y(from)][SQ_X(from)];
+  char placed = HOD_PROMOTES(h) ? piece + 2 : piece;
+  uint32_t captured = list->captured[HOD_CAPTURE(h)];
+  for (int view = 0; view < 2; view++)
+  {
+    const Nnue_Vec *add = net->w1[nnue_feature(view, placed, to)];
+    const Nnue_Vec *sub = net->w1[nnue_feature(view, piece, from)];
+    for (int k = 0; k < NNUE_VECS; k++)
+      dst->v[view][k] = src->v[view][k] + add[k] - sub[k];
+    for (uint32_t rest = captured; rest != 0; rest &= rest - 1)
+    {
+      int sq = __builtin_ctz(rest);
+      sub = net->w1[nnue_feature(view, lodic[SQ_Y(sq)][SQ_X(sq)], sq)];
+      for (int k = 0; k < NNUE_VECS; k++)
+        dst->v[view][k] -= sub[k];
+    }
+  }
+}
+
+// Оценка для стороны side в сотых долях простой
+NNUE_DISPATCH static int nnue_output(const Nnue_Net *net, const Nnue_Accumulator *acc, char side){
+  int16_t in[2 * NNUE_HIDDEN];
+  const Nnue_Vec zero = {0}, top = zero + NNUE_QA;
+  for (int half = 0; half < 2; half++)
+  {
+    const Nnue_Vec *v = acc->v[(side == '2') ^ half];
+    for (int k = 0; k < NNUE_VECS; k++)
+    {
+      Nnue_Vec x = v[k];
+      x = (x & (x > zero)) | (zero & ~(x > zero));
+      x = (x & (x < top)) | (top & ~(x < top));
+      memcpy(in + half * NNUE_HIDDEN + k * 16, &x, sizeof(x));
+    }
+  }
+  int32_t out = net->b3;
+  for (int o = 0; o < NNUE_L2; o++)
+  {
+    int32_t sum = net->b2[o];
+    for (int i = 0; i < 2 * NNUE_HIDDEN; i++)
+      sum += net->w2[o][i] * in[i];
+    sum /= NNUE_QB;
+    out += net->w3[o] * (sum < 0 ? 0 : (sum > NNUE_QA ? NNUE_QA : sum));
+  }
+  return (int)((int64_t)out * NNUE_SCALE / (NNUE_QA * NNUE_QB));
+}
+
+static int nnue_evaluate(const Nnue_Net *net, char lodic[8][8], char side){
+  Nnue_Accumulator acc;
+  nnue_refresh(net, &acc, lodic);
+  return nnue_output(net, &acc, side);
+}
+
+// Комбинаторная индексация позиций. Подмножество из k клеток нумеруется
+// комбинаторной системой счисления: для клеток p1 < p2 < ... < pk (номера
+// внутри разрешенного множества) индекс равен C(p1,1) + C(p2,2) + ... + C(pk,k).
+//
+// Простые верхней стороны стоят на клетках 0-27, нижней - на 4-31. Общая
+// часть 4-27 зависит от того, сколько верхних простых стоит на строке 0,
+// поэтому расстановки простых разбиты на группы по этому числу.
+
+#define TOP_MEN_SQUARES 0x0FFFFFFFu    /**< Клетки, где может стоять простая '1' */
+#define BOTTOM_MEN_SQUARES 0xFFFFFFF0u /**< Клетки, где может стоять простая '2' */
+#define TOP_ROW_SQUARES 0x0000000Fu    /**< Строка 0, недоступная простым '2' */
+#define SHARED_MEN_SQUARES 0x0FFFFFF0u /**< Клетки, общие для простых обеих сторон */
+
+static uint64_t binomial[SQUARES + 1][SQUARES + 1];
+static pthread_once_t binomial_once = PTHREAD_ONCE_INIT;
+
+static void init_binomial(){
+  for (int n = 0; n <= SQUARES; n++)
+  {
+    binomial[n][0] = 1;
+    for (int k = 1; k <= n; k++)
+      binomial[n][k] = binomial[n - 1][k - 1] + (k <= n - 1 ? binomial[n - 1][k] : 0);
+  }
+}
+
+static inline uint64_t choose(int n, int k){
+  return (k < 0 || n < 0 || k > n) ? 0 : binomial[n][k];
+}
+
+static uint64_t subset_rank(uint32_t set, uint32_t universe){
+  uint64_t rank = 0;
+  int i = 1;
+  for (uint32_t rest = set; rest != 0; rest &= rest - 1, i++)
+  {
+    uint32_t bit = rest & (~rest + 1);
+    rank += binomial[__builtin_popcount(universe & (bit - 1))][i];
+  }
+  return rank;
+}
+
+static uint32_t subset_unrank(uint64_t rank, int k, uint32_t universe){
+  // Идем по клеткам множества сверху вниз: старший бит остатка имеет номер p
+  uint32_t set = 0;
+  int p = __builtin_popcount(universe) - 1;
+  for (int i = k; i >= 1; i--)
+  {
+    while (binomial[p][i] > rank)
+    {
+      universe &= ~(1u << (31 - __builtin_clz(universe)));
+      p--;
+    }
+    rank -= binomial[p][i];
+    uint32_t bit = 1u << (31 - __builtin_clz(universe));
+    set |= bit;
+    universe &= ~bit;
+    p--;
+  }
+  return set;
+}
+
+// Количество расстановок простых, у которых k верхних простых стоят на строке 0
+static uint64_t men_group_size(int top, int bottom, int k){
+  return choose(4, k) * choose(24, top - k) * choose(28 - top + k, bottom);
+}
+
+void piece_config_of(const uint32_t masks[4], Piece_Config *cfg){
+  cfg->top_men = (short)__builtin_popcount(masks[0]);
+  cfg->top_kings = (short)__builtin_popcount(masks[1]);
+  cfg->bottom_men = (short)__builtin_popcount(masks[2]);
+  cfg->bottom_kings = (short)__builtin_popcount(masks[3]);
+}
+
+uint64_t position_index_size(const Piece_Config *cfg){
+  pthread_once(&binomial_once, init_binomial);
+  int men = cfg->top_men + cfg->bottom_men;
+  uint64_t men_size = 0;
+  for (int k = 0; k <= 4 && k <= cfg->top_men; k++)
+    men_size += men_group_size(cfg->top_men, cfg->bottom_men, k);
+  return men_size * choose(SQUARES - men, cfg->top_kings) *
+         choose(SQUARES - men - cfg->top_kings, cfg->bottom_kings);
+}
+
+uint64_t position_index(const uint32_t masks[4]){
+  pthread_once(&binomial_once, init_binomial);
+  if ((masks[0] & ~TOP_MEN_SQUARES) || (masks[2] & ~BOTTOM_MEN_SQUARES))
+    return UINT64_MAX;
+  Piece_Config cfg;
+  piece_config_of(masks, &cfg);
+  int top = cfg.top_men, bottom = cfg.bottom_men;
+  int k = __builtin_popcount(masks[0] & TOP_ROW_SQUARES);
+
+  uint64_t men = 0;
+  for (int j = 0; j < k; j++)
+    men += men_group_size(top, bottom, j);
+  uint64_t top_rank = subset_rank(masks[0] & TOP_ROW_SQUARES, TOP_ROW_SQUARES) * choose(24, top - k) +
+                      subset_rank(masks[0] & SHARED_MEN_SQUARES, SHARED_MEN_SQUARES);
+  men += top_rank * choose(28 - top + k, bottom) + subset_rank(masks[2], BOTTOM_MEN_SQUARES & ~masks[0]);
+
+  uint32_t free_squares = ~(masks[0] | masks[2]);
+  int free_count = SQUARES - top - bottom;
+  uint64_t index = men * choose(free_count, cfg.top_kings) + subset_rank(masks[1], free_squares);
+  return index * choose(free_count - cfg.top_kings, cfg.bottom_kings) + subset_rank(masks[3], free_squares & ~masks[1]);
+}
+
+void position_from_index(const Piece_Config *cfg, uint64_t index, uint32_t masks[4]){
+  pthread_once(&binomial_once, init_binomial);
+  int top = cfg->top_men, bottom = cfg->bottom_men;
+  int free_count = SQUARES - top - bottom;
+  uint64_t bottom_kings_count = choose(free_count - cfg->top_kings, cfg->bottom_kings);
+  uint64_t top_kings_count = choose(free_count, cfg->top_kings);
+  uint64_t bottom_kings_rank = index % bottom_kings_count;
+  index /= bottom_kings_count;
+  uint64_t top_kings_rank = index % top_kings_count;
+  uint64_t men = index / top_kings_count;
+
+  int k = 0;
+  while (k < 4 && k < top && men >= men_group_size(top, bottom, k))
+    men -= men_group_size(top, bottom, k++);
+  uint64_t bottom_count = choose(28 - top + k, bottom);
+  uint64_t top_rank = men / bottom_count;
+  uint64_t shared_count = choose(24, top - k);
+  masks[0] = subset_unrank(top_rank / shared_count, k, TOP_ROW_SQUARES) |
+             subset_unrank(top_rank % shared_count, top - k, SHARED_MEN_SQUARES);
+  masks[2] = subset_unrank(men % bottom_count, bottom, BOTTOM_MEN_SQUARES & ~masks[0]);
+  uint32_t free_squares = ~(masks[0] | masks[2]);
+  masks[1] = subset_unrank(top_kings_rank, cfg->top_kings, free_squares);
+  masks[3] = subset_unrank(bottom_kings_rank, cfg->bottom_kings, free_squares & ~masks[1]);
+}
+
+void bench_position_index(const Piece_Config *cfg){
+  uint64_t size = position_index_size(cfg);
+  printf("Состав %d,%d,%d,%d: %llu позиций, %.1f МБ при одном байте на позицию\n",
+         cfg->top_men, cfg->top_kings, cfg->bottom_men, cfg->bottom_kings,
+         (unsigned long long)size, size / 1048576.0);
+  // Для больших составов проверяем равномерную выборку индексов
+  uint64_t step = size > 50000000 ? size / 50000000 : 1;
+  uint64_t checked = 0, errors = 0;
+  struct timespec start, finish;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint64_t index = 0; index < size; index += step)
+  {
+    uint32_t masks[4];
+    position_from_index(cfg, index, masks);
+    Piece_Config got;
+    piece_config_of(masks, &got);
+    if (position_index(masks) != index || (masks[0] & masks[1]) || (masks[0] & masks[2]) || (masks[0] & masks[3]) ||
+        (masks[1] & masks[2]) || (masks[1] & masks[3]) || (masks[2] & masks[3]) ||
+        got.top_men != cfg->top_men || got.top_kings != cfg->top_kings ||
+        got.bottom_men != cfg->bottom_men || got.bottom_kings != cfg->bottom_kings)
+      errors++;
+    checked++;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  double seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+  printf("Проверено индексов: %llu, ошибок: %llu, %.1f млн пар индекс/расстановка в секунду\n",
+         (unsigned long long)checked, (unsigned long long)errors, seconds > 0 ? checked / seconds / 1e6 : 0.0);
+}
+
+// Случайность и журнал партии. Генератор хранится в состоянии потока, как и
+// доска, поэтому ход компьютера зависит только от позиции, правил и зерна.
+
+void rng_seed(uint64_t seed){
+  rng_state = seed;
+}
+
+uint64_t rng_next(){
+  uint64_t z = (rng_state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+void replay_write(int fd, const char *fmt, ...){
+  if (fd < 0)
+    return;
+  char line[256];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  if (n > (int)sizeof(line) - 1)
+    n = sizeof(line) - 1;
+  if (n > 0 && write(fd, line, n) != n)
+    perror("replay");
+}
+
+static const char *search_mode_name(const Search_Options *options){
+  static const char *names[8] = {"full", "lmr", "pvs", "pvs+lmr", "probcut", "lmr+probcut", "pvs+probcut", "pvs+lmr+probcut"};
+  return names[options->pvs * 2 + options->lmr + options->probcut * 4];
+}
+
+void replay_write_header(int fd, uint64_t seed, bool player_white){
+  replay_write(fd, "variant %s\nseed %llu\ndraws %d\ndepth %d\nmovetime %ld\nnodes %llu\nsearch %s\nthreads %d\ncolor %s\n",
+               rules_variant == RULES_RUSSIAN ? "russian" : (rules_variant == RULES_POOL ? "pool" : "american"),
+               (unsigned long long)seed, draw_moves, search_options.depth, search_options.time_ms,
+               (unsigned long long)search_options.max_nodes, search_mode_name(&search_options),
+               search_options.threads > 1 ? search_options.threads : 1, player_white ? "white" : "black");
+  // Без сети ходы считает ручная оценка; сеть узнается по сумме весов
+  if (nnue_net != NULL)
+    replay_write(fd, "nnue %016llx %s\n", (unsigned long long)nnue_sum, nnue_name);
+  else
+    replay_write(fd, "nnue none\n");
+}
+
+void replay_write_hod(int fd, const char *who, const Hod_Info *h, long ms){
+  char from_x, from_y, to_x, to_y;
+  reverse_graph_out_koordinaty(h->from_x, h->from_y, &from_x, &from_y);
+  reverse_graph_out_koordinaty(h->to_x, h->to_y, &to_x, &to_y);
+  replay_write(fd, "%s %c%c %c%c %08x %ld\n", who, from_x, from_y, to_x, to_y, h->captured, ms);
+}
+
+int replay_game(const char *path){
+  FILE *in = fopen(path, "r");
+  if (in == NULL)
+  {
+    perror(path);
+    return 1;
+  }
+
+  char line[256];
+  int ply = 0;
+  int result = 0;
+  initial_position(lodic);
+  game_state = (GameState){12, 12, 0, 0};
+  rng_seed(0);
+  while (fgets(line, sizeof(line), in) != NULL)
+  {
+    char key[16], value[32], to[8];
+    unsigned int captured = 0;
+    long logged_ms = 0;
+    int fields = sscanf(line, "%15s %31s %7s %x %ld", key, value, to, &captured, &logged_ms);
+    if (strcmp(key, "undo") == 0 || strcmp(key, "redo") == 0)
+    {
+      // Без числа - отмена хода игрока вместе с ответом компьютера
+      bool back = key[0] == 'u';
+      int plies = fields >= 2 ? atoi(value) : console_undo_plies();
+      int done = back ? console_back(plies) : console_forward(plies);
+      if (plies <= 0 || done != plies)
+      {
+        printf("Ход %d: в журнале %s полуходов: %d, а сделано %d\n", ply, back ? "отмена" : "повтор", plies, done);
+        result = 1;
+        break;
+      }
+      printf("Ход %d: %s полуходов: %d\n", ply, back ? "отменено" : "повторено", done);
+      continue;
+    }
+    if (fields == 1 && strcmp(key, "resign") == 0)
+      printf("Игрок сдался\n");
+    if (fields < 2 || key[0] == '#')
+      continue;
+
+    if (strcmp(key, "variant") == 0)
+    {
+      if (!select_rules(value))
+      {
+        printf("Неизвестные правила в журнале: %s\n", value);
+        result = 1;
+        break;
+      }
+    }
+    else if (strcmp(key, "seed") == 0)
+      rng_seed(strtoull(value, NULL, 10));
+    else if (strcmp(key, "draws") == 0)
+      draw_moves = atoi(value);
+    else if (strcmp(key, "depth") == 0)
+      search_options.depth = atoi(value);
+    else if (strcmp(key, "movetime") == 0)
+      search_options.time_ms = atol(value);
+    else if (strcmp(key, "nodes") == 0)
+      search_options.max_nodes = strtoull(value, NULL, 10);
+    else if (strcmp(key, "threads") == 0)
+    {
+      // Поиск в одном потоке и разделенный на 2 и больше обходят разные
+      // деревья; количество потоков больше 1 на результат не влияет
+      search_options.threads = atoi(value);
+      if (search_options.threads < 1 || search_options.threads > SPLIT_MAX_THREADS)
+        search_options.threads = 1;
+    }
+    else if (strcmp(key, "nnue") == 0)
+    {
+      // Другая оценка дала бы расхождения ходов, которые ошибками не являются
+      bool logged = strcmp(value, "none") != 0;
+      if (logged != (nnue_net != NULL) || (logged && strtoull(value, NULL, 16) != nnue_sum))
+      {
+        char name[64] = "";
+        sscanf(line, "%*s %*s %63s", name);
+        if (logged)
+          printf("Партия сыграна с сетью %s (сумма %s), загружена %s; запустите с --nnue %s\n", name, value,
+                 nnue_net != NULL ? nnue_name : "ручная оценка", name);
+        else
+          printf("Партия сыграна с ручной оценкой, запустите без --nnue\n");
+        result = 1;
+        break;
+      }
+    }
+    else if (strcmp(key, "search") == 0)
+    {
+      search_options.pvs = strstr(value, "pvs") != NULL;
+      search_options.lmr = strstr(value, "lmr") != NULL;
+      search_options.probcut = strstr(value, "probcut") != NULL;
+    }
+    else if (strcmp(key, "color") == 0)
+    {
+      player_is_white = strcmp(value, "white") == 0;
+      is_player_turn = player_is_white;
+      count_pieces(lodic, &game_state);
+      history_reset(&game_history, position_hash(lodic, is_player_turn ? '2' : '1'));
+    }
+    else if (strcmp(key, "result") == 0)
+    {
+      int board_result = game_result();
+      printf("Результат в журнале: %s, по доске: %s\n", value,
+             board_result == 1 ? "white" : (board_result == 2 ? "black" : (board_result == 3 ? "draw" : "none")));
+    }
+    else if ((strcmp(key, "player") == 0 || strcmp(key, "computer") == 0 || strcmp(key, "forced") == 0) &&
+             fields >= 4)
+    {
+      short fx, fy, tx, ty, gx, gy;
+      ply++;
+      if (!koordinaty(value[0], value[1], &gx, &gy, &fx, &fy) || !koordinaty(to[0], to[1], &gx, &gy, &tx, &ty))
+      {
+        printf("Ход %d: неверные координаты в журнале\n", ply);
+        result = 1;
+        break;
+      }
+      // Ходы записываются в историю консоли, чтобы undo и redo из журнала
+      // повторялись так же, как в партии
+      Hod_List hods;
+      is_player_turn = key[0] == 'p';
+      generate_hods(lodic, is_player_turn ? '2' : '1', &hods);
+      int expected = find_hod(&hods, fx, fy, tx, ty, captured);
+      if (key[0] == 'p')
+      {
+        if (expected < 0)
+        {
+          printf("Ход %d: ход игрока %s-%s недопустим в этой позиции\n", ply, value, to);
+          result = 2;
+          break;
+        }
+        Hod_Info h = hod_info(&hods, hods.hods[expected]);
+        console_make_hod(&h);
+        is_player_turn = false;
+        continue;
+      }
+
+      // Ход компьютера пересчитывается и сравнивается с записанным
+      struct timespec t0, t1;
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      Hod_Info best;
+      bool moved = computer_best_move(&best) != -SEARCH_INFINITY;
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      long ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+      if (key[0] == 'f')
+      {
+        // Игрок прервал поиск, и итог зависел от момента прерывания. Поиск
+        // все равно повторяется: он продвигает генератор партии так же, как
+        // прерванный, и следующие ходы снова можно сверить
+        if (expected < 0 || !moved)
+        {
+          printf("Ход %d: ход компьютера %s-%s недопустим в этой позиции\n", ply, value, to);
+          result = 3;
+          break;
+        }
+        Hod_Info h = hod_info(&hods, hods.hods[expected]);
+        console_make_hod(&h);
+        printf("Ход %d: %s-%s сделан по прерванному поиску, принят из журнала\n", ply, value, to);
+        is_player_turn = true;
+        continue;
+      }
+      char got[8] = "нет";
+      if (moved)
+        format_hod(&best, got);
+      if (expected < 0 || !moved ||
+          find_hod(&hods, best.from_x, best.from_y, best.to_x, best.to_y, best.captured) != expected)
+      {
+        printf("Ход %d: в журнале компьютер сыграл %s-%s, при воспроизведении %s\n", ply, value, to, got);
+        result = 3;
+        break;
+      }
+      console_make_hod(&best);
+      printf("Ход %d: %s совпал, %ld мс (в журнале %ld мс)\n", ply, got, ms, logged_ms);
+      is_player_turn = true;
+    }
+  }
+  fclose(in);
+  if (result == 0)
+    printf("Партия воспроизведена: %d ходов совпали\n", ply);
+  return result;
+}
+
+// Повторения позиций и ничьи. Хэш Зобриста считается по 32 темным клеткам,
+// ключи получаются из splitmix64 с постоянным зерном и одинаковы во всех
+// запусках, поэтому хэши из журналов и сессий сравнимы между собой.
+
+static uint64_t zobrist_keys[SQUARES][4]; // Ключи фишек '1'-'4' на каждой клетке
+static uint64_t zobrist_side;             // Ключ хода стороны '2'
+static pthread_once_t zobrist_once = PTHREAD_ONCE_INIT;
+
+static void zobrist_init(){
+  uint64_t state = 0x5A0B1257ull;
+  for (int i = 0; i <= SQUARES * 4; i++)
+  {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    if (i < SQUARES * 4)
+      zobrist_keys[i / 4][i % 4] = z;
+    else
+      zobrist_side = z;
+  }
+}
+
+uint64_t position_hash(char lodic[8][8], char side){
+  pthread_once(&zobrist_once, zobrist_init);
+  uint64_t hash = side == '2' ? zobrist_side : 0;
+  for (int sq = 0; sq < SQUARES; sq++)
+  {
+    char cell = lodic[SQ_Y(sq)][SQ_X(sq)];
+    if (cell >= '1' && cell <= '4')
+      hash ^= zobrist_keys[sq][cell - '1'];
+  }
+  return hash;
+}
+
+bool hod_is_reversible(char lodic[8][8], const Hod_Info *h){
+  char piece = lodic[h->from_y][h->from_x];
+  return h->kills == 0 && (piece == '3' || piece == '4');
+}
+
+// Клетка кольца, которую займет history_push
+static int history_next_slot(const Game_History *h, bool reversible){
+  if (!reversible)
+    return 0;
+  // Полная история сначала отбрасывает две самые старые позиции, и новая
+  // ложится на место самой старой
+  return (h->count == HISTORY_SIZE ? h->start : h->start + h->count) % HISTORY_SIZE;
+}
+
+void history_reset(Game_History *h, uint64_t hash){
+  h->start = 0;
+  h->hashes[0] = hash;
+  h->count = 1;
+}
+
+void history_push(Game_History *h, uint64_t hash, bool reversible){
+  if (!reversible)
+  {
+    history_reset(h, hash);
+    return;
+  }
+  // Без предела ходов история может переполниться: самые старые позиции
+  // отбрасываются, повторения ищутся в последних HISTORY_SIZE позициях
+  if (h->count == HISTORY_SIZE)
+  {
+    h->start = (h->start + 2) % HISTORY_SIZE;
+    h->count -= 2;
+  }
+  h->hashes[(h->start + h->count) % HISTORY_SIZE] = hash;
+  h->count++;
+}
+
+int history_repetitions(const Game_History *h, uint64_t hash){
+  int repetitions = 0;
+  for (int i = 0; i < h->count; i++)
+    repetitions += HISTORY_AT(h, i) == hash;
+  return repetitions;
+}
+
+int history_draw_after(const Game_History *h, uint64_t hash, bool reversible){
+  // После необратимого хода ни повторения, ни затянувшейся игры быть не может
+  if (!reversible)
+    return 0;
+  // Позиция с той же стороной на ходу стоит в истории через одну, начиная
+  // с предпоследней: остальные хэши можно не сравнивать
+  int repetitions = 1;
+  for (int i = h->count - 2; i >= 0; i -= 2)
+    repetitions += HISTORY_AT(h, i) == hash;
+  if (repetitions >= 3)
+    return 1;
+  if (draw_moves > 0 && h->count >= 2 * draw_moves)
+    return 2;
+  return 0;
+}
+
+int history_draw(const Game_History *h){
+  if (h->count == 0)
+    return 0;
+  if (history_repetitions(h, HISTORY_AT(h, h->count - 1)) >= 3)
+    return 1;
+  if (draw_moves > 0 && h->count - 1 >= 2 * draw_moves)
+    return 2;
+  return 0;
+}
+
+// Счетчик game_state для фишки '1'-'4', как в count_pieces
+static int *game_state_count(GameState *gs, char cell){
+  bool white = (cell == '2' || cell == '4') == player_is_white;
+  if (cell == '3' || cell == '4')
+    return white ? &gs->count_white_king : &gs->count_black_king;
+  return white ? &gs->count_white : &gs->count_black;
+}
+
+void make_hod(const Hod_Info *h){
+  pthread_once(&zobrist_once, zobrist_init);
+  char piece = lodic[h->from_y][h->from_x];
+  char placed = h->promotes ? piece + 2 : piece;
+  char next_side = piece == '1' || piece == '3' ? '2' : '1';
+  bool reversible = hod_is_reversible(lodic, h);
+  // Хэш и счетчики фишек меняются только на клетках хода
+  uint64_t hash = zobrist_side ^ zobrist_keys[SQ_INDEX(h->from_x, h->from_y)][piece - '1'] ^
+                  zobrist_keys[SQ_INDEX(h->to_x, h->to_y)][placed - '1'];
+  lodic[h->from_y][h->from_x] = '0';
+  for (uint32_t rest = h->captured; rest != 0; rest &= rest - 1)
+  {
+    int sq = __builtin_ctz(rest);
+    char cell = lodic[SQ_Y(sq)][SQ_X(sq)];
+    hash ^= zobrist_keys[sq][cell - '1'];
+    (*game_state_count(&game_state, cell))--;
+    lodic[SQ_Y(sq)][SQ_X(sq)] = '0';
+  }
+  if (placed != piece)
+  {
+    (*game_state_count(&game_state, piece))--;
+    (*game_state_count(&game_state, placed))++;
+  }
+  lodic[h->to_y][h->to_x] = placed;
+  // Без истории хэша позиции до хода нет, он считается заново
+  if (game_history.count > 0)
+    hash ^= HISTORY_AT(&game_history, game_history.count - 1);
+  else
+    hash = position_hash(lodic, next_side);
+  history_push(&game_history, hash, reversible);
+  last_hod = *h;
+}
+
+void make_hod_record(const Hod_Info *h, Undo_Record *u){
+  Hod_Info hod = *h;
+  char piece = lodic[h->from_y][h->from_x];
+  char king = piece == '1' || piece == '3' ? '4' : '3';
+  u->hod = hod;
+  u->piece = piece;
+  u->captured_kings = 0;
+  for (uint32_t rest = hod.captured; rest != 0; rest &= rest - 1)
+  {
+    int sq = __builtin_ctz(rest);
+    if (lodic[SQ_Y(sq)][SQ_X(sq)] == king)
+      u->captured_kings |= 1u << sq;
+  }
+  u->game_state = game_state;
+  u->reversible = hod_is_reversible(lodic, &hod);
+  u->history_start = game_history.start;
+  u->history_count = game_history.count;
+  u->history_slot = game_history.hashes[history_next_slot(&game_history, u->reversible)];
+  make_hod(&hod);
+}
+
+void unmake_hod(const Undo_Record *u){
+  const Hod_Info *h = &u->hod;
+  char man = u->piece == '1' || u->piece == '3' ? '2' : '1';
+  lodic[h->to_y][h->to_x] = '0';
+  for (uint32_t rest = h->captured; rest != 0; rest &= rest - 1)
+  {
+    int sq = __builtin_ctz(rest);
+    lodic[SQ_Y(sq)][SQ_X(sq)] = (u->captured_kings >> sq) & 1 ? man + 2 : man;
+  }
+  lodic[h->from_y][h->from_x] = u->piece;
+  game_state = u->game_state;
+  game_history.start = u->history_start;
+  game_history.count = u->history_count;
+  game_history.hashes[history_next_slot(&game_history, u->reversible)] = u->history_slot;
+}
+
+// Поиск хода: альфа-бета с итеративным углублением. Дочерняя позиция
+// строится копией доски узла, поэтому ход не нужно отменять. Состояние поиска
+// (счетчик узлов, лучшие продолжения, эвристики порядка ходов) хранится в
+// потоке, как и доска, поэтому рабочие потоки сервера считают независимо.
+// Списки ходов узлов лежат не на стеке, а в кадрах, выделенных вместе с
+// состоянием один раз на поток: поиск ничего не выделяет, а стек узла
+// занимает несколько десятков байт вместо списка ходов.
+
+typedef struct
+{
+  Hod_List list;                      // Ходы узла
+  char child[8][8];                   // Доска после проверяемого хода
+  int order[MAX_HODS];                // Порядок перебора ходов
+  int keys[MAX_HODS];                 // Ключи сортировки ходов
+} Search_Frame;
+
+typedef struct Search_Thread
+{
+  const Search_Options *options;
+  uint64_t nodes;
+  bool stop;                          // Время вышло, итерация отбрасывается
+  bool can_stop;                      // Первая итерация всегда считается до конца
+  struct timespec deadline;
+  Hod_List root_list;                 // Корневые ходы в перемешанном порядке
+  int root_best;                      // Номер лучшего корневого хода итерации
+  bool root_excluded[MAX_HODS];       // Корневые ходы, уже выбранные другими линиями
+  uint64_t hashes[MAX_PLY + 1];       // Хэши позиций пути поиска
+  int clock[MAX_PLY + 1];             // Обратимых полуходов подряд до позиции пути
+  Search_Move pv[MAX_PLY][MAX_PLY];   // Треугольная таблица лучших продолжений
+  int pv_length[MAX_PLY];
+  Search_Move prev_pv[MAX_PLY];       // Лучшее продолжение прошлой итерации
+  int prev_pv_length;
+  Search_Move killers[MAX_PLY][2];    // Тихие ходы, давшие отсечение на этом полуходе
+  int history[SQUARES][SQUARES];      // Успешность тихих ходов по клеткам
+  Search_Line lines[MAX_MULTIPV];     // Линии анализа текущей глубины
+  Nnue_Accumulator acc[MAX_PLY];      // Первый слой сети для позиций пути, если сеть загружена
+  struct Split_State *split;          // Задачи и контексты разделяемого поиска, NULL - поиск в одном потоке
+  struct Split_Context *context;      // Контекст, чьи таблица и эвристики сейчас загружены в поток
+  struct Split_Point *split_point;    // Узел, чью задачу считает поток
+  uint64_t helper_nodes;              // Узлы задач этого поиска, посчитанных другими потоками
+  struct Tree_Dump *tree;             // Дерево поиска для отладки, NULL - не пишется
+  unsigned char tree_flags;           // Флаги дерева для узла, из которого поиск только что вернулся
+  int frame_top;                      // Занятых кадров
+  Search_Frame frames[SEARCH_FRAMES]; // Кадры узлов пути поиска
+} Search_Thread;
+
+static _Thread_local Search_Thread *search_thread;
+
+// Таблица переходов потока. Запись - два слова: полный хэш и упакованные
+// данные (оценка, глубина, граница, ход, поколение). Записи прошлых поисков
+// не используются: от них зависел бы ход компьютера, и партии с журналом
+// перестали бы воспроизводиться.
+//
+// С --shared-hash все потоки и процессы пишут в одну таблицу в разделяемой
+// памяти без блокировок. Ключ там хранится как хэш ^ данные: запись,
+// разорванная одновременной записью из другого процесса, не сходится с
+// хэшем и считается промахом. Поколений нет, результаты чужих поисков
+// используются, поэтому ходы зависят от соседей и не воспроизводятся.
+
+typedef struct
+{
+  uint64_t key;
+  uint64_t data;
+} Tt_Entry;
+
+typedef struct
+{
+  Tt_Entry *entries;
+  size_t mask;                 // Количество записей - 1, степень двойки
+  uint16_t generation;         // Номер текущего поиска, 0 не используется
+  bool shared;                 // Общая таблица в разделяемой памяти
+  uint64_t salt;               // Для общей таблицы и кэша: различает правила и предел ничьей
+} Trans_Table;
+
+typedef struct
+{
+  int score;
+  int depth;
+  int bound;
+  Search_Move move;
+} Tt_Hit;
+
+// Заголовок объекта разделяемой памяти, записи идут сразу за ним
+typedef struct
+{
+  uint64_t magic;              // Пишется последним: таблица готова
+  uint64_t count;              // Количество записей, степень двойки
+  char reserved[48];
+} Shared_Tt_Header;
+
+#define SHARED_TT_MAGIC 0x3130545453524843ull // "CHRSTT01"
+
+static Tt_Entry *shared_tt_entries;   // NULL - у каждого потока своя таблица
+static size_t shared_tt_mask;
+
+static _Thread_local Trans_Table search_tt;
+static pthread_key_t tt_key;       // Освобождает таблицу при завершении потока
+static pthread_key_t search_key;   // Освобождает состояние поиска
+static pthread_once_t search_key_once = PTHREAD_ONCE_INIT;
+
+static void search_key_create(){
+  pthread_key_create(&tt_key, free);
+  pthread_key_create(&search_key, free);
+}
+
+static Search_Thread *search_thread_get(){
+  if (search_thread == NULL)
+  {
+    // Накопители сети - векторы AVX2, поэтому состояние выравнивается
+    size_t size = (sizeof(Search_Thread) + 63) & ~(size_t)63;
+    search_thread = aligned_alloc(64, size);
+    if (search_thread == NULL)
+    {
+      fprintf(stderr, "Не удалось выделить %zu байт для поиска\n", sizeof(Search_Thread));
+      exit(1);
+    }
+    memset(search_thread, 0, size);
+    pthread_once(&search_key_once, search_key_create);
+    pthread_setspecific(search_key, search_thread);
+  }
+  return search_thread;
+}
+
+// Наибольшая степень двойки записей, помещающаяся в size_mb
+static size_t tt_entry_count(int size_mb){
+  size_t count = 1;
+  while (count * 2 * sizeof(Tt_Entry) <= ((size_t)size_mb << 20))
+    count *= 2;
+  return count;
+}
+
+bool shared_tt_open(const char *name, int size_mb){
+  if (size_mb <= 0)
+  {
+    fprintf(stderr, "Размер общей таблицы должен быть положительным\n");
+    return false;
+  }
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  bool created = fd >= 0;
+  if (!created && errno == EEXIST)
+    fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0)
+  {
+    fprintf(stderr, "Не удалось открыть общую таблицу %s: %s\n", name, strerror(errno));
+    return false;
+  }
+
+  size_t count = tt_entry_count(size_mb);
+  size_t bytes = sizeof(Shared_Tt_Header) + count * sizeof(Tt_Entry);
+  if (created)
+  {
+    // ftruncate заполняет объект нулями, нулевая запись ни с одним хэшем не сходится
+    if (ftruncate(fd, (off_t)bytes) != 0)
+    {
+      fprintf(stderr, "Не удалось задать размер общей таблицы %s: %s\n", name, strerror(errno));
+      shm_unlink(name);
+      close(fd);
+      return false;
+    }
+  }
+  else
+  {
+    // Создатель мог еще не успеть задать размер
+    struct stat st = {0};
+    for (int tries = 0; tries < 100; tries++)
+    {
+      if (fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(Shared_Tt_Header))
+        break;
+      usleep(10000);
+    }
+    bytes = (size_t)st.st_size;
+    if (bytes <= sizeof(Shared_Tt_Header))
+    {
+      fprintf(stderr, "Общая таблица %s пуста\n", name);
+      close(fd);
+      return false;
+    }
+  }
+
+  Shared_Tt_Header *header = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (header == MAP_FAILED)
+  {
+    fprintf(stderr, "Не удалось отобразить общую таблицу %s: %s\n", name, strerror(errno));
+    if (created)
+      shm_unlink(name);
+    return false;
+  }
+  if (created)
+  {
+    header->count = count;
+    __atomic_store_n(&header->magic, SHARED_TT_MAGIC, __ATOMIC_RELEASE);
+  }
+  else
+  {
+    for (int tries = 0; tries < 100 && __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHARED_TT_MAGIC; tries++)
+      usleep(10000);
+    count = header->count;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHARED_TT_MAGIC || count < 2 ||
+        (count & (count - 1)) != 0 || count > (bytes - sizeof(Shared_Tt_Header)) / sizeof(Tt_Entry))
+    {
+      fprintf(stderr, "Объект %s не является общей таблицей переходов\n", name);
+      munmap(header, bytes);
+      return false;
+    }
+  }
+  shared_tt_entries = (Tt_Entry *)(header + 1);
+  shared_tt_mask = count - 1;
+  return true;
+}
+
+bool shared_tt_unlink(const char *name){
+  if (shm_unlink(name) != 0)
+  {
+    fprintf(stderr, "Не удалось удалить общую таблицу %s: %s\n", name, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+static void tt_new_search(Trans_Table *tt){
+  tt->salt = ((uint64_t)rules_variant << 8 | (uint64_t)draw_moves) * 0x9E3779B97F4A7C15ull;
+  if (shared_tt_entries != NULL)
+  {
+    tt->entries = shared_tt_entries;
+    tt->mask = shared_tt_mask;
+    tt->shared = true;
+    return;
+  }
+  if (tt->entries == NULL && tt_size_mb > 0)
+  {
+    size_t count = tt_entry_count(tt_size_mb);
+    tt->entries = calloc(count, sizeof(Tt_Entry));
+    if (tt->entries == NULL)
+      return;
+    tt->mask = count - 1;
+    pthread_once(&search_key_once, search_key_create);
+    pthread_setspecific(tt_key, tt->entries);
+  }
+  if (tt->entries != NULL && ++tt->generation == 0)
+  {
+    memset(tt->entries, 0, sizeof(Tt_Entry) * (tt->mask + 1));
+    tt->generation = 1;
+  }
+}
+
+static void tt_unpack(uint64_t data, Tt_Hit *hit){
+  hit->score = (int16_t)(data & 0xFFFF);
+  hit->depth = (int)((data >> 16) & 0xFF);
+  hit->bound = (int)((data >> 24) & 3);
+  hit->move.from = (data >> 36) & 1 ? (signed char)((data >> 26) & 31) : -1;
+  hit->move.to = (signed char)((data >> 31) & 31);
+  hit->move.captured = 0;
+}
+
+// Кэш анализа на диске (--cache). Файл - заголовок и отсортированные по
+// ключу записи таблицы переходов глубиной не меньше CACHE_MIN_DEPTH. При
+// запуске файл отображается в память только для чтения, при выходе к его
+// записям добавляются новые глубокие результаты и файл заменяется целиком.
+// Ключ - хэш позиции с солью правил, как в общей таблице.
+//
+// Поиск пишет новые записи в буфер своего потока без блокировок; в общий
+// список они переносятся в конце поиска, а у помощников - когда задач нет.
+
+#define CACHE_MIN_DEPTH 8
+#define CACHE_MAGIC 0x3148434143524843ull // "CHRCACH1"
+#define CACHE_MAX_RECORDS (4u << 20)    // Новых записей за запуск, 64 МБ
+#define CACHE_THREAD_RECORDS (1u << 16) // Новых записей потока за поиск, 1 МБ
+
+typedef struct
+{
+  uint64_t magic;
+  uint64_t count;
+} Cache_Header;
+
+typedef struct
+{
+  const char *path;
+  void *map;                   // Отображение загруженного файла
+  size_t map_bytes;
+  const Tt_Entry *entries;     // Записи файла, по возрастанию ключа
+  size_t count;
+  pthread_mutex_t lock;        // Защищает новые записи
+  Tt_Entry *recorded;          // Новые записи этого запуска
+  size_t recorded_count;
+  size_t recorded_capacity;
+} Disk_Cache;
+
+static Disk_Cache disk_cache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+typedef struct
+{
+  size_t count;
+  bool full;                   // Сжатие не освободило места, новые записи до переноса теряются
+  Tt_Entry entries[CACHE_THREAD_RECORDS];
+} Cache_Buffer;
+
+static _Thread_local Cache_Buffer *cache_buffer; // NULL - кэша нет
+static pthread_key_t cache_key;                  // Переносит записи и освобождает буфер при завершении потока
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+// Отображает файл кэша; отсутствующий файл - пустой кэш
+static bool cache_map_file(const char *path, void **map, size_t *bytes, const Tt_Entry **entries, size_t *count){
+  *map = NULL;
+  *bytes = 0;
+  *entries = NULL;
+  *count = 0;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    if (errno == ENOENT)
+      return true;
+    fprintf(stderr, "Не удалось открыть кэш %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    close(fd);
+    return true;
+  }
+  void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+  {
+    fprintf(stderr, "Не удалось отобразить кэш %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  const Cache_Header *header = p;
+  size_t size = (size_t)st.st_size;
+  if (size < sizeof(Cache_Header) || header->magic != CACHE_MAGIC ||
+      header->count != (size - sizeof(Cache_Header)) / sizeof(Tt_Entry) ||
+      (size - sizeof(Cache_Header)) % sizeof(Tt_Entry) != 0)
+  {
+    fprintf(stderr, "Файл %s не является кэшем анализа\n", path);
+    munmap(p, size);
+    return false;
+  }
+  *map = p;
+  *bytes = size;
+  *entries = (const Tt_Entry *)(header + 1);
+  *count = header->count;
+  return true;
+}
+
+// По возрастанию ключа, при равных ключах сначала более глубокая запись
+static int cache_entry_compare(const void *a, const void *b){
+  const Tt_Entry *x = a, *y = b;
+  if (x->key != y->key)
+    return x->key < y->key ? -1 : 1;
+  int dx = (int)((x->data >> 16) & 0xFF), dy = (int)((y->data >> 16) & 0xFF);
+  return dy - dx;
+}
+
+// Сортирует записи и оставляет по одной, самой глубокой, на ключ
+static size_t cache_compact(Tt_Entry *entries, size_t count){
+  if (count == 0)
+    return 0;
+  qsort(entries, count, sizeof(Tt_Entry), cache_entry_compare);
+  size_t kept = 1;
+  for (size_t i = 1; i < count; i++)
+    if (entries[i].key != entries[kept - 1].key)
+      entries[kept++] = entries[i];
+  return kept;
+}
+
+// Пишет записи во временный файл и атомарно заменяет им path
+static bool cache_write_file(const char *path, const Tt_Entry *entries, size_t count){
+  size_t len = strlen(path);
+  char *tmp = malloc(len + 16);
+  if (tmp == NULL)
+    return false;
+  snprintf(tmp, len + 16, "%s.%ld", path, (long)getpid());
+  FILE *f = fopen(tmp, "wb");
+  if (f == NULL)
+  {
+    fprintf(stderr, "Не удалось создать %s: %s\n", tmp, strerror(errno));
+    free(tmp);
+    return false;
+  }
+  Cache_Header header = {CACHE_MAGIC, count};
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(entries, sizeof(Tt_Entry), count, f) == count;
+  ok = fclose(f) == 0 && ok;
+  if (ok && rename(tmp, path) != 0)
+    ok = false;
+  if (!ok)
+  {
+    fprintf(stderr, "Не удалось записать кэш %s: %s\n", path, strerror(errno));
+    unlink(tmp);
+  }
+  free(tmp);
+  return ok;
+}
+
+bool disk_cache_open(const char *path){
+  disk_cache.path = path;
+  return cache_map_file(path, &disk_cache.map, &disk_cache.map_bytes, &disk_cache.entries, &disk_cache.count);
+}
+
+// Переносит записи буфера потока в общий список
+static void cache_buffer_flush(Cache_Buffer *buffer){
+  if (buffer == NULL || buffer->count == 0)
+    return;
+  pthread_mutex_lock(&disk_cache.lock);
+  size_t need = disk_cache.recorded_count + buffer->count;
+  if (need > disk_cache.recorded_capacity)
+  {
+    // Повторы одной позиции из разных поисков сначала выбрасываются
+    disk_cache.recorded_count = cache_compact(disk_cache.recorded, disk_cache.recorded_count);
+    need = disk_cache.recorded_count + buffer->count;
+    size_t capacity = disk_cache.recorded_capacity ? disk_cache.recorded_capacity : 4096;
+    while (capacity < need && capacity < CACHE_MAX_RECORDS)
+      capacity *= 2;
+    if (capacity > disk_cache.recorded_capacity)
+    {
+      Tt_Entry *grown = realloc(disk_cache.recorded, capacity * sizeof(Tt_Entry));
+      if (grown != NULL)
+      {
+        disk_cache.recorded = grown;
+        disk_cache.recorded_capacity = capacity;
+      }
+    }
+  }
+  size_t count = disk_cache.recorded_capacity - disk_cache.recorded_count;
+  if (count > buffer->count)
+    count = buffer->count;
+  memcpy(disk_cache.recorded + disk_cache.recorded_count, buffer->entries, count * sizeof(Tt_Entry));
+  disk_cache.recorded_count += count;
+  pthread_mutex_unlock(&disk_cache.lock);
+  buffer->count = 0;
+  buffer->full = false;
+}
+
+static void cache_buffer_release(void *buffer){
+  cache_buffer_flush(buffer);
+  free(buffer);
+}
+
+static void cache_key_create(){
+  pthread_key_create(&cache_key, cache_buffer_release);
+}
+
+// Выделяет буфер потока до начала поиска
+static void cache_buffer_get(){
+  if (cache_buffer != NULL || disk_cache.path == NULL)
+    return;
+  cache_buffer = malloc(sizeof(Cache_Buffer));
+  if (cache_buffer == NULL)
+    return;
+  cache_buffer->count = 0;
+  cache_buffer->full = false;
+  pthread_once(&cache_key_once, cache_key_create);
+  pthread_setspecific(cache_key, cache_buffer);
+}
+
+void disk_cache_save(void){
+  cache_buffer_flush(cache_buffer);
+  pthread_mutex_lock(&disk_cache.lock);
+  if (disk_cache.path != NULL && disk_cache.recorded_count > 0)
+  {
+    size_t count = disk_cache.count + disk_cache.recorded_count;
+    Tt_Entry *all = malloc(count * sizeof(Tt_Entry));
+    if (all != NULL)
+    {
+      // Новые записи идут первыми: при равной глубине остается новая
+      memcpy(all, disk_cache.recorded, disk_cache.recorded_count * sizeof(Tt_Entry));
+      if (disk_cache.count > 0)
+        memcpy(all + disk_cache.recorded_count, disk_cache.entries, disk_cache.count * sizeof(Tt_Entry));
+      count = cache_compact(all, count);
+      if (cache_write_file(disk_cache.path, all, count))
+        fprintf(stderr, "Кэш %s: %zu позиций\n", disk_cache.path, count);
+      free(all);
+    }
+    disk_cache.recorded_count = 0;
+  }
+  pthread_mutex_unlock(&disk_cache.lock);
+}
+
+int disk_cache_merge(const char *output, char **inputs, int count){
+  Tt_Entry *all = NULL;
+  size_t total = 0;
+  for (int i = 0; i < count; i++)
+  {
+    void *map;
+    size_t bytes, n;
+    const Tt_Entry *entries;
+    if (!cache_map_file(inputs[i], &map, &bytes, &entries, &n))
+    {
+      free(all);
+      return 1;
+    }
+    Tt_Entry *grown = realloc(all, (total + n) * sizeof(Tt_Entry) + 1);
+    if (grown == NULL)
+    {
+      fprintf(stderr, "Не хватает памяти для %zu записей\n", total + n);
+      munmap(map, bytes);
+      free(all);
+      return 1;
+    }
+    all = grown;
+    if (n > 0)
+      memcpy(all + total, entries, n * sizeof(Tt_Entry));
+    total += n;
+    if (map != NULL)
+      munmap(map, bytes);
+  }
+  size_t kept = cache_compact(all, total);
+  bool ok = cache_write_file(output, all, kept);
+  if (ok)
+    printf("Записей во входных файлах: %zu, позиций в %s: %zu\n", total, output, kept);
+  free(all);
+  return ok ? 0 : 1;
+}
+
+// Запоминает глубокий результат в буфере потока для записи при выходе
+static void cache_record(uint64_t key, uint64_t data){
+  Cache_Buffer *buffer = cache_buffer;
+  if (buffer == NULL)
+    return;
+  if (buffer->count == CACHE_THREAD_RECORDS && !buffer->full)
+  {
+    // Повторы одной позиции с итераций углубления выбрасываются на месте
+    buffer->count = cache_compact(buffer->entries, buffer->count);
+    buffer->full = buffer->count > CACHE_THREAD_RECORDS / 2;
+  }
+  if (buffer->count < CACHE_THREAD_RECORDS)
+    buffer->entries[buffer->count++] = (Tt_Entry){key, data};
+}
+
+// Ищет позицию в загруженном файле; ключи равномерны, поэтому поиск
+// интерполяционный, обычно хватает двух-трех чтений
+static bool cache_probe(const Trans_Table *tt, uint64_t hash, Tt_Hit *hit){
+  uint64_t key = hash ^ tt->salt;
+  const Tt_Entry *e = disk_cache.entries;
+  if (disk_cache.count == 0 || key < e[0].key || key > e[disk_cache.count - 1].key)
+    return false;
+  size_t lo = 0, hi = disk_cache.count - 1;
+  for (int step = 0; lo <= hi && key >= e[lo].key && key <= e[hi].key; step++)
+  {
+    // После нескольких шагов - деление пополам, чтобы не выродиться в линейный
+    size_t mid = lo + (hi - lo) / 2;
+    if (step < 4 && e[hi].key != e[lo].key)
+      mid = lo + (size_t)((double)(key - e[lo].key) / (double)(e[hi].key - e[lo].key) * (double)(hi - lo));
+    if (e[mid].key == key)
+    {
+      tt_unpack(e[mid].data, hit);
+      return true;
+    }
+    if (e[mid].key < key)
+      lo = mid + 1;
+    else if (mid == 0)
+      break;
+    else
+      hi = mid - 1;
+  }
+  return false;
+}
+
+// Общая таблица разбита на пары: первая запись хранит самый глубокий
+// результат, вторая - последний. Слова читаются и пишутся атомарно по
+// отдельности, целостность пары слов проверяет XOR
+static bool tt_probe_shared(const Trans_Table *tt, uint64_t hash, Tt_Hit *hit){
+  hash ^= tt->salt;
+  const Tt_Entry *bucket = &tt->entries[hash & tt->mask & ~(size_t)1];
+  for (int i = 0; i < 2; i++)
+  {
+    uint64_t data = __atomic_load_n(&bucket[i].data, __ATOMIC_RELAXED);
+    uint64_t key = __atomic_load_n(&bucket[i].key, __ATOMIC_RELAXED);
+    if ((key ^ data) == hash)
+    {
+      tt_unpack(data, hit);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void tt_store_shared(Trans_Table *tt, uint64_t hash, uint64_t data, int depth){
+  hash ^= tt->salt;
+  Tt_Entry *bucket = &tt->entries[hash & tt->mask & ~(size_t)1];
+  uint64_t old_data = __atomic_load_n(&bucket[0].data, __ATOMIC_RELAXED);
+  uint64_t old_key = __atomic_load_n(&bucket[0].key, __ATOMIC_RELAXED);
+  Tt_Entry *e = &bucket[1];
+  if ((old_key ^ old_data) == hash || (int)((old_data >> 16) & 0xFF) <= depth)
+    e = &bucket[0];
+  __atomic_store_n(&e->key, hash ^ data, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->data, data, __ATOMIC_RELAXED);
+}
+
+static bool tt_probe(const Trans_Table *tt, uint64_t hash, Tt_Hit *hit){
+  if (tt->entries == NULL)
+    return false;
+  if (tt->shared)
+    return tt_probe_shared(tt, hash, hit);
+  const Tt_Entry *e = &tt->entries[hash & tt->mask];
+  uint64_t data = e->data;
+  if (e->key != hash || (uint16_t)(data >> 40) != tt->generation)
+    return false;
+  tt_unpack(data, hit);
+  return true;
+}
+
+static void tt_store(Trans_Table *tt, uint64_t hash, int score, int depth, int bound, Search_Move move){
+  if (tt->entries == NULL)
+    return;
+  uint64_t data = (uint64_t)(uint16_t)score | (uint64_t)(depth > 255 ? 255 : depth) << 16 | (uint64_t)bound << 24 |
+                  (uint64_t)tt->generation << 40;
+  if (move.from >= 0)
+    data |= (uint64_t)move.from << 26 | (uint64_t)move.to << 31 | 1ull << 36;
+  if (disk_cache.path != NULL && depth >= CACHE_MIN_DEPTH)
+    cache_record(hash ^ tt->salt, data & ~(0xFFFFull << 40));
+  if (tt->shared)
+  {
+    tt_store_shared(tt, hash, data, depth);
+    return;
+  }
+  Tt_Entry *e = &tt->entries[hash & tt->mask];
+  // Запись текущего поиска уступает место только не менее глубокой
+  if ((uint16_t)(e->data >> 40) == tt->generation && (int)((e->data >> 16) & 0xFF) > depth)
+    return;
+  e->key = hash;
+  e->data = data;
+}
+
+// Выигрыш хранится в таблице относительно узла, а не корня
+static int tt_score_in(int score, int ply){
+  return score > SEARCH_MATE - MAX_PLY ? score + ply : (score < -SEARCH_MATE + MAX_PLY ? score - ply : score);
+}
+
+static int tt_score_out(int score, int ply){
+  return score > SEARCH_MATE - MAX_PLY ? score - ply : (score < -SEARCH_MATE + MAX_PLY ? score + ply : score);
+}
+
+EVAL_DISPATCH int evaluate_position(char lodic[8][8], char side){
+  if (nnue_net != NULL)
+    return nnue_evaluate(nnue_net, lodic, side);
+  uint32_t masks[4];
+  pack_position(lodic, masks);
+  int score = evaluate_masks(masks);
+  return side == '1' ? score : -score;
+}
+
+// Дерево поиска для отладки (--tree-dump). Узлы пишутся в двоичный файл
+// через свой буфер, поэтому запись стоит несколько сравнений и копирование
+// 19 байт на узел. Пишет только поток, первым начавший поиск: у остальных
+// поток поиска свой, и их деревья перемешались бы. Задачи разделяемого
+// поиска, украденные помощниками, в дереве отсутствуют; задачи, посчитанные
+// самим потоком поиска, помечены.
+//
+// Узел записывается, если его полуход не глубже предела, его родитель
+// записан и предел узлов еще не исчерпан. Запись узла идет после записей
+// его детей, так что дерево восстанавливается одним проходом со стеком.
+// Родитель определяется по уровню кадра, а не по полуходу: проверочный
+// поиск ProbCut занимает кадр в той же позиции.
+//
+// Формат: "CHTREE01", байт правил, байт предела полуходов, затем записи.
+//   'S' (20 байт) - поиск из корня: сторона ('1'/'2'), номер линии, глубина
+//       итерации, маски позиции pack_position по 4 байта;
+//   'N' (19 байт) - узел: уровень кадра, полуход, глубина (со знаком),
+//       флаги TREE_*, поля хода в узел (255 - нет хода), номер хода в
+//       порядке перебора, флаги TREE_MOVE_*, альфа, бета и оценка по 2 байта
+//       со знаком, узлов поддерева (4 байта);
+//   'E' (10 байт) - конец: записано узлов (8 байт), 1 - предел узлов достигнут.
+// Числа записываются младшим байтом вперед.
+
+#define TREE_MAGIC "CHTREE01"
+#define TREE_BUFFER (1 << 16)
+#define TREE_SEARCH_BYTES 20
+#define TREE_NODE_BYTES 19
+#define TREE_END_BYTES 10
+#define TREE_NO_SQUARE 255
+
+#define TREE_PV 1                     // Узел главного варианта
+#define TREE_TT 2                     // Отсечение по таблице переходов
+#define TREE_FAIL_HIGH 4              // Оценка не меньше беты
+#define TREE_FAIL_LOW 8               // Оценка не больше альфы
+#define TREE_LEAF 16                  // Статическая оценка или нет ходов
+#define TREE_DRAW 32                  // Ничья повторением или правилом ходов
+#define TREE_PROBCUT 64               // Отсечение ProbCut
+#define TREE_STOPPED 128              // Время вышло, оценка недействительна
+
+#define TREE_MOVE_CAPTURE 1           // Ход - взятие
+#define TREE_MOVE_PROBCUT 2           // Не ход, а проверочный поиск ProbCut той же позиции
+#define TREE_MOVE_SPLIT 4             // Задача разделяемого поиска
+
+typedef struct
+{
+  unsigned char from, to;
+  unsigned char order;
+  unsigned char flags;
+} Tree_Move;
+
+typedef struct Tree_Dump
+{
+  int fd;                             // -1 - дерево не пишется
+  int max_ply;                        // Узлы глубже не пишутся
+  uint64_t max_nodes;
+  uint64_t count;                     // Записано узлов
+  bool truncated;                     // Часть узлов не записана из-за предела
+  Search_Thread *owner;               // Поток, который пишет дерево
+  Tree_Move moves[SEARCH_FRAMES];     // Ход в узел каждого уровня кадров
+  bool open[SEARCH_FRAMES];           // Узел уровня пишется
+  size_t used;
+  unsigned char buffer[TREE_BUFFER];
+} Tree_Dump;
+
+static Tree_Dump tree_dump = {.fd = -1};
+
+static void tree_flush(Tree_Dump *tree){
+  size_t done = 0;
+  while (done < tree->used)
+  {
+    ssize_t n = write(tree->fd, tree->buffer + done, tree->used - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+    {
+      // Остальные узлы не пишутся, чтобы не сыпать ошибками на каждом
+      fprintf(stderr, "Не удалось записать дерево поиска: %s\n", strerror(errno));
+      tree->max_nodes = tree->count;
+      break;
+    }
+    done += (size_t)n;
+  }
+  tree->used = 0;
+}
+
+static void tree_put(Tree_Dump *tree, const unsigned char *data, size_t size){
+  if (tree->used + size > TREE_BUFFER)
+    tree_flush(tree);
+  memcpy(tree->buffer + tree->used, data, size);
+  tree->used += size;
+}
+
+static void tree_put16(unsigned char *out, int value){
+  out[0] = (unsigned char)value;
+  out[1] = (unsigned char)(value >> 8);
+}
+
+static void tree_put32(unsigned char *out, uint32_t value){
+  for (int i = 0; i < 4; i++)
+    out[i] = (unsigned char)(value >> (8 * i));
+}
+
+bool tree_dump_open(const char *path, int max_ply, uint64_t max_nodes){
+  tree_dump.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (tree_dump.fd < 0)
+  {
+    fprintf(stderr, "Не удалось создать %s: %s\n", path, strerror(errno));
+    return false;
+  }
+  tree_dump.max_ply = max_ply;
+  tree_dump.max_nodes = max_nodes;
+  unsigned char header[10];
+  memcpy(header, TREE_MAGIC, 8);
+  header[8] = (unsigned char)rules_variant;
+  header[9] = (unsigned char)max_ply;
+  tree_put(&tree_dump, header, sizeof(header));
+  return true;
+}
+
+void tree_dump_close(void){
+  if (tree_dump.fd < 0)
+    return;
+  unsigned char end[TREE_END_BYTES] = {'E'};
+  tree_put32(end + 1, (uint32_t)tree_dump.count);
+  tree_put32(end + 5, (uint32_t)(tree_dump.count >> 32));
+  end[9] = tree_dump.truncated;
+  tree_put(&tree_dump, end, sizeof(end));
+  tree_flush(&tree_dump);
+  close(tree_dump.fd);
+  fprintf(stderr, "Дерево поиска: %llu узлов%s\n", (unsigned long long)tree_dump.count,
+          tree_dump.truncated ? ", остальные отброшены пределом" : "");
+  tree_dump.fd = -1;
+}
+
+// Дерево достается первому потоку, начавшему поиск
+static Tree_Dump *tree_dump_claim(Search_Thread *st){
+  if (tree_dump.fd < 0)
+    return NULL;
+  Search_Thread *owner = NULL;
+  __atomic_compare_exchange_n(&tree_dump.owner, &owner, st, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+  return owner == NULL || owner == st ? &tree_dump : NULL;
+}
+
+// Запоминает ход, по которому поиск идет в узел уровня level
+static void tree_dump_move(Tree_Dump *tree, int level, int from, int to, int order, int flags){
+  if (level >= SEARCH_FRAMES)
+    return;
+  Tree_Move *m = &tree->moves[level];
+  m->from = (unsigned char)from;
+  m->to = (unsigned char)to;
+  m->order = (unsigned char)order;
+  m->flags = (unsigned char)flags;
+}
+
+static void tree_dump_search(Tree_Dump *tree, char lodic[8][8], char side, int line, int depth){
+  if (tree->count >= tree->max_nodes)
+    return;
+  unsigned char record[TREE_SEARCH_BYTES] = {'S', (unsigned char)side, (unsigned char)line, (unsigned char)depth};
+  uint32_t masks[4];
+  pack_position(lodic, masks);
+  for (int i = 0; i < 4; i++)
+    tree_put32(record + 4 + 4 * i, masks[i]);
+  tree_put(tree, record, sizeof(record));
+  tree_dump_move(tree, 0, TREE_NO_SQUARE, TREE_NO_SQUARE, 0, 0);
+}
+
+static void tree_dump_node(Tree_Dump *tree, int level, int ply, int depth, int flags, int alpha, int beta, int score,
+                           uint64_t nodes){
+  const Tree_Move *m = &tree->moves[level];
+  unsigned char record[TREE_NODE_BYTES] = {'N', (unsigned char)level, (unsigned char)ply, (unsigned char)depth,
+                                           (unsigned char)flags, m->from, m->to, m->order, m->flags};
+  tree_put16(record + 9, alpha);
+  tree_put16(record + 11, beta);
+  tree_put16(record + 13, score);
+  tree_put32(record + 15, nodes > UINT32_MAX ? UINT32_MAX : (uint32_t)nodes);
+  tree_put(tree, record, sizeof(record));
+}
+
+// Узел дерева, прочитанный из файла
+typedef struct
+{
+  int level, ply, depth, flags;
+  int from, to, order, move_flags;
+  int alpha, beta, score;
+  uint32_t nodes;
+  int first_child;                    // -1 - детей нет
+  int next_sibling;
+} Tree_Node;
+
+// Поиск из корня, прочитанный из файла
+typedef struct
+{
+  char side;
+  int line, depth;
+  uint32_t masks[4];
+  int root;                           // -1 - поиск не записан до конца
+} Tree_Search;
+
+static int tree_get16(const unsigned char *in){
+  return (int16_t)(in[0] | in[1] << 8);
+}
+
+static uint32_t tree_get32(const unsigned char *in){
+  return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+// Позиция корня в FEN: номера полей как в parse_fen
+static void tree_fen(const Tree_Search *s, char *out, size_t size){
+  int used = snprintf(out, size, "%c", s->side == '2' ? 'W' : 'B');
+  for (int color = 0; color < 2; color++)
+  {
+    uint32_t men = s->masks[color == 0 ? 2 : 0], kings = s->masks[color == 0 ? 3 : 1];
+    used += snprintf(out + used, size - (size_t)used, ":%c", color == 0 ? 'W' : 'B');
+    const char *comma = "";
+    for (int sq = 0; sq < SQUARES; sq++)
+      if ((men | kings) >> sq & 1)
+      {
+        used += snprintf(out + used, size - (size_t)used, "%s%s%d", comma, kings >> sq & 1 ? "K" : "", sq + 1);
+        comma = ",";
+      }
+  }
+}
+
+static void tree_move_text(const Tree_Node *n, char *out){
+  if (n->move_flags & TREE_MOVE_PROBCUT)
+    strcpy(out, "ProbCut");
+  else if (n->from == TREE_NO_SQUARE)
+    strcpy(out, "корень");
+  else
+    format_search_move((Search_Move){n->from, n->to, n->move_flags & TREE_MOVE_CAPTURE ? 1u : 0u}, out);
+}
+
+static const char *const tree_flag_names[8] = {"pv", "tt", "fail-high", "fail-low", "leaf", "draw", "probcut", "stopped"};
+
+static void tree_write_dot(FILE *f, const Tree_Node *nodes, int index){
+  const Tree_Node *n = &nodes[index];
+  char move[16];
+  tree_move_text(n, move);
+  fprintf(f, "  n%d [label=\"%s #%d\\nd=%d [%d,%d] %d\\n%u узл.", index, move, n->order, n->depth, n->alpha,
+          n->beta, n->score, n->nodes);
+  for (int bit = 1; bit < 8; bit++)
+    if (n->flags >> bit & 1)
+      fprintf(f, " %s", tree_flag_names[bit]);
+  // Отсечения по бете - красные, узлы без улучшения альфы - синие,
+  // отсеченные без перебора ходов - серые
+  const char *color = n->flags & TREE_FAIL_HIGH ? "red" : (n->flags & TREE_FAIL_LOW ? "blue" : "black");
+  fprintf(f, "\", color=%s%s%s];\n", color, n->flags & TREE_PV ? ", penwidth=2" : "",
+          n->flags & (TREE_TT | TREE_PROBCUT | TREE_DRAW) ? ", style=filled, fillcolor=gray90"
+                                                             : (n->flags & TREE_STOPPED ? ", style=dashed" : ""));
+  for (int c = n->first_child; c >= 0; c = nodes[c].next_sibling)
+  {
+    tree_write_dot(f, nodes, c);
+    fprintf(f, "  n%d -> n%d;\n", index, c);
+  }
+}
+
+static void tree_write_json(FILE *f, const Tree_Node *nodes, int index){
+  const Tree_Node *n = &nodes[index];
+  char move[16];
+  tree_move_text(n, move);
+  fprintf(f, "{\"move\":\"%s\",\"order\":%d,\"ply\":%d,\"depth\":%d,\"alpha\":%d,\"beta\":%d,\"score\":%d,\"nodes\":%u,"
+             "\"split\":%s,\"flags\":[",
+          move, n->order, n->ply, n->depth, n->alpha, n->beta, n->score, n->nodes,
+          n->move_flags & TREE_MOVE_SPLIT ? "true" : "false");
+  const char *comma = "";
+  for (int bit = 0; bit < 8; bit++)
+    if (n->flags >> bit & 1)
+    {
+      fprintf(f, "%s\"%s\"", comma, tree_flag_names[bit]);
+      comma = ",";
+    }
+  fprintf(f, "],\"children\":[");
+  for (int c = n->first_child; c >= 0; c = nodes[c].next_sibling)
+  {
+    tree_write_json(f, nodes, c);
+    if (nodes[c].next_sibling >= 0)
+      fputc(',', f);
+  }
+  fprintf(f, "]}");
+}
+
+int tree_dump_convert(const char *input, const char *output){
+  const char *ext = strrchr(output, '.');
+  bool dot = ext != NULL && strcmp(ext, ".dot") == 0;
+  if (!dot && (ext == NULL || strcmp(ext, ".json") != 0))
+  {
+    printf("Формат выхода определяется расширением: .dot или .json\n");
+    return 1;
+  }
+  FILE *in = fopen(input, "rb");
+  if (in == NULL)
+  {
+    printf("Не удалось открыть %s: %s\n", input, strerror(errno));
+    return 1;
+  }
+  unsigned char header[10];
+  if (fread(header, 1, sizeof(header), in) != sizeof(header) || memcmp(header, TREE_MAGIC, 8) != 0)
+  {
+    printf("Файл %s не является деревом поиска\n", input);
+    fclose(in);
+    return 1;
+  }
+
+  // Записи идут после детей: дети узла уровня L - узлы уровня L + 1,
+  // законченные после прошлого узла уровня L
+  Tree_Node *nodes = NULL;
+  Tree_Search *searches = NULL;
+  size_t node_count = 0, node_capacity = 0, search_count = 0, search_capacity = 0;
+  int head[SEARCH_FRAMES + 1], tail[SEARCH_FRAMES + 1];
+  for (int i = 0; i <= SEARCH_FRAMES; i++)
+    head[i] = tail[i] = -1;
+  bool complete = false, truncated = false, ok = true;
+  int type;
+  while (ok && (type = fgetc(in)) != EOF)
+  {
+    unsigned char r[TREE_SEARCH_BYTES];
+    if (type == 'S')
+    {
+      ok = fread(r + 1, 1, TREE_SEARCH_BYTES - 1, in) == TREE_SEARCH_BYTES - 1;
+      if (ok && search_count == search_capacity)
+      {
+        search_capacity = search_capacity == 0 ? 64 : search_capacity * 2;
+        Tree_Search *grown = realloc(searches, search_capacity * sizeof(Tree_Search));
+        ok = grown != NULL;
+        if (ok)
+          searches = grown;
+      }
+      if (!ok)
+        break;
+      Tree_Search *s = &searches[search_count++];
+      s->side = (char)r[1];
+      s->line = r[2];
+      s->depth = r[3];
+      for (int i = 0; i < 4; i++)
+        s->masks[i] = tree_get32(r + 4 + 4 * i);
+      s->root = -1;
+      for (int i = 0; i <= SEARCH_FRAMES; i++)
+        head[i] = tail[i] = -1;
+    }
+    else if (type == 'N')
+    {
+      ok = fread(r + 1, 1, TREE_NODE_BYTES - 1, in) == TREE_NODE_BYTES - 1 && r[1] < SEARCH_FRAMES &&
+           search_count > 0;
+      if (ok && node_count == node_capacity)
+      {
+        node_capacity = node_capacity == 0 ? 4096 : node_capacity * 2;
+        Tree_Node *grown = realloc(nodes, node_capacity * sizeof(Tree_Node));
+        ok = grown != NULL;
+        if (ok)
+          nodes = grown;
+      }
+      if (!ok)
+        break;
+      int index = (int)node_count++;
+      Tree_Node *n = &nodes[index];
+      n->level = r[1];
+      n->ply = r[2];
+      n->depth = (signed char)r[3];
+      n->flags = r[4];
+      n->from = r[5];
+      n->to = r[6];
+      n->order = r[7];
+      n->move_flags = r[8];
+      n->alpha = tree_get16(r + 9);
+      n->beta = tree_get16(r + 11);
+      n->score = tree_get16(r + 13);
+      n->nodes = tree_get32(r + 15);
+      n->first_child = head[n->level + 1];
+      n->next_sibling = -1;
+      head[n->level + 1] = tail[n->level + 1] = -1;
+      if (n->level == 0)
+        searches[search_count - 1].root = index;
+      else if (head[n->level] < 0)
+        head[n->level] = tail[n->level] = index;
+      else
+      {
+        nodes[tail[n->level]].next_sibling = index;
+        tail[n->level] = index;
+      }
+    }
+    else if (type == 'E')
+    {
+      ok = fread(r + 1, 1, TREE_END_BYTES - 1, in) == TREE_END_BYTES - 1;
+      complete = ok;
+      truncated = ok && r[9] != 0;
+      break;
+    }
+    else
+      ok = false;
+  }
+  fclose(in);
+  if (!ok)
+  {
+    printf("Файл %s поврежден\n", input);
+    free(nodes);
+    free(searches);
+    return 1;
+  }
+
+  FILE *out = fopen(output, "w");
+  if (out == NULL)
+  {
+    printf("Не удалось создать %s: %s\n", output, strerror(errno));
+    free(nodes);
+    free(searches);
+    return 1;
+  }
+  if (dot)
+    fprintf(out, "digraph search {\n  node [shape=box, fontname=\"monospace\", fontsize=9];\n");
+  else
+    fprintf(out, "[\n");
+  int written = 0;
+  for (size_t i = 0; i < search_count; i++)
+  {
+    const Tree_Search *s = &searches[i];
+    if (s->root < 0)
+      continue;
+    char fen[160];
+    tree_fen(s, fen, sizeof(fen));
+    if (dot)
+    {
+      fprintf(out, "  s%zu [shape=note, label=\"Поиск %zu, линия %d, глубина %d\\n%s\"];\n", i + 1, i + 1,
+              s->line + 1, s->depth, fen);
+      tree_write_dot(out, nodes, s->root);
+      fprintf(out, "  s%zu -> n%d;\n", i + 1, s->root);
+    }
+    else
+    {
+      fprintf(out, "%s{\"search\":%zu,\"line\":%d,\"depth\":%d,\"fen\":\"%s\",\"tree\":", written > 0 ? ",\n" : "",
+              i + 1, s->line + 1, s->depth, fen);
+      tree_write_json(out, nodes, s->root);
+      fputc('}', out);
+    }
+    written++;
+  }
+  fprintf(out, dot ? "}\n" : "\n]\n");
+  ok = fclose(out) == 0;
+  printf("Поисков: %d, узлов: %zu%s%s\n", written, node_count,
+         truncated ? ", дерево обрезано пределом узлов" : "",
+         complete ? "" : ", файл не закончен: программа не завершилась нормально");
+  free(nodes);
+  free(searches);
+  return ok ? 0 : 1;
+}
+
+// Разделяемый поиск (--threads N): узлы главного варианта у корня делятся
+// между потоками по схеме YBWC. Старший ход считается в самом потоке
+// поиска, после него младшие братья раздаются задачами с нулевым окном,
+// а пересчеты с полным окном идут снова в потоке поиска по порядку ходов.
+// Задачи лежат в очереди Чейза-Лева потока поиска: владелец кладет и
+// берет с нижнего конца, помощники из общего пула крадут с верхнего.
+//
+// Результат не зависит от того, какой поток посчитал задачу и когда: у
+// каждого младшего брата свой контекст - таблица переходов, killer-ходы и
+// история, - найденный по хэшу узла и номеру хода. Задача пишет только в
+// свой контекст и читает еще таблицу узла разделения, в которую, пока
+// задачи считаются, никто не пишет. Контекст между итерациями копит одно и
+// то же при любом количестве потоков, а отсечения не прерывают соседние
+// задачи. Поэтому при ограничении по глубине ход,
+// оценка и количество узлов одинаковы при 2 и при 32 потоках. Со временем
+// на ход и общей таблицей (--shared-hash) воспроизводимость теряется, как и
+// в обычном поиске.
+
+typedef struct Split_Context
+{
+  uint64_t key;                       // Хэш узла разделения и номер хода
+  Trans_Table tt;
+  Search_Move killers[MAX_PLY][2];
+  int history[SQUARES][SQUARES];
+} Split_Context;
+
+typedef struct
+{
+  struct Split_Point *point;
+  int index;                          // Номер хода в списке узла
+  Hod hod;
+  int order;                          // Номер хода в порядке перебора
+  int reduction;                      // Сокращение LMR
+  char child[8][8];                   // Позиция после хода
+  uint64_t hash;
+  int clock;
+  Split_Context *context;             // NULL - контексты кончились, задача считается с чистого листа
+  int score;
+  bool stopped;                       // Поиск задачи прерван по времени
+} Split_Task;
+
+typedef struct Split_Point
+{
+  struct Search_Thread *master;       // Поток, ведущий поиск
+  const Game_History *history;        // История партии потока поиска
+  char side;                          // Сторона, которая ходит в дочерних позициях
+  int ply;                            // Полуход дочерних позиций
+  int depth;                          // Глубина дочерних позиций без сокращения
+  int alpha;                          // Альфа узла на момент раздачи задач
+  int count;                          // Задач вместе со старшим ходом
+  int remaining;                      // Розданных задач еще не посчитано
+  bool stop;                          // Одна из задач прервана, остальные тоже бросают счет
+  Trans_Table parent_tt;              // Таблица узла разделения, только для чтения
+  Split_Task tasks[MAX_HODS];
+} Split_Point;
+
+// Очередь Чейза-Лева без блокировок. Одновременно в ней лежат задачи
+// только одного узла, поэтому кольцо не растет
+typedef struct
+{
+  _Alignas(64) long top;
+  _Alignas(64) long bottom;
+  _Alignas(64) Split_Task *tasks[SPLIT_DEQUE_SIZE];
+} Split_Deque;
+
+typedef struct Split_State
+{
+  Split_Deque deque;
+  bool in_use;                        // Занято потоком поиска; освобождается при его завершении
+  int max_helpers;                    // Сколько помощников может одновременно считать задачи
+  int helpers;                        // Сколько считает сейчас
+  int used;                           // Выдано контекстов в текущем поиске
+  Split_Context root;                 // Таблица и эвристики самого поиска, пока загружен другой контекст
+  Split_Context scratch;              // Контекст задач, которым не хватило своего
+  Split_Context contexts[SPLIT_CONTEXTS];
+  Tt_Entry *tt_slab;                  // Таблицы контекстов и scratch, выделяются вместе с состоянием
+  int map[2 * SPLIT_CONTEXTS];        // Открытая адресация по ключу: номер контекста + 1
+  Split_Point points[SPLIT_MAX_PLY];
+} Split_State;
+
+static Split_State *split_states[SPLIT_MAX_MASTERS]; // Очереди, из которых крадут помощники
+static int split_state_count;
+static int split_worker_count;
+static long split_pending;                          // Задач в очередях
+static pthread_mutex_t split_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t split_cond = PTHREAD_COND_INITIALIZER;
+static _Thread_local Split_State *split_state;       // Состояние потока поиска
+static _Thread_local Split_Context *split_scratch;   // Контекст задач без своего в этом потоке
+
+static void split_push(Split_Deque *deque, Split_Task *task){
+  long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->tasks[bottom & (SPLIT_DEQUE_SIZE - 1)], task, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+}
+
+static Split_Task *split_take(Split_Deque *deque){
+  long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+  if (top > bottom)
+  {
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  Split_Task *task = __atomic_load_n(&deque->tasks[bottom & (SPLIT_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+  if (top == bottom)
+  {
+    // Последнюю задачу может одновременно красть помощник
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+      task = NULL;
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+  }
+  return task;
+}
+
+static Split_Task *split_steal(Split_Deque *deque){
+  long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+  if (top >= bottom)
+    return NULL;
+  Split_Task *task = __atomic_load_n(&deque->tasks[top & (SPLIT_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    return NULL;
+  return task;
+}
+
+// Меняет загруженные в поток таблицу и эвристики на контекст to, сохраняя
+// текущие в их контекст. У помощника между задачами контекста нет
+static void split_switch(Search_Thread *st, Split_Context *to){
+  Split_Context *from = st->context;
+  if (from == to)
+    return;
+  if (from != NULL)
+  {
+    from->tt = search_tt;
+    memcpy(from->killers, st->killers, sizeof(st->killers));
+    memcpy(from->history, st->history, sizeof(st->history));
+  }
+  if (to != NULL)
+  {
+    search_tt = to->tt;
+    memcpy(st->killers, to->killers, sizeof(st->killers));
+    memcpy(st->history, to->history, sizeof(st->history));
+  }
+  else
+    memset(&search_tt, 0, sizeof(search_tt));
+  st->context = to;
+}
+
+// Записей в таблице одного контекста: таблицы всех контекстов поиска и его
+// scratch вместе помещаются в --hash. Поддерево узла разделения намного
+// меньше всего дерева, поэтому маленькой таблицы ему хватает
+static size_t split_tt_count(){
+  size_t count = 1;
+  while (count * 2 * sizeof(Tt_Entry) * (SPLIT_CONTEXTS + 1) <= ((size_t)tt_size_mb << 20))
+    count *= 2;
+  return count;
+}
+
+// Таблицы выделяются до поиска; NULL - контекст считает без таблицы
+static Tt_Entry *split_tt_alloc(size_t contexts){
+  if (shared_tt_entries != NULL || tt_size_mb <= 0)
+    return NULL;
+  return calloc(split_tt_count() * contexts, sizeof(Tt_Entry));
+}
+
+static void split_tt_attach(Split_Context *ctx, Tt_Entry *entries){
+  ctx->tt.entries = entries;
+  ctx->tt.mask = entries != NULL ? split_tt_count() - 1 : 0;
+}
+
+static void split_context_reset(Split_Context *ctx){
+  if (ctx->tt.entries != NULL || shared_tt_entries != NULL)
+    tt_new_search(&ctx->tt);
+  memset(ctx->killers, -1, sizeof(ctx->killers));
+  memset(ctx->history, 0, sizeof(ctx->history));
+}
+
+// Контекст дочерней позиции: один и тот же на всех итерациях поиска
+static Split_Context *split_context(Split_State *state, const Search_Thread *st, uint64_t hash, int index){
+  uint64_t key = hash ^ (uint64_t)(index + 1) * 0x9E3779B97F4A7C15ull;
+  size_t slot = (size_t)(key >> 32) & (2 * SPLIT_CONTEXTS - 1);
+  for (; state->map[slot] != 0; slot = (slot + 1) & (2 * SPLIT_CONTEXTS - 1))
+    if (state->contexts[state->map[slot] - 1].key == key)
+      return &state->contexts[state->map[slot] - 1];
+  if (state->used == SPLIT_CONTEXTS)
+    return NULL;
+  Split_Context *ctx = &state->contexts[state->used];
+  ctx->key = key;
+  split_context_reset(ctx);
+  memcpy(ctx->killers, st->killers, sizeof(ctx->killers));
+  memcpy(ctx->history, st->history, sizeof(ctx->history));
+  state->map[slot] = ++state->used;
+  return ctx;
+}
+
+static void split_run_task(Split_Task *task);
+
+static void *split_worker(void *arg){
+  (void)arg;
+  split_scratch = calloc(1, sizeof(Split_Context));
+  if (split_scratch == NULL)
+    return NULL;
+  split_tt_attach(split_scratch, split_tt_alloc(1));
+  search_thread_get();
+  cache_buffer_get();
+  unsigned start = 0;
+  for (;;)
+  {
+    // Пока задач нет, записи для кэша переносятся в общий список
+    if (__atomic_load_n(&split_pending, __ATOMIC_ACQUIRE) == 0)
+      cache_buffer_flush(cache_buffer);
+    pthread_mutex_lock(&split_mutex);
+    while (__atomic_load_n(&split_pending, __ATOMIC_ACQUIRE) == 0)
+      pthread_cond_wait(&split_cond, &split_mutex);
+    pthread_mutex_unlock(&split_mutex);
+
+    // Очереди обходятся с разных мест, чтобы помощники не толпились у одной
+    int count = __atomic_load_n(&split_state_count, __ATOMIC_ACQUIRE);
+    Split_Task *task = NULL;
+    Split_State *state = NULL;
+    for (int k = 0; k < count && task == NULL; k++)
+    {
+      state = __atomic_load_n(&split_states[(start + k) % count], __ATOMIC_ACQUIRE);
+      int helpers = __atomic_load_n(&state->helpers, __ATOMIC_RELAXED);
+      if (helpers >= __atomic_load_n(&state->max_helpers, __ATOMIC_RELAXED) ||
+          !__atomic_compare_exchange_n(&state->helpers, &helpers, helpers + 1, false, __ATOMIC_ACQUIRE,
+                                       __ATOMIC_RELAXED))
+        continue;
+      task = split_steal(&state->deque);
+      if (task == NULL)
+        __atomic_sub_fetch(&state->helpers, 1, __ATOMIC_RELEASE);
+    }
+    start++;
+    if (task == NULL)
+    {
+      sched_yield();
+      continue;
+    }
+    __atomic_sub_fetch(&split_pending, 1, __ATOMIC_RELAXED);
+    split_run_task(task);
+    __atomic_sub_fetch(&state->helpers, 1, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+// Состояние освобождается при завершении потока поиска и достается
+// следующему; очередь остается в списке, из которого крадут помощники
+static void split_release(void *state){
+  __atomic_store_n(&((Split_State *)state)->in_use, false, __ATOMIC_RELEASE);
+}
+
+static pthread_key_t split_key;
+static pthread_once_t split_key_once = PTHREAD_ONCE_INIT;
+
+static void split_key_create(){
+  pthread_key_create(&split_key, split_release);
+}
+
+// Готовит поток к разделяемому поиску с threads потоками; NULL - не удалось,
+// поиск идет в одном потоке
+static Split_State *split_begin(Search_Thread *st, int threads){
+  if (threads > SPLIT_MAX_THREADS)
+    threads = SPLIT_MAX_THREADS;
+  pthread_mutex_lock(&split_mutex);
+  if (split_state == NULL)
+  {
+    for (int i = 0; i < split_state_count && split_state == NULL; i++)
+      if (!__atomic_load_n(&split_states[i]->in_use, __ATOMIC_ACQUIRE))
+        split_state = split_states[i];
+    if (split_state == NULL && split_state_count < SPLIT_MAX_MASTERS &&
+        (split_state = aligned_alloc(64, sizeof(Split_State))) != NULL)
+    {
+      memset(split_state, 0, sizeof(Split_State));
+      Tt_Entry *slab = split_state->tt_slab = split_tt_alloc(SPLIT_CONTEXTS + 1);
+      size_t count = slab != NULL ? split_tt_count() : 0;
+      for (int i = 0; i < SPLIT_CONTEXTS; i++)
+        split_tt_attach(&split_state->contexts[i], slab != NULL ? slab + i * count : NULL);
+      split_tt_attach(&split_state->scratch, slab != NULL ? slab + SPLIT_CONTEXTS * count : NULL);
+      __atomic_store_n(&split_states[split_state_count], split_state, __ATOMIC_RELEASE);
+      __atomic_store_n(&split_state_count, split_state_count + 1, __ATOMIC_RELEASE);
+    }
+    if (split_state != NULL)
+    {
+      __atomic_store_n(&split_state->in_use, true, __ATOMIC_RELAXED);
+      pthread_once(&split_key_once, split_key_create);
+      pthread_setspecific(split_key, split_state);
+    }
+  }
+  while (split_state != NULL && split_worker_count < threads - 1)
+  {
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    bool created = pthread_create(&thread, &attr, split_worker, NULL) == 0;
+    pthread_attr_destroy(&attr);
+    if (!created)
+      break;
+    split_worker_count++;
+  }
+  pthread_mutex_unlock(&split_mutex);
+  Split_State *state = split_state;
+  if (state == NULL)
+    return NULL;
+
+  __atomic_store_n(&state->max_helpers, threads - 1, __ATOMIC_RELAXED);
+  state->used = 0;
+  memset(state->map, 0, sizeof(state->map));
+  split_scratch = &state->scratch;
+  st->context = &state->root;
+  st->split_point = NULL;
+  st->helper_nodes = 0;
+  return state;
+}
+
+static Search_Move search_move_of(const Hod_List *list, Hod h){
+  Search_Move m = {(signed char)HOD_FROM(h), (signed char)HOD_TO(h), list->captured[HOD_CAPTURE(h)]};
+  return m;
+}
+
+static bool search_move_equal(Search_Move a, Search_Move b){
+  return a.from == b.from && a.to == b.to && a.captured == b.captured;
+}
+
+static void search_check_time(Search_Thread *st){
+  if (!st->can_stop)
+    return;
+  if (st->split_point != NULL && __atomic_load_n(&st->split_point->stop, __ATOMIC_RELAXED))
+    st->stop = true;
+  // Бюджет узлов не зависит от скорости машины: результат воспроизводим.
+  // В разделяемом поиске к нему добавляются только досчитанные помощниками
+  // задачи, и бюджет соблюдается приблизительно
+  const Search_Thread *master = st->split_point != NULL ? st->split_point->master : st;
+  uint64_t nodes = st->nodes + __atomic_load_n(&master->helper_nodes, __ATOMIC_RELAXED);
+  if (st->options->max_nodes > 0 && nodes >= st->options->max_nodes)
+    st->stop = true;
+  if (st->options->cancel != NULL && __atomic_load_n(st->options->cancel, __ATOMIC_RELAXED))
+    st->stop = true;
+  if (st->options->time_ms <= 0)
+    return;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (now.tv_sec > st->deadline.tv_sec || (now.tv_sec == st->deadline.tv_sec && now.tv_nsec >= st->deadline.tv_nsec))
+    st->stop = true;
+}
+
+static bool search_is_draw(const Search_Thread *st, int ply){
+  // Внутри поиска ничьей считается уже второе появление позиции: если
+  // повторение выгодно одной из сторон, она повторит позицию и в третий раз
+  int clock = st->clock[ply];
+  if (draw_moves > 0 && clock >= 2 * draw_moves)
+    return true;
+  uint64_t hash = st->hashes[ply];
+  for (int j = ply - 2; j >= ply - clock; j -= 2)
+  {
+    uint64_t earlier = j >= 0 ? st->hashes[j] : HISTORY_AT(&game_history, game_history.count - 1 + j);
+    if (earlier == hash)
+      return true;
+  }
+  return false;
+}
+
+static int search_move_key(const Search_Thread *st, const Hod_List *list, Hod h, int ply, Search_Move tt_move){
+  Search_Move m = search_move_of(list, h);
+  if (ply < st->prev_pv_length && search_move_equal(m, st->prev_pv[ply]))
+    return 1 << 30;
+  if (m.from == tt_move.from && m.to == tt_move.to)
+    return (1 << 30) - 1;
+  if (m.captured != 0)
+    return (1 << 29) + __builtin_popcount(m.captured);
+  if (search_move_equal(m, st->killers[ply][0]))
+    return (1 << 28) + 1;
+  if (search_move_equal(m, st->killers[ply][1]))
+    return 1 << 28;
+  return st->history[m.from][m.to];
+}
+
+static void search_store_cutoff(Search_Thread *st, const Hod_List *list, Hod h, int depth, int ply){
+  Search_Move m = search_move_of(list, h);
+  if (!search_move_equal(m, st->killers[ply][0]))
+  {
+    st->killers[ply][1] = st->killers[ply][0];
+    st->killers[ply][0] = m;
+  }
+  st->history[m.from][m.to] += depth * depth;
+  // Счетчики не должны дорасти до ключей взятий и killer-ходов
+  if (st->history[m.from][m.to] > (1 << 20))
+    for (int from = 0; from < SQUARES; from++)
+      for (int to = 0; to < SQUARES; to++)
+        st->history[from][to] /= 2;
+}
+
+static int search_node(char lodic[8][8], char side, int depth, int alpha, int beta, int ply, bool pv_node);
+static int search_split(Search_Thread *st, Search_Frame *frame, const Hod_List *list, char lodic[8][8], char side,
+                        int depth, int alpha, int beta, int ply);
+
+static int search_frame(Search_Thread *st, Search_Frame *frame, char lodic[8][8], char side, int depth, int alpha,
+                        int beta, int ply, bool pv_node){
+  st->pv_length[ply] = 0;
+  if ((++st->nodes & 1023) == 0)
+    search_check_time(st);
+  if (st->stop)
+    return 0;
+  if (ply > 0 && search_is_draw(st, ply))
+  {
+    st->tree_flags = TREE_DRAW;
+    return 0;
+  }
+
+  // В главном варианте таблица дает только порядок ходов, иначе вариант
+  // обрывался бы на позиции из таблицы
+  uint64_t hash = st->hashes[ply];
+  Search_Move tt_move = {-1, -1, 0};
+  Tt_Hit hit, cached;
+  // Задача разделяемого поиска смотрит еще и таблицу узла разделения:
+  // пока задачи считаются, в нее никто не пишет
+  bool found = ply > 0 && (tt_probe(&search_tt, hash, &hit) ||
+                           (st->split_point != NULL && tt_probe(&st->split_point->parent_tt, hash, &hit)));
+  if (ply > 0 && depth >= CACHE_MIN_DEPTH && disk_cache.count > 0 && (!found || hit.depth < depth) &&
+      cache_probe(&search_tt, hash, &cached) && (!found || cached.depth > hit.depth))
+  {
+    hit = cached;
+    found = true;
+  }
+  if (found)
+  {
+    tt_move = hit.move;
+    int score = tt_score_out(hit.score, ply);
+    if (!pv_node && hit.depth >= depth &&
+        (hit.bound == TT_BOUND_EXACT || (hit.bound == TT_BOUND_LOWER && score >= beta) ||
+         (hit.bound == TT_BOUND_UPPER && score <= alpha)))
+    {
+      st->tree_flags = TREE_TT;
+      return score;
+    }
+  }
+
+  Hod_List *list = &st->root_list;
+  if (ply > 0)
+  {
+    list = &frame->list;
+    if (generate_hods(lodic, side, list) == 0)
+    {
+      st->tree_flags = TREE_LEAF;
+      return -SEARCH_MATE + ply;
+    }
+  }
+  int count = list->count;
+  bool captures = HOD_CAPTURE(list->hods[0]) != 0;
+  // На нулевой глубине досчитываются только взятия: позиция с обязательным
+  // взятием оценивается после того, как размен закончится
+  if ((depth <= 0 && !captures) || ply >= MAX_PLY - 1)
+  {
+    st->tree_flags = TREE_LEAF;
+    return nnue_net != NULL ? nnue_output(nnue_net, &st->acc[ply], side) : evaluate_position(lodic, side);
+  }
+  // Вынужденный ход не тратит глубину
+  if (count == 1 && ply > 0 && depth > 0)
+    depth++;
+
+  // ProbCut: если мелкий поиск уверенно выходит за окно, глубокий почти
+  // наверняка выйдет тоже. Границы пересчитываются через модель: глубокая
+  // оценка ~ a * мелкая + b с ошибкой sigma. Во время взятий не применяется:
+  // там мелкий поиск плохо предсказывает результат
+  if (st->options->probcut && !pv_node && ply > 0 && depth >= PROBCUT_MIN_DEPTH && !captures &&
+      beta < SEARCH_MATE - MAX_PLY && alpha > -SEARCH_MATE + MAX_PLY)
+  {
+    const Probcut_Model *model = &probcut_model;
+    if (st->tree != NULL)
+      tree_dump_move(st->tree, st->frame_top, TREE_NO_SQUARE, TREE_NO_SQUARE, 0, TREE_MOVE_PROBCUT);
+    int high = (int)((beta + PROBCUT_THRESHOLD * model->sigma - model->b) / model->a + 0.999);
+    if (high < SEARCH_MATE - MAX_PLY &&
+        search_node(lodic, side, depth - PROBCUT_REDUCTION, high - 1, high, ply, false) >= high)
+    {
+      st->tree_flags = TREE_PROBCUT;
+      return beta;
+    }
+    int low = (int)((alpha - PROBCUT_THRESHOLD * model->sigma - model->b) / model->a - 0.999);
+    if (!st->stop && low > -SEARCH_MATE + MAX_PLY &&
+        search_node(lodic, side, depth - PROBCUT_REDUCTION, low, low + 1, ply, false) <= low)
+    {
+      st->tree_flags = TREE_PROBCUT;
+      return alpha;
+    }
+    if (st->stop)
+      return 0;
+  }
+
+  int *order = frame->order;
+  int *keys = frame->keys;
+  for (int i = 0; i < count; i++)
+  {
+    order[i] = i;
+    keys[i] = search_move_key(st, list, list->hods[i], ply, tt_move);
+  }
+  if (st->split != NULL && pv_node && st->options->pvs && depth >= SPLIT_MIN_DEPTH && ply < SPLIT_MAX_PLY)
+    return search_split(st, frame, list, lodic, side, depth, alpha, beta, ply);
+
+  char other = side == '1' ? '2' : '1';
+  int alpha_start = alpha;
+  int best_score = -SEARCH_INFINITY;
+  Search_Move best_move = {-1, -1, 0};
+  int searched = 0;
+  for (int n = 0; n < count; n++)
+  {
+    // Выбираем лучший из оставшихся: после отсечения остальные не сортируются
+    int pick = n;
+    for (int j = n + 1; j < count; j++)
+      if (keys[order[j]] > keys[order[pick]])
+        pick = j;
+    int index = order[pick];
+    order[pick] = order[n];
+    order[n] = index;
+
+    // Ходы, выбранные прошлыми линиями анализа, не рассматриваются
+    if (ply == 0 && st->root_excluded[index])
+      continue;
+    Hod h = list->hods[index];
+    if (st->tree != NULL)
+      tree_dump_move(st->tree, st->frame_top, HOD_FROM(h), HOD_TO(h), n, HOD_CAPTURE(h) != 0 ? TREE_MOVE_CAPTURE : 0);
+    char (*child)[8] = frame->child;
+    memcpy(child, lodic, sizeof(char) * 8 * 8);
+    apply_hod(child, list, h);
+    if (nnue_net != NULL)
+      nnue_update(nnue_net, &st->acc[ply + 1], &st->acc[ply], lodic, list, h);
+    st->hashes[ply + 1] = position_hash(child, other);
+    // Обратимы только тихие ходы дамок
+    char piece = lodic[SQ_Y(HOD_FROM(h))][SQ_X(HOD_FROM(h))];
+    st->clock[ply + 1] = HOD_CAPTURE(h) == 0 && (piece == '3' || piece == '4') ? st->clock[ply] + 1 : 0;
+
+    int reduction = 0;
+    if (st->options->lmr && depth >= 3 && searched >= (pv_node ? 4 : 2) && HOD_CAPTURE(h) == 0 &&
+        keys[index] < (1 << 28) && !HOD_PROMOTES(h))
+      reduction = depth >= 6 && n >= 8 ? 2 : 1;
+
+    int score;
+    if (searched++ == 0)
+      score = -search_node(child, other, depth - 1, -beta, -alpha, ply + 1, pv_node);
+    else if (st->options->pvs)
+    {
+      score = -search_node(child, other, depth - 1 - reduction, -alpha - 1, -alpha, ply + 1, false);
+      // Сокращенный поиск поднял альфу: проверяем ход на полной глубине
+      if (reduction > 0 && score > alpha)
+        score = -search_node(child, other, depth - 1, -alpha - 1, -alpha, ply + 1, false);
+      if (score > alpha && score < beta)
+        score = -search_node(child, other, depth - 1, -beta, -alpha, ply + 1, pv_node);
+    }
+    else
+    {
+      score = -search_node(child, other, depth - 1 - reduction, -beta, -alpha, ply + 1, pv_node);
+      if (reduction > 0 && score > alpha)
+        score = -search_node(child, other, depth - 1, -beta, -alpha, ply + 1, pv_node);
+    }
+    if (st->stop)
+      return 0;
+
+    if (score > best_score)
+    {
+      best_score = score;
+      best_move = search_move_of(list, h);
+      if (ply == 0)
+        st->root_best = index;
+      if (score > alpha)
+      {
+        alpha = score;
+        st->pv[ply][0] = best_move;
+        memcpy(&st->pv[ply][1], st->pv[ply + 1], sizeof(Search_Move) * st->pv_length[ply + 1]);
+        st->pv_length[ply] = st->pv_length[ply + 1] + 1;
+        if (alpha >= beta)
+        {
+          if (HOD_CAPTURE(h) == 0)
+            search_store_cutoff(st, list, h, depth, ply);
+          break;
+        }
+      }
+    }
+  }
+  // Корень не сохраняется: при поиске нескольких линий часть ходов исключена
+  if (ply > 0 && depth > 0)
+    tt_store(&search_tt, hash, tt_score_in(best_score, ply), depth,
+             best_score >= beta ? TT_BOUND_LOWER : (best_score > alpha_start ? TT_BOUND_EXACT : TT_BOUND_UPPER),
+             best_move);
+  st->tree_flags = 0;
+  return best_score;
+}
+
+// Узел поиска с записью в дерево. Узел занимает место в пределе узлов при
+// входе, поэтому в файле не больше max_nodes узлов
+static int tree_search_frame(Search_Thread *st, Search_Frame *frame, char lodic[8][8], char side, int depth,
+                             int alpha, int beta, int ply, bool pv_node){
+  Tree_Dump *tree = st->tree;
+  int level = st->frame_top - 1;
+  if (ply > tree->max_ply || (level > 0 && !tree->open[level - 1]))
+    return search_frame(st, frame, lodic, side, depth, alpha, beta, ply, pv_node);
+  if (tree->count >= tree->max_nodes)
+  {
+    tree->truncated = true;
+    return search_frame(st, frame, lodic, side, depth, alpha, beta, ply, pv_node);
+  }
+  tree->count++;
+  tree->open[level] = true;
+  uint64_t nodes = st->nodes;
+  int score = search_frame(st, frame, lodic, side, depth, alpha, beta, ply, pv_node);
+  tree->open[level] = false;
+  int flags = pv_node ? TREE_PV : 0;
+  if (st->stop)
+    flags |= TREE_STOPPED;
+  else
+  {
+    flags |= st->tree_flags;
+    if (score >= beta)
+      flags |= TREE_FAIL_HIGH;
+    else if (score <= alpha)
+      flags |= TREE_FAIL_LOW;
+  }
+  tree_dump_node(tree, level, ply, depth, flags, alpha, beta, score, st->nodes - nodes);
+  return score;
+}
+
+static int search_node(char lodic[8][8], char side, int depth, int alpha, int beta, int ply, bool pv_node){
+  Search_Thread *st = search_thread;
+  // Кадры кончаются только при вложенных ProbCut на длинном пути
+  if (st->frame_top == SEARCH_FRAMES)
+  {
+    st->pv_length[ply] = 0;
+    return evaluate_position(lodic, side);
+  }
+  Search_Frame *frame = &st->frames[st->frame_top++];
+  int score = st->tree == NULL ? search_frame(st, frame, lodic, side, depth, alpha, beta, ply, pv_node)
+                               : tree_search_frame(st, frame, lodic, side, depth, alpha, beta, ply, pv_node);
+  st->frame_top--;
+  return score;
+}
+
+static void split_tree_move(Search_Thread *st, const Split_Task *task, int flags){
+  Hod h = task->hod;
+  tree_dump_move(st->tree, st->frame_top, HOD_FROM(h), HOD_TO(h), task->order,
+                 flags | (HOD_CAPTURE(h) != 0 ? TREE_MOVE_CAPTURE : 0));
+}
+
+// Задача считается в том потоке, который ее взял: помощник сначала
+// копирует путь до узла, историю партии и ограничения потока поиска
+static void split_run_task(Split_Task *task){
+  Split_Point *sp = task->point;
+  Search_Thread *master = sp->master;
+  Search_Thread *st = search_thread_get();
+  if (st != master)
+  {
+    st->options = master->options;
+    st->deadline = master->deadline;
+    st->can_stop = master->can_stop;
+    st->stop = false;
+    st->nodes = 0;
+    st->split = NULL;
+    st->tree = NULL;
+    st->frame_top = 0;
+    st->prev_pv_length = master->prev_pv_length;
+    memcpy(st->prev_pv, master->prev_pv, sizeof(Search_Move) * master->prev_pv_length);
+    memcpy(st->hashes, master->hashes, sizeof(uint64_t) * sp->ply);
+    memcpy(st->clock, master->clock, sizeof(int) * sp->ply);
+    // Окно истории копируется в начало кольца
+    game_history.start = 0;
+    game_history.count = sp->history->count;
+    for (int i = 0; i < sp->history->count; i++)
+      game_history.hashes[i] = HISTORY_AT(sp->history, i);
+  }
+  uint64_t nodes = st->nodes;
+  Split_Context *saved = st->context;
+  Split_Point *saved_point = st->split_point;
+  st->split_point = sp;
+  if (task->context == NULL)
+    split_context_reset(split_scratch);
+  split_switch(st, task->context != NULL ? task->context : split_scratch);
+  st->hashes[sp->ply] = task->hash;
+  st->clock[sp->ply] = task->clock;
+  if (nnue_net != NULL)
+    nnue_refresh(nnue_net, &st->acc[sp->ply], task->child);
+  if (st->tree != NULL)
+    split_tree_move(st, task, TREE_MOVE_SPLIT);
+
+  int alpha = sp->alpha;
+  int score = -search_node(task->child, sp->side, sp->depth - task->reduction, -alpha - 1, -alpha, sp->ply, false);
+  if (!st->stop && task->reduction > 0 && score > alpha)
+    score = -search_node(task->child, sp->side, sp->depth, -alpha - 1, -alpha, sp->ply, false);
+  task->score = score;
+  task->stopped = st->stop;
+  if (st->stop)
+    __atomic_store_n(&sp->stop, true, __ATOMIC_RELAXED);
+
+  split_switch(st, saved);
+  st->split_point = saved_point;
+  if (st != master)
+    __atomic_add_fetch(&master->helper_nodes, st->nodes - nodes, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&sp->remaining, 1, __ATOMIC_RELEASE);
+}
+
+// Счет дочерней позиции в потоке поиска: в контексте ее задачи, а старшего
+// хода и задач без своего контекста - в контексте самого узла
+static int split_search_child(Search_Thread *st, Split_Point *sp, Split_Task *task, int alpha, int beta, bool pv_node){
+  Split_Context *saved = st->context;
+  if (task->context != NULL)
+    split_switch(st, task->context);
+  st->hashes[sp->ply] = task->hash;
+  st->clock[sp->ply] = task->clock;
+  if (nnue_net != NULL)
+    nnue_refresh(nnue_net, &st->acc[sp->ply], task->child);
+  if (st->tree != NULL)
+    split_tree_move(st, task, 0);
+  int score = -search_node(task->child, sp->side, sp->depth, -beta, -alpha, sp->ply, pv_node);
+  split_switch(st, saved);
+  return score;
+}
+
+// Раздает младших братьев задачами с нулевым окном по alpha
+static void split_dispatch(Split_State *state, Split_Point *sp, int alpha){
+  sp->alpha = alpha;
+  sp->remaining = sp->count - 1;
+  for (int i = 1; i < sp->count; i++)
+    split_push(&state->deque, &sp->tasks[i]);
+  pthread_mutex_lock(&split_mutex);
+  __atomic_add_fetch(&split_pending, sp->count - 1, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&split_cond);
+  pthread_mutex_unlock(&split_mutex);
+}
+
+// Поток поиска сам считает задачи, которые еще не украли, и ждет остальные
+static void split_wait(Split_State *state, Split_Point *sp){
+  Split_Task *task;
+  while ((task = split_take(&state->deque)) != NULL)
+  {
+    __atomic_sub_fetch(&split_pending, 1, __ATOMIC_RELAXED);
+    split_run_task(task);
+  }
+  while (__atomic_load_n(&sp->remaining, __ATOMIC_ACQUIRE) > 0)
+    sched_yield();
+}
+
+// Узел главного варианта, поделенный между потоками. Ходы упорядочиваются
+// теми же ключами, что и в search_frame; старший ход считается сразу,
+// остальные - задачами с нулевым окном по альфе после старшего хода.
+// Результаты разбираются по порядку ходов: ход, поднявший альфу,
+// пересчитывается как в PVS
+static int search_split(Search_Thread *st, Search_Frame *frame, const Hod_List *list, char lodic[8][8], char side,
+                        int depth, int alpha, int beta, int ply){
+  Split_State *state = st->split;
+  Split_Point *sp = &state->points[ply];
+  int *order = frame->order;
+  int *keys = frame->keys;
+  int count = list->count;
+  uint64_t hash = st->hashes[ply];
+  sp->master = st;
+  sp->history = &game_history;
+  sp->side = side == '1' ? '2' : '1';
+  sp->ply = ply + 1;
+  sp->depth = depth - 1;
+  sp->count = 0;
+  sp->stop = false;
+
+  int searched = 0;
+  for (int n = 0; n < count; n++)
+  {
+    int pick = n;
+    for (int j = n + 1; j < count; j++)
+      if (keys[order[j]] > keys[order[pick]])
+        pick = j;
+    int index = order[pick];
+    order[pick] = order[n];
+    order[n] = index;
+    if (ply == 0 && st->root_excluded[index])
+      continue;
+
+    Hod h = list->hods[index];
+    Split_Task *task = &sp->tasks[sp->count++];
+    task->point = sp;
+    task->index = index;
+    task->hod = h;
+    task->order = n;
+    memcpy(task->child, lodic, sizeof(char) * 8 * 8);
+    apply_hod(task->child, list, h);
+    task->hash = position_hash(task->child, sp->side);
+    char piece = lodic[SQ_Y(HOD_FROM(h))][SQ_X(HOD_FROM(h))];
+    task->clock = HOD_CAPTURE(h) == 0 && (piece == '3' || piece == '4') ? st->clock[ply] + 1 : 0;
+    // Старший ход считается в контексте самого узла, как в обычном поиске
+    task->context = sp->count > 1 ? split_context(state, st, hash, index) : NULL;
+    task->reduction = 0;
+    if (st->options->lmr && depth >= 3 && searched >= 4 && HOD_CAPTURE(h) == 0 && keys[index] < (1 << 28) &&
+        !HOD_PROMOTES(h))
+      task->reduction = depth >= 6 && n >= 8 ? 2 : 1;
+    searched++;
+  }
+
+  sp->parent_tt = search_tt;
+
+  int alpha_start = alpha;
+  int best_score = -SEARCH_INFINITY;
+  Search_Move best_move = {-1, -1, 0};
+  for (int k = 0; k < sp->count; k++)
+  {
+    Split_Task *task = &sp->tasks[k];
+    Hod h = list->hods[task->index];
+    int score;
+    if (k == 0)
+    {
+      score = split_search_child(st, sp, task, alpha, beta, true);
+      if (st->stop)
+        return 0;
+    }
+    else
+    {
+      // Младшие братья раздаются только после старшего: его оценка дает им
+      // узкое окно
+      if (k == 1)
+      {
+        split_dispatch(state, sp, alpha);
+        split_wait(state, sp);
+      }
+      if (task->stopped)
+      {
+        st->stop = true;
+        return 0;
+      }
+      score = task->score;
+      st->pv_length[ply + 1] = 0;
+      // Задача дала границу относительно альфы раздачи: сверху, если не
+      // превысила ее, иначе снизу. Если граница ничего не говорит о текущей
+      // альфе, ход проверяется нулевым окном по ней
+      bool lower = score > sp->alpha;
+      if (lower ? score <= alpha : score > alpha)
+        score = split_search_child(st, sp, task, alpha, alpha + 1, false);
+      if (!st->stop && score > alpha && score < beta)
+        score = split_search_child(st, sp, task, alpha, beta, true);
+      if (st->stop)
+        return 0;
+    }
+
+    if (score > best_score)
+    {
+      best_score = score;
+      best_move = search_move_of(list, h);
+      if (ply == 0)
+        st->root_best = task->index;
+      if (score > alpha)
+      {
+        alpha = score;
+        st->pv[ply][0] = best_move;
+        memcpy(&st->pv[ply][1], st->pv[ply + 1], sizeof(Search_Move) * st->pv_length[ply + 1]);
+        st->pv_length[ply] = st->pv_length[ply + 1] + 1;
+        if (alpha >= beta)
+        {
+          if (HOD_CAPTURE(h) == 0)
+            search_store_cutoff(st, list, h, depth, ply);
+          break;
+        }
+      }
+    }
+  }
+  if (ply > 0)
+    tt_store(&search_tt, hash, tt_score_in(best_score, ply), depth,
+             best_score >= beta ? TT_BOUND_LOWER : (best_score > alpha_start ? TT_BOUND_EXACT : TT_BOUND_UPPER),
+             best_move);
+  st->tree_flags = 0;
+  return best_score;
+}
+
+int search_multipv(char lodic[8][8], char side, const Search_Options *options, int lines, Search_Line *out,
+                   Search_Result *result){
+  Search_Thread *st = search_thread_get();
+  struct timespec start, finish;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  st->options = options;
+  st->nodes = 0;
+  st->stop = false;
+  st->can_stop = false;
+  st->deadline.tv_sec = start.tv_sec + options->time_ms / 1000;
+  st->deadline.tv_nsec = start.tv_nsec + (options->time_ms % 1000) * 1000000;
+  if (st->deadline.tv_nsec >= 1000000000)
+  {
+    st->deadline.tv_sec++;
+    st->deadline.tv_nsec -= 1000000000;
+  }
+
+  int count = generate_hods(lodic, side, &st->root_list);
+  if (count == 0)
+    return 0;
+  if (lines > count)
+    lines = count;
+  if (lines > MAX_MULTIPV)
+    lines = MAX_MULTIPV;
+  if (lines < 1)
+    lines = 1;
+  // Корневые ходы перемешиваются генератором партии: из равных по оценке
+  // ходов поиск оставляет первый, поэтому выбор между ними случаен, но
+  // воспроизводим по зерну
+  for (int i = count - 1; i > 0; i--)
+  {
+    int j = (int)(rng_next() % (uint64_t)(i + 1));
+    Hod tmp = st->root_list.hods[i];
+    st->root_list.hods[i] = st->root_list.hods[j];
+    st->root_list.hods[j] = tmp;
+  }
+  tt_new_search(&search_tt);
+  cache_buffer_get();
+  memset(st->killers, -1, sizeof(st->killers));
+  memset(st->history, 0, sizeof(st->history));
+  st->helper_nodes = 0;
+  st->split = options->threads > 1 ? split_begin(st, options->threads) : NULL;
+  st->tree = tree_dump_claim(st);
+  st->prev_pv_length = 0;
+  st->frame_top = 0;
+  st->hashes[0] = position_hash(lodic, side);
+  if (nnue_net != NULL)
+    nnue_refresh(nnue_net, &st->acc[0], lodic);
+  st->clock[0] = game_history.count > 0 ? game_history.count - 1 : 0;
+
+  for (int k = 0; k < lines; k++)
+  {
+    out[k].move = hod_info(&st->root_list, st->root_list.hods[k]);
+    out[k].score = 0;
+    out[k].pv_length = 0;
+  }
+  result->depth = 0;
+  for (int depth = 1; depth <= options->depth; depth++)
+  {
+    // Линии текущей глубины собираются отдельно: если время выйдет на
+    // середине, остаются линии прошлой глубины целиком
+    Search_Line *found = st->lines;
+    int k = 0;
+    memset(st->root_excluded, 0, sizeof(st->root_excluded));
+    for (; k < lines; k++)
+    {
+      if (st->tree != NULL)
+        tree_dump_search(st->tree, lodic, side, k, depth);
+      int score = search_node(lodic, side, depth, -SEARCH_INFINITY, SEARCH_INFINITY, 0, true);
+      if (st->stop)
+        break;
+      found[k].move = hod_info(&st->root_list, st->root_list.hods[st->root_best]);
+      found[k].score = score;
+      found[k].pv_length = st->pv_length[0];
+      memcpy(found[k].pv, st->pv[0], sizeof(Search_Move) * st->pv_length[0]);
+      st->root_excluded[st->root_best] = true;
+      if (k == 0)
+      {
+        st->prev_pv_length = st->pv_length[0];
+        memcpy(st->prev_pv, st->pv[0], sizeof(Search_Move) * st->pv_length[0]);
+      }
+    }
+    if (k < lines)
+      break;
+    // Поздняя линия может оказаться лучше ранней: к ней таблица уже
+    // заполнена глубже. Линии упорядочиваются по оценке
+    for (int i = 1; i < lines; i++)
+      for (int j = i; j > 0 && found[j].score > found[j - 1].score; j--)
+      {
+        Search_Line tmp = found[j];
+        found[j] = found[j - 1];
+        found[j - 1] = tmp;
+      }
+    memcpy(out, found, sizeof(Search_Line) * lines);
+    result->depth = depth;
+    st->can_stop = true;
+    // Единственный ход и найденный выигрыш или проигрыш углублять незачем
+    if (count == 1 || (lines == 1 && (found[0].score > SEARCH_MATE - MAX_PLY || found[0].score < -SEARCH_MATE + MAX_PLY)))
+      break;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  cache_buffer_flush(cache_buffer);
+  result->best = out[0].move;
+  result->score = out[0].score;
+  result->nodes = st->nodes + st->helper_nodes;
+  result->ms = (finish.tv_sec - start.tv_sec) * 1000 + (finish.tv_nsec - start.tv_nsec) / 1000000;
+  return lines;
+}
+
+bool search_position(char lodic[8][8], char side, const Search_Options *options, Search_Result *result){
+  Search_Line line;
+  return search_multipv(lodic, side, options, 1, &line, result) > 0;
+}
+
+void format_search_move(Search_Move m, char *out){
+  reverse_graph_out_koordinaty(SQ_X(m.from), SQ_Y(m.from), &out[0], &out[1]);
+  out[2] = m.captured != 0 ? ':' : '-';
+  reverse_graph_out_koordinaty(SQ_X(m.to), SQ_Y(m.to), &out[3], &out[4]);
+  out[5] = '\0';
+}
+
+bool parse_fen(const char *text, char lodic[8][8], char *side){
+  const char *tag = strstr(text, "FEN \"");
+  if (tag != NULL)
+    text = tag + 5;
+  while (*text == ' ' || *text == '"')
+    text++;
+  if (*text != 'W' && *text != 'B')
+    return false;
+  *side = *text == 'W' ? '2' : '1';
+  text++;
+
+  for (int y = 0; y < 8; y++)
+    for (int x = 0; x < 8; x++)
+      lodic[y][x] = (x + y) % 2 == 1 ? '0' : ' ';
+  // Разделы :W... и :B..., в каждом список полей через запятую; K - дамка,
+  // a-b - диапазон полей
+  while (*text == ':')
+  {
+    text++;
+    char color = *text++;
+    if (color != 'W' && color != 'B')
+      return false;
+    while (*text != '\0' && *text != ':' && *text != '"' && *text != ']' && *text != '.')
+    {
+      bool king = *text == 'K';
+      if (king)
+        text++;
+      char *end;
+      long first = strtol(text, &end, 10);
+      if (end == text)
+        return false;
+      long last = first;
+      text = end;
+      if (*text == '-')
+      {
+        last = strtol(text + 1, &end, 10);
+        if (end == text + 1)
+          return false;
+        text = end;
+      }
+      if (first < 1 || last > SQUARES || first > last)
+        return false;
+      for (long n = first; n <= last; n++)
+        lodic[SQ_Y(n - 1)][SQ_X(n - 1)] = color == 'W' ? (king ? '4' : '2') : (king ? '3' : '1');
+      if (*text == ',')
+        text++;
+    }
+  }
+  return true;
+}
+
+int analyze_position(const char *fen, int lines){
+  char position[8][8];
+  char side;
+  if (!parse_fen(fen, position, &side))
+  {
+    printf("Не удалось разобрать позицию: %s\n", fen);
+    return 1;
+  }
+  Search_Line found[MAX_MULTIPV];
+  Search_Result result;
+  game_history.count = 0;
+  rng_seed(0);
+  int count = search_multipv(position, side, &search_options, lines, found, &result);
+  char text[256];
+  format_position(position, true, text);
+  printf("%sХодят %s\n", text, side == '2' ? "белые" : "черные");
+  if (count == 0)
+  {
+    printf("Ходов нет\n");
+    return 0;
+  }
+  printf("Глубина %d, узлов %llu, %ld мс\n", result.depth, (unsigned long long)result.nodes, result.ms);
+  for (int k = 0; k < count; k++)
+  {
+    char move[8];
+    format_hod(&found[k].move, move);
+    printf("%2d. %s %+6d ", k + 1, move, found[k].score);
+    for (int i = 0; i < found[k].pv_length; i++)
+    {
+      format_search_move(found[k].pv[i], move);
+      printf(" %s", move);
+    }
+    printf("\n");
+  }
+  return 0;
+}
+
+enum { BENCH_POSITIONS = 12 };
+
+// Позиции получаются случайными ходами из начальной расстановки с
+// постоянным зерном, поэтому набор одинаков во всех запусках
+static int bench_positions(char positions[BENCH_POSITIONS][8][8], char sides[BENCH_POSITIONS]){
+  int total = 0;
+  for (int p = 0; p < BENCH_POSITIONS; p++)
+  {
+    char position[8][8];
+    char side = '2';
+    initial_position(position);
+    rng_seed(1000 + p);
+    for (int ply = 0; ply < 4 + 3 * p; ply++)
+    {
+      Hod_List list;
+      if (generate_hods(position, side, &list) == 0)
+        break;
+      apply_hod(position, &list, list.hods[rng_next() % list.count]);
+      side = side == '1' ? '2' : '1';
+    }
+    // Позиции с единственным ходом поиск не углубляет
+    Hod_List list;
+    if (generate_hods(position, side, &list) < 2)
+      continue;
+    memcpy(positions[total], position, sizeof(char) * 8 * 8);
+    sides[total++] = side;
+  }
+  return total;
+}
+
+void bench_search(long time_ms){
+  static char positions[BENCH_POSITIONS][8][8];
+  static char sides[BENCH_POSITIONS];
+  int total = bench_positions(positions, sides);
+
+  static const struct
+  {
+    const char *name;
+    bool pvs;
+    bool lmr;
+    bool probcut;
+  } modes[] = {{"alpha-beta", false, false, false},
+               {"pvs", true, false, false},
+               {"pvs+lmr", true, true, false},
+               {"+probcut", true, true, true}};
+  game_history.count = 0;
+  printf("Позиций: %d, время на позицию: %ld мс\n", total, time_ms);
+  for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+  {
+    Search_Options options = {MAX_PLY - 1, time_ms, modes[m].pvs, modes[m].lmr, modes[m].probcut, 0, 1, NULL};
+    int depth_sum = 0, depth_min = MAX_PLY, depth_max = 0;
+    uint64_t nodes = 0;
+    long ms = 0;
+    for (int p = 0; p < total; p++)
+    {
+      Search_Result result;
+      rng_seed(0);
+      search_position(positions[p], sides[p], &options, &result);
+      depth_sum += result.depth;
+      depth_min = result.depth < depth_min ? result.depth : depth_min;
+      depth_max = result.depth > depth_max ? result.depth : depth_max;
+      nodes += result.nodes;
+      ms += result.ms;
+    }
+    printf("%-10s глубина %5.2f (от %d до %d), узлов %12llu, %.0f тыс. узлов/с\n", modes[m].name,
+           (double)depth_sum / total, depth_min, depth_max, (unsigned long long)nodes,
+           ms > 0 ? nodes / (double)ms : 0.0);
+  }
+}
+
+void bench_threads(int depth){
+  static char positions[BENCH_POSITIONS][8][8];
+  static char sides[BENCH_POSITIONS];
+  static const int counts[] = {1, 2, 4, 8, 16, 32};
+  int total = bench_positions(positions, sides);
+  // Эталон воспроизводимости - результат двух потоков: с разделением
+  // поиск должен давать те же ходы, оценки и узлы при любом их количестве
+  char moves[BENCH_POSITIONS][8];
+  int scores[BENCH_POSITIONS];
+  uint64_t reference_nodes = 0;
+  long serial_ms = 0;
+  game_history.count = 0;
+  printf("Позиций: %d, глубина %d, процессоров %ld\n", total, depth, sysconf(_SC_NPROCESSORS_ONLN));
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+  {
+    Search_Options options = search_options;
+    options.depth = depth;
+    options.time_ms = 0;
+    options.max_nodes = 0;
+    options.threads = counts[c];
+    uint64_t nodes = 0;
+    long ms = 0;
+    bool same = true;
+    for (int p = 0; p < total; p++)
+    {
+      Search_Result result;
+      char move[8];
+      rng_seed(0);
+      search_position(positions[p], sides[p], &options, &result);
+      format_hod(&result.best, move);
+      if (counts[c] == 2)
+      {
+        strcpy(moves[p], move);
+        scores[p] = result.score;
+      }
+      else if (strcmp(moves[p], move) != 0 || scores[p] != result.score)
+        same = false;
+      nodes += result.nodes;
+      ms += result.ms;
+    }
+    if (counts[c] == 1)
+      serial_ms = ms;
+    else if (counts[c] == 2)
+      reference_nodes = nodes;
+    else if (nodes != reference_nodes)
+      same = false;
+    printf("%2d потоков: %8ld мс, узлов %12llu, ускорение %5.2f%s\n", counts[c], ms, (unsigned long long)nodes,
+           ms > 0 ? (double)serial_ms / ms : 0.0,
+           counts[c] <= 2 ? "" : same ? ", результат как у 2 потоков" : ", результат отличается от 2 потоков");
+  }
+}
+
+// Самоигра: партии считаются независимо в потоках, у каждого потока своя
+// доска, история позиций и генератор случайных чисел. Те же партии служат
+// источником позиций для подбора модели ProbCut.
+
+typedef struct
+{
+  const Search_Options *options[2];   // Настройки первого и второго игрока
+  uint64_t seed;                      // Зерно начал партий
+  int games;
+  int next_game;                      // Следующая партия, берется атомарно
+  bool calibrate;                     // Собирать пары оценок для ProbCut
+  pthread_mutex_t mutex;
+  int wins[2];                        // Победы первого и второго игрока
+  int draws;
+  long depth_sum[2];                  // Сумма глубин ходов каждого игрока
+  long moves[2];
+  double sx, sy, sxx, sxy, syy;       // Суммы для регрессии ProbCut
+  long samples;
+  char **pdn;                         // Запись каждой партии в PDN или NULL
+} Selfplay;
+
+static void format_pdn_move(const Hod_Info *h, bool algebraic, char *out);
+
+// Дописывает ход в запись партии: номер хода перед ходом белых, по восемь
+// ходов в строке
+static void selfplay_record(FILE *out, int *ply_number, const Hod_Info *h){
+  if (out == NULL)
+    return;
+  char move[PDN_MOVE_SIZE];
+  format_pdn_move(h, false, move);
+  if (*ply_number % 2 == 0)
+    fprintf(out, "%s%d. ", *ply_number == 0 ? "" : (*ply_number % 16 == 0 ? "\n" : " "), *ply_number / 2 + 1);
+  else
+    fputc(' ', out);
+  fputs(move, out);
+  ++*ply_number;
+}
+
+static void *selfplay_thread(void *arg){
+  Selfplay *sp = arg;
+  int game;
+  while ((game = __atomic_fetch_add(&sp->next_game, 1, __ATOMIC_RELAXED)) < sp->games)
+  {
+    // Начало game / 2 играется дважды: первый игрок белыми, затем черными
+    int white = game & 1;
+    long depth_sum[2] = {0, 0}, moves[2] = {0, 0};
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+    long samples = 0;
+
+    // Ходы партии для PDN
+    char *movetext = NULL;
+    size_t movetext_length = 0;
+    FILE *moves_out = sp->pdn != NULL ? open_memstream(&movetext, &movetext_length) : NULL;
+    int ply_number = 0;
+
+    initial_position(lodic);
+    player_is_white = true; // '2' - белые, ходят первыми
+    is_player_turn = true;
+    count_pieces(lodic, &game_state);
+    history_reset(&game_history, position_hash(lodic, '2'));
+    rng_seed(sp->seed + game / 2);
+    for (int ply = 0; ply < SELFPLAY_RANDOM_PLIES && game_result() == 0; ply++)
+    {
+      Hod_List list;
+      generate_hods(lodic, is_player_turn ? '2' : '1', &list);
+      Hod_Info h = hod_info(&list, list.hods[rng_next() % list.count]);
+      selfplay_record(moves_out, &ply_number, &h);
+      make_hod(&h);
+      is_player_turn = !is_player_turn;
+    }
+
+    int result;
+    while ((result = game_result()) == 0)
+    {
+      char side = is_player_turn ? '2' : '1';
+      int player = is_player_turn ? white : 1 - white;
+      Search_Result deep;
+      if (sp->calibrate)
+      {
+        // Пара оценок одной позиции: мелкий поиск и на PROBCUT_REDUCTION глубже
+        Search_Options options = *sp->options[player];
+        options.probcut = false;
+        options.time_ms = 0;
+        options.max_nodes = 0;
+        options.depth = PROBCUT_MIN_DEPTH + 1 - PROBCUT_REDUCTION;
+        Search_Result shallow;
+        Hod_List list;
+        generate_hods(lodic, side, &list);
+        search_position(lodic, side, &options, &shallow);
+        options.depth = PROBCUT_MIN_DEPTH + 1;
+        search_position(lodic, side, &options, &deep);
+        if (HOD_CAPTURE(list.hods[0]) == 0 && deep.score < SEARCH_MATE - MAX_PLY && deep.score > -SEARCH_MATE + MAX_PLY &&
+            shallow.score < SEARCH_MATE - MAX_PLY && shallow.score > -SEARCH_MATE + MAX_PLY)
+        {
+          sx += shallow.score;
+          sy += deep.score;
+          sxx += (double)shallow.score * shallow.score;
+          sxy += (double)shallow.score * deep.score;
+          syy += (double)deep.score * deep.score;
+          samples++;
+        }
+      }
+      else
+        search_position(lodic, side, sp->options[player], &deep);
+      depth_sum[player] += deep.depth;
+      moves[player]++;
+      selfplay_record(moves_out, &ply_number, &deep.best);
+      make_hod(&deep.best);
+      is_player_turn = !is_player_turn;
+    }
+
+    // Результат PDN записан со стороны белых
+    if (moves_out != NULL)
+    {
+      const char *outcome = result == 1 ? "1-0" : (result == 2 ? "0-1" : "1/2-1/2");
+      fclose(moves_out);
+      if (asprintf(&sp->pdn[game],
+                   "[Event \"Selfplay\"]\n[Round \"%d\"]\n[White \"%s\"]\n[Black \"%s\"]\n[Result \"%s\"]\n%s %s\n\n",
+                   game + 1, search_mode_name(sp->options[white]), search_mode_name(sp->options[1 - white]), outcome,
+                   movetext, outcome) < 0)
+        sp->pdn[game] = NULL;
+      free(movetext);
+    }
+
+    pthread_mutex_lock(&sp->mutex);
+    if (result == 3)
+      sp->draws++;
+    else
+      sp->wins[result == 1 ? white : 1 - white]++;
+    for (int player = 0; player < 2; player++)
+    {
+      sp->depth_sum[player] += depth_sum[player];
+      sp->moves[player] += moves[player];
+    }
+    sp->sx += sx;
+    sp->sy += sy;
+    sp->sxx += sxx;
+    sp->sxy += sxy;
+    sp->syy += syy;
+    sp->samples += samples;
+    pthread_mutex_unlock(&sp->mutex);
+  }
+  return NULL;
+}
+
+static void selfplay_run(Selfplay *sp, int threads){
+  if (threads <= 0)
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads > sp->games)
+    threads = sp->games;
+  if (threads < 1)
+    threads = 1;
+  pthread_t *ids = malloc(sizeof(pthread_t) * threads);
+  int started = 0;
+  for (; started < threads; started++)
+    if (pthread_create(&ids[started], NULL, selfplay_thread, sp) != 0)
+      break;
+  // Если потоки не создались, партии считает текущий поток
+  if (started == 0)
+    selfplay_thread(sp);
+  for (int i = 0; i < started; i++)
+    pthread_join(ids[i], NULL);
+  free(ids);
+}
+
+void run_selfplay(int games, const Search_Options *first, const Search_Options *second, int threads, uint64_t seed,
+                  const char *pdn_path){
+  Selfplay sp;
+  memset(&sp, 0, sizeof(sp));
+  sp.options[0] = first;
+  sp.options[1] = second;
+  sp.seed = seed;
+  sp.games = (games + 1) & ~1;
+  if (pdn_path != NULL)
+    sp.pdn = calloc(sp.games, sizeof(char *));
+  pthread_mutex_init(&sp.mutex, NULL);
+  struct timespec start, finish;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  selfplay_run(&sp, threads);
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  pthread_mutex_destroy(&sp.mutex);
+
+  // Партии пишутся по номерам, а не по порядку окончания в потоках
+  if (sp.pdn != NULL)
+  {
+    FILE *out = fopen(pdn_path, "w");
+    if (out == NULL)
+      fprintf(stderr, "Не удалось создать %s: %s\n", pdn_path, strerror(errno));
+    for (int game = 0; game < sp.games; game++)
+    {
+      if (out != NULL && sp.pdn[game] != NULL)
+        fputs(sp.pdn[game], out);
+      free(sp.pdn[game]);
+    }
+    if (out != NULL)
+      fclose(out);
+    free(sp.pdn);
+  }
+
+  if (first->time_ms > 0)
+    printf("Партий: %d, время на ход: %ld мс, зерно %llu\n", sp.games, first->time_ms, (unsigned long long)seed);
+  else
+    printf("Партий: %d, глубина: %d, зерно %llu\n", sp.games, first->depth, (unsigned long long)seed);
+  for (int player = 0; player < 2; player++)
+    printf("%-16s побед %3d, ничьих %3d, поражений %3d, очков %5.1f%%, средняя глубина %5.2f\n",
+           search_mode_name(sp.options[player]), sp.wins[player], sp.draws, sp.wins[1 - player],
+           100.0 * (sp.wins[player] + 0.5 * sp.draws) / sp.games,
+           sp.moves[player] > 0 ? (double)sp.depth_sum[player] / sp.moves[player] : 0.0);
+  printf("Время: %.1f с\n", (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+void calibrate_probcut(int games, int threads, uint64_t seed){
+  Selfplay sp;
+  memset(&sp, 0, sizeof(sp));
+  sp.options[0] = &search_options;
+  sp.options[1] = &search_options;
+  sp.seed = seed;
+  sp.games = games;
+  sp.calibrate = true;
+  pthread_mutex_init(&sp.mutex, NULL);
+  selfplay_run(&sp, threads);
+  pthread_mutex_destroy(&sp.mutex);
+
+  double n = (double)sp.samples;
+  double spread = n * sp.sxx - sp.sx * sp.sx;
+  if (sp.samples < 2 || spread <= 0)
+  {
+    printf("Недостаточно позиций для подбора модели ProbCut: %ld\n", sp.samples);
+    return;
+  }
+  // Линейная регрессия глубокой оценки по мелкой и разброс остатков
+  double a = (n * sp.sxy - sp.sx * sp.sy) / spread;
+  double b = (sp.sy - a * sp.sx) / n;
+  double sse = sp.syy + a * a * sp.sxx + n * b * b - 2 * a * sp.sxy - 2 * b * sp.sy + 2 * a * b * sp.sx;
+  probcut_model.a = a;
+  probcut_model.b = b;
+  probcut_model.sigma = sqrt(sse > 0 ? sse / n : 0);
+  printf("Позиций: %ld, глубины %d и %d\n", sp.samples, PROBCUT_MIN_DEPTH + 1 - PROBCUT_REDUCTION,
+         PROBCUT_MIN_DEPTH + 1);
+  printf("--probcut-model %.3f,%.1f,%.1f\n", probcut_model.a, probcut_model.b, probcut_model.sigma);
+}
+
+// Генератор позиций для обучения (--datagen). Каталог набора - шарды
+// shard-NNN.bin, по одному на поток, и текстовый индекс. Шард - заголовок и
+// записи Data_Record подряд; в него только дописывают, поэтому потоки не
+// делят ни файлов, ни буферов. Индекс хранит, сколько записей каждого шарда
+// уже лежит на диске: он пишется после fdatasync шардов во временный файл и
+// заменяет прежний, так что после сбоя читатель видит целые записи, а
+// следующий запуск обрезает недописанный хвост. Повторы ищутся в общей
+// таблице хэшей без блокировок: корзина - 8 ключей в одной строке кэша,
+// в полной корзине ключ вытесняет случайный, и редкий повтор проходит.
+
+#define DATA_MAGIC 0x3130415441444843ull // "CHDATA01"
+#define DATA_INDEX_MAGIC "CHDATA01"
+#define DATAGEN_BUFFER 65536             // Записей в буфере потока, 1 МБ
+#define DATAGEN_BUCKET 8                 // Ключей в корзине таблицы повторов
+#define DATA_READ_BUFFER 65536           // Записей в буфере чтения
+
+_Static_assert(sizeof(Data_Record) == 16, "Data_Record должна занимать 16 байт");
+
+typedef struct
+{
+  uint64_t magic;
+  uint32_t variant;
+  uint32_t record_size;
+} Data_Shard_Header;
+
+typedef struct
+{
+  int fd;
+  uint64_t records;                 // Записей на диске после заголовка
+  uint64_t games;
+} Datagen_Shard;
+
+typedef struct
+{
+  const char *dir;
+  uint64_t target;                  // Новых позиций за запуск
+  uint64_t seed;
+  Search_Options options;
+  uint64_t *dedup;                  // Хэши записанных позиций
+  size_t dedup_buckets;             // Корзин, степень двойки
+  Datagen_Shard *shards;
+  int shard_count;                  // Шардов в индексе, включая чужие
+  int next_shard;                   // Шард следующего потока, берется атомарно
+  uint64_t next_game;               // Номер следующей партии, берется атомарно
+  uint64_t written;                 // Новых позиций, атомарно
+  uint64_t duplicates;              // Отброшенных повторов, атомарно
+  uint64_t games;                   // Законченных партий, атомарно
+  pthread_mutex_t index_lock;       // Запись индекса и счетчики шардов
+  struct timespec index_time;       // Когда индекс записан в последний раз
+  bool failed;                      // Запись не удалась, потоки заканчивают
+} Datagen;
+
+static void data_record_pack(const uint32_t masks[4], char side, Data_Record *rec){
+  uint32_t own = masks[2] | masks[3], kings = masks[1] | masks[3];
+  uint32_t occupied = masks[0] | masks[1] | own;
+  uint32_t owner_bits = 0, king_bits = 0;
+  int n = 0;
+  for (uint32_t rest = occupied; rest != 0; rest &= rest - 1, n++)
+  {
+    uint32_t bit = rest & -rest;
+    owner_bits |= (uint32_t)((own & bit) != 0) << n;
+    king_bits |= (uint32_t)((kings & bit) != 0) << n;
+  }
+  memset(rec, 0, sizeof(*rec));
+  rec->occupied = occupied;
+  for (int i = 0; i < 3; i++)
+  {
+    rec->owner[i] = (uint8_t)(owner_bits >> (8 * i));
+    rec->kings[i] = (uint8_t)(king_bits >> (8 * i));
+  }
+  rec->flags = side == '2';
+}
+
+void data_record_unpack(const Data_Record *rec, uint32_t masks[4]){
+  uint32_t owner_bits = rec->owner[0] | (uint32_t)rec->owner[1] << 8 | (uint32_t)rec->owner[2] << 16;
+  uint32_t king_bits = rec->kings[0] | (uint32_t)rec->kings[1] << 8 | (uint32_t)rec->kings[2] << 16;
+  memset(masks, 0, sizeof(uint32_t) * 4);
+  int n = 0;
+  for (uint32_t rest = rec->occupied; rest != 0 && n < 24; rest &= rest - 1, n++)
+    masks[((owner_bits >> n) & 1) * 2 + ((king_bits >> n) & 1)] |= rest & -rest;
+}
+
+static uint64_t data_record_hash(const Data_Record *rec){
+  uint32_t masks[4];
+  char position[8][8];
+  data_record_unpack(rec, masks);
+  unpack_position(masks, position);
+  return position_hash(position, rec->flags & 1 ? '2' : '1');
+}
+
+// true, если позиции еще не было; ключ 0 означает пустую клетку
+static bool datagen_insert(Datagen *dg, uint64_t hash){
+  uint64_t key = hash != 0 ? hash : 1;
+  uint64_t *bucket = dg->dedup + (key & (dg->dedup_buckets - 1)) * DATAGEN_BUCKET;
+  for (int i = 0; i < DATAGEN_BUCKET; i++)
+  {
+    uint64_t seen = __atomic_load_n(&bucket[i], __ATOMIC_RELAXED);
+    if (seen == key)
+      return false;
+    if (seen == 0)
+    {
+      if (__atomic_compare_exchange_n(&bucket[i], &seen, key, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return true;
+      if (seen == key)
+        return false;
+    }
+  }
+  __atomic_store_n(&bucket[(key >> 58) & (DATAGEN_BUCKET - 1)], key, __ATOMIC_RELAXED);
+  return true;
+}
+
+static char *data_path(const char *dir, const char *name){
+  char *path = NULL;
+  if (asprintf(&path, "%s/%s", dir, name) < 0)
+    return NULL;
+  return path;
+}
+
+// Читает индекс: правила и количество записей и партий по шардам. Нет
+// индекса - пустой набор, если так можно
+static bool data_read_index(const char *dir, bool missing_ok, int *variant, int *count, uint64_t **records,
+                            uint64_t **games){
+  *variant = rules_variant;
+  *count = 0;
+  *records = NULL;
+  *games = NULL;
+  char *path = data_path(dir, "index");
+  if (path == NULL)
+    return false;
+  FILE *in = fopen(path, "r");
+  if (in == NULL && (errno != ENOENT || !missing_ok))
+    fprintf(stderr, "Не удалось открыть %s: %s\n", path, strerror(errno));
+  free(path);
+  if (in == NULL)
+    return missing_ok && errno == ENOENT;
+  char line[256], name[32];
+  bool ok = fgets(line, sizeof(line), in) != NULL && strncmp(line, DATA_INDEX_MAGIC, strlen(DATA_INDEX_MAGIC)) == 0;
+  while (ok && fgets(line, sizeof(line), in) != NULL)
+  {
+    int shard;
+    unsigned long long n, g;
+    if (sscanf(line, "variant %31s", name) == 1)
+    {
+      *variant = strcmp(name, "russian") == 0 ? RULES_RUSSIAN : (strcmp(name, "pool") == 0 ? RULES_POOL : RULES_AMERICAN);
+      continue;
+    }
+    if (sscanf(line, "shard %d %llu %llu", &shard, &n, &g) != 3 || shard != *count)
+    {
+      ok = false;
+      break;
+    }
+    uint64_t *r = realloc(*records, sizeof(uint64_t) * (*count + 1));
+    uint64_t *gm = realloc(*games, sizeof(uint64_t) * (*count + 1));
+    if (r != NULL)
+      *records = r;
+    if (gm != NULL)
+      *games = gm;
+    if (r == NULL || gm == NULL)
+    {
+      ok = false;
+      break;
+    }
+    (*records)[*count] = n;
+    (*games)[*count] = g;
+    ++*count;
+  }
+  fclose(in);
+  if (!ok)
+  {
+    fprintf(stderr, "Испорчен индекс набора %s\n", dir);
+    free(*records);
+    free(*games);
+    *records = NULL;
+    *games = NULL;
+    *count = 0;
+  }
+  return ok;
+}
+
+// Сбрасывает шарды на диск и заменяет индекс. Записи, дописанные после
+// снимка счетчиков, в индекс не попадают до следующего раза
+static bool datagen_write_index(Datagen *dg){
+  uint64_t records[dg->shard_count], games[dg->shard_count];
+  for (int i = 0; i < dg->shard_count; i++)
+  {
+    records[i] = dg->shards[i].records;
+    games[i] = dg->shards[i].games;
+  }
+  for (int i = 0; i < dg->shard_count; i++)
+    if (dg->shards[i].fd >= 0 && fdatasync(dg->shards[i].fd) != 0)
+      return false;
+  char *path = data_path(dg->dir, "index");
+  char *tmp = data_path(dg->dir, "index.tmp");
+  bool ok = path != NULL && tmp != NULL;
+  FILE *out = ok ? fopen(tmp, "w") : NULL;
+  ok = out != NULL;
+  if (ok)
+  {
+    fprintf(out, "%s\nvariant %s\n", DATA_INDEX_MAGIC,
+            rules_variant == RULES_RUSSIAN ? "russian" : (rules_variant == RULES_POOL ? "pool" : "american"));
+    for (int i = 0; i < dg->shard_count; i++)
+      fprintf(out, "shard %d %llu %llu\n", i, (unsigned long long)records[i], (unsigned long long)games[i]);
+    ok = fflush(out) == 0 && fsync(fileno(out)) == 0;
+    ok = fclose(out) == 0 && ok;
+    ok = ok && rename(tmp, path) == 0;
+  }
+  if (!ok)
+    fprintf(stderr, "Не удалось записать индекс набора %s: %s\n", dg->dir, strerror(errno));
+  free(path);
+  free(tmp);
+  return ok;
+}
+
+// Дописывает буфер в шард; индекс обновляется не чаще DATAGEN_INDEX_SECONDS
+static void datagen_flush(Datagen *dg, Datagen_Shard *shard, const Data_Record *buffer, size_t count, uint64_t games){
+  const char *p = (const char *)buffer;
+  size_t left = count * sizeof(Data_Record);
+  while (left > 0)
+  {
+    ssize_t n = write(shard->fd, p, left);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+    {
+      fprintf(stderr, "Не удалось дописать шард набора %s: %s\n", dg->dir, strerror(errno));
+      __atomic_store_n(&dg->failed, true, __ATOMIC_RELAXED);
+      return;
+    }
+    p += n;
+    left -= (size_t)n;
+  }
+  pthread_mutex_lock(&dg->index_lock);
+  shard->records += count;
+  shard->games += games;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (now.tv_sec - dg->index_time.tv_sec >= DATAGEN_INDEX_SECONDS)
+  {
+    dg->index_time = now;
+    if (!datagen_write_index(dg))
+      __atomic_store_n(&dg->failed, true, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&dg->index_lock);
+}
+
+static void *datagen_thread(void *arg){
+  Datagen *dg = arg;
+  Datagen_Shard *shard = &dg->shards[__atomic_fetch_add(&dg->next_shard, 1, __ATOMIC_RELAXED)];
+  Data_Record *buffer = malloc(sizeof(Data_Record) * DATAGEN_BUFFER);
+  Data_Record *game_records = NULL;
+  size_t game_capacity = 0, buffered = 0;
+  uint64_t buffered_games = 0;
+  if (buffer == NULL)
+    return NULL;
+
+  while (!__atomic_load_n(&dg->failed, __ATOMIC_RELAXED) &&
+         __atomic_load_n(&dg->written, __ATOMIC_RELAXED) < dg->target)
+  {
+    uint64_t game = __atomic_fetch_add(&dg->next_game, 1, __ATOMIC_RELAXED);
+    initial_position(lodic);
+    player_is_white = true; // '2' - белые, ходят первыми
+    is_player_turn = true;
+    count_pieces(lodic, &game_state);
+    history_reset(&game_history, position_hash(lodic, '2'));
+    rng_seed(dg->seed + game);
+    for (int ply = 0; ply < DATAGEN_RANDOM_PLIES && game_result() == 0; ply++)
+    {
+      Hod_List list;
+      generate_hods(lodic, is_player_turn ? '2' : '1', &list);
+      Hod_Info h = hod_info(&list, list.hods[rng_next() % list.count]);
+      make_hod(&h);
+      is_player_turn = !is_player_turn;
+    }
+
+    // Позиции партии копятся до результата; повторы отбрасываются сразу
+    size_t count = 0;
+    int result;
+    for (int ply = DATAGEN_RANDOM_PLIES; (result = game_result()) == 0; ply++)
+    {
+      char side = is_player_turn ? '2' : '1';
+      Hod_List list;
+      generate_hods(lodic, side, &list);
+      Search_Result found;
+      search_position(lodic, side, &dg->options, &found);
+      if (HOD_CAPTURE(list.hods[0]) == 0)
+      {
+        if (!datagen_insert(dg, position_hash(lodic, side)))
+          __atomic_fetch_add(&dg->duplicates, 1, __ATOMIC_RELAXED);
+        else
+        {
+          if (count == game_capacity)
+          {
+            size_t capacity = game_capacity > 0 ? game_capacity * 2 : 256;
+            Data_Record *grown = realloc(game_records, capacity * sizeof(Data_Record));
+            if (grown == NULL)
+              break;
+            game_records = grown;
+            game_capacity = capacity;
+          }
+          uint32_t masks[4];
+          pack_position(lodic, masks);
+          Data_Record *rec = &game_records[count++];
+          data_record_pack(masks, side, rec);
+          rec->score = (int16_t)found.score;
+          rec->depth = (uint8_t)found.depth;
+          rec->ply = (uint16_t)(ply < UINT16_MAX ? ply : UINT16_MAX);
+        }
+      }
+      make_hod(&found.best);
+      is_player_turn = !is_player_turn;
+    }
+    if (result == 0)
+      continue;
+
+    // Результат для стороны на ходу: 1 - белые ('2'), 2 - черные ('1')
+    for (size_t i = 0; i < count; i++)
+    {
+      bool white_to_move = game_records[i].flags & 1;
+      int outcome = result == 3 ? 1 : ((result == 1) == white_to_move ? 2 : 0);
+      game_records[i].flags |= (uint8_t)(outcome << 1);
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+      buffer[buffered++] = game_records[i];
+      if (buffered == DATAGEN_BUFFER)
+      {
+        datagen_flush(dg, shard, buffer, buffered, buffered_games);
+        buffered = 0;
+        buffered_games = 0;
+      }
+    }
+    buffered_games++;
+    __atomic_fetch_add(&dg->written, count, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dg->games, 1, __ATOMIC_RELAXED);
+  }
+  if (buffered > 0 || buffered_games > 0)
+    datagen_flush(dg, shard, buffer, buffered, buffered_games);
+  free(buffer);
+  free(game_records);
+  return NULL;
+}
+
+// Открывает шард для дописывания: новый получает заголовок, у старого
+// отрезается хвост, не учтенный индексом
+static int datagen_open_shard(const char *dir, int index, uint64_t records){
+  char name[32];
+  snprintf(name, sizeof(name), "shard-%03d.bin", index);
+  char *path = data_path(dir, name);
+  if (path == NULL)
+    return -1;
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  Data_Shard_Header header = {DATA_MAGIC, (uint32_t)rules_variant, sizeof(Data_Record)};
+  bool ok = fd >= 0;
+  if (ok && records == 0)
+    ok = ftruncate(fd, 0) == 0 && write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header);
+  else if (ok)
+  {
+    Data_Shard_Header found;
+    ok = pread(fd, &found, sizeof(found), 0) == (ssize_t)sizeof(found) && memcmp(&found, &header, sizeof(header)) == 0 &&
+         ftruncate(fd, (off_t)(sizeof(header) + records * sizeof(Data_Record))) == 0;
+  }
+  ok = ok && lseek(fd, 0, SEEK_END) >= 0;
+  if (!ok)
+  {
+    fprintf(stderr, "Не удалось открыть шард %s: %s\n", path, errno != 0 ? strerror(errno) : "чужой заголовок");
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+  }
+  free(path);
+  return fd;
+}
+
+int run_datagen(const char *dir, uint64_t positions, int threads, uint64_t seed, int dedup_mb){
+  if (threads <= 0)
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 1)
+    threads = 1;
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+  {
+    fprintf(stderr, "Не удалось создать каталог %s: %s\n", dir, strerror(errno));
+    return 1;
+  }
+  int variant, indexed;
+  uint64_t *records, *games;
+  if (!data_read_index(dir, true, &variant, &indexed, &records, &games))
+    return 1;
+  if (indexed > 0 && variant != rules_variant)
+  {
+    fprintf(stderr, "Набор %s записан по другим правилам\n", dir);
+    free(records);
+    free(games);
+    return 1;
+  }
+
+  Datagen dg;
+  memset(&dg, 0, sizeof(dg));
+  dg.dir = dir;
+  dg.target = positions;
+  dg.seed = seed;
+  dg.options = search_options;
+  dg.options.threads = 1;
+  dg.shard_count = indexed > threads ? indexed : threads;
+  dg.shards = calloc(dg.shard_count, sizeof(Datagen_Shard));
+  size_t buckets = 1;
+  while (buckets * 2 * DATAGEN_BUCKET * sizeof(uint64_t) <= (size_t)dedup_mb << 20)
+    buckets *= 2;
+  dg.dedup_buckets = buckets;
+  dg.dedup = calloc(buckets * DATAGEN_BUCKET, sizeof(uint64_t));
+  pthread_mutex_init(&dg.index_lock, NULL);
+  int status = dg.shards == NULL || dg.dedup == NULL ? 1 : 0;
+  if (status != 0)
+    fprintf(stderr, "Не хватает памяти для таблицы повторов %d МБ\n", dedup_mb);
+
+  // Позиции, записанные прежними запусками, тоже считаются повторами
+  uint64_t known = 0;
+  Data_Reader reader;
+  if (status == 0 && indexed > 0 && data_reader_open(&reader, dir))
+  {
+    Data_Record rec;
+    while (data_reader_next(&reader, &rec))
+    {
+      datagen_insert(&dg, data_record_hash(&rec));
+      known++;
+    }
+    status = reader.failed ? 1 : 0;
+    data_reader_close(&reader);
+  }
+  for (int i = 0; i < dg.shard_count; i++)
+  {
+    dg.shards[i].records = i < indexed ? records[i] : 0;
+    dg.shards[i].games = i < indexed ? games[i] : 0;
+    dg.next_game += dg.shards[i].games; // Продолжение не повторяет сыгранные начала
+    dg.shards[i].fd = -1;
+    // Открываются и шарды сверх числа потоков: у них тоже обрезается хвост
+    if (status == 0 && (dg.shards[i].fd = datagen_open_shard(dir, i, dg.shards[i].records)) < 0)
+      status = 1;
+  }
+  free(records);
+  free(games);
+
+  struct timespec start, finish;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  dg.index_time = start;
+  if (status == 0)
+  {
+    pthread_t ids[threads];
+    int started = 0;
+    for (; started < threads; started++)
+      if (pthread_create(&ids[started], NULL, datagen_thread, &dg) != 0)
+        break;
+    // Если потоки не создались, партии играет текущий поток
+    if (started == 0)
+      datagen_thread(&dg);
+    for (int i = 0; i < started; i++)
+      pthread_join(ids[i], NULL);
+    pthread_mutex_lock(&dg.index_lock);
+    if (!datagen_write_index(&dg) || dg.failed)
+      status = 1;
+    pthread_mutex_unlock(&dg.index_lock);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  for (int i = 0; i < dg.shard_count; i++)
+    if (dg.shards[i].fd >= 0)
+      close(dg.shards[i].fd);
+
+  if (status == 0)
+  {
+    double seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+    uint64_t total = 0;
+    for (int i = 0; i < dg.shard_count; i++)
+      total += dg.shards[i].records;
+    printf("Партий: %llu, новых позиций: %llu, повторов отброшено: %llu, в наборе до запуска: %llu, всего: %llu\n",
+           (unsigned long long)dg.games, (unsigned long long)dg.written, (unsigned long long)dg.duplicates,
+           (unsigned long long)known, (unsigned long long)total);
+    printf("Время: %.1f с, %.0f позиций/с, %.2f МБ/с\n", seconds, seconds > 0 ? dg.written / seconds : 0.0,
+           seconds > 0 ? dg.written * sizeof(Data_Record) / seconds / (1 << 20) : 0.0);
+  }
+  pthread_mutex_destroy(&dg.index_lock);
+  free(dg.shards);
+  free(dg.dedup);
+  return status;
+}
+
+bool data_reader_open(Data_Reader *r, const char *dir){
+  memset(r, 0, sizeof(*r));
+  r->fd = -1;
+  r->shard = -1;
+  r->dir = strdup(dir);
+  r->buffer = malloc(sizeof(Data_Record) * DATA_READ_BUFFER);
+  if (r->dir == NULL || r->buffer == NULL ||
+      !data_read_index(dir, false, &r->variant, &r->shard_count, &r->shard_records, &r->shard_games))
+  {
+    data_reader_close(r);
+    return false;
+  }
+  return true;
+}
+
+// Открывает следующий шард с записями; false, если шарды кончились
+static bool data_reader_next_shard(Data_Reader *r){
+  if (r->fd >= 0)
+    close(r->fd);
+  r->fd = -1;
+  while (++r->shard < r->shard_count)
+  {
+    if (r->shard_records[r->shard] == 0)
+      continue;
+    char name[32];
+    snprintf(name, sizeof(name), "shard-%03d.bin", r->shard);
+    char *path = data_path(r->dir, name);
+    r->fd = path != NULL ? open(path, O_RDONLY) : -1;
+    Data_Shard_Header header;
+    if (r->fd < 0 || read(r->fd, &header, sizeof(header)) != (ssize_t)sizeof(header) || header.magic != DATA_MAGIC ||
+        header.record_size != sizeof(Data_Record))
+    {
+      fprintf(stderr, "Не удалось прочитать шард %s\n", path != NULL ? path : name);
+      free(path);
+      r->failed = true;
+      return false;
+    }
+    free(path);
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    r->left = r->shard_records[r->shard];
+    return true;
+  }
+  return false;
+}
+
+bool data_reader_next(Data_Reader *r, Data_Record *out){
+  while (r->next == r->buffered)
+  {
+    if (r->failed)
+      return false;
+    if (r->left == 0 && !data_reader_next_shard(r))
+      return false;
+    size_t want = r->left < DATA_READ_BUFFER ? (size_t)r->left : DATA_READ_BUFFER;
+    ssize_t n = read(r->fd, r->buffer, want * sizeof(Data_Record));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0 || n % sizeof(Data_Record) != 0)
+    {
+      // Шард короче, чем обещает индекс
+      fprintf(stderr, "Шард %d набора %s обрывается раньше индекса\n", r->shard, r->dir);
+      r->failed = true;
+      return false;
+    }
+    r->buffered = (size_t)n / sizeof(Data_Record);
+    r->next = 0;
+    r->left -= r->buffered;
+  }
+  *out = r->buffer[r->next++];
+  return true;
+}
+
+void data_reader_close(Data_Reader *r){
+  if (r->fd >= 0)
+    close(r->fd);
+  free(r->dir);
+  free(r->shard_records);
+  free(r->shard_games);
+  free(r->buffer);
+  memset(r, 0, sizeof(*r));
+  r->fd = -1;
+}
+
+int data_info(const char *dir){
+  Data_Reader r;
+  if (!data_reader_open(&r, dir))
+    return 1;
+  uint64_t games = 0, results[3] = {0, 0, 0}, count = 0, white = 0, kings = 0;
+  double score_sum = 0;
+  long depth_sum = 0;
+  for (int i = 0; i < r.shard_count; i++)
+    games += r.shard_games[i];
+  Data_Record rec;
+  struct timespec start, finish;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (data_reader_next(&r, &rec))
+  {
+    count++;
+    results[((rec.flags >> 1) & 3) < 3 ? (rec.flags >> 1) & 3 : 1]++;
+    white += rec.flags & 1;
+    kings += (rec.kings[0] | rec.kings[1] | rec.kings[2]) != 0;
+    score_sum += abs(rec.score);
+    depth_sum += rec.depth;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  bool failed = r.failed;
+  printf("Набор %s: правила %s, шардов %d, партий %llu, позиций %llu\n", dir,
+         r.variant == RULES_RUSSIAN ? "russian" : (r.variant == RULES_POOL ? "pool" : "american"), r.shard_count,
+         (unsigned long long)games, (unsigned long long)count);
+  if (count > 0)
+  {
+    double seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Результат для стороны на ходу: выигрыш %.1f%%, ничья %.1f%%, проигрыш %.1f%%\n",
+           100.0 * results[2] / count, 100.0 * results[1] / count, 100.0 * results[0] / count);
+    printf("Ходят белые: %.1f%%, с дамками: %.1f%%, средняя |оценка| %.0f, средняя глубина %.1f\n",
+           100.0 * white / count, 100.0 * kings / count, score_sum / count, (double)depth_sum / count);
+    printf("Чтение: %.3f с, %.0f позиций/с\n", seconds, seconds > 0 ? count / seconds : 0.0);
+  }
+  data_reader_close(&r);
+  return failed ? 1 : 0;
+}
+
+// Чтение PDN и разметка ошибок. Файл читает и результаты пишет главный
+// поток; партии размечаются в пуле потоков и возвращаются в порядке входа
+// через кольцо слотов, поэтому вывод не зависит от количества потоков.
+
+static void pdn_append_tags(Pdn_Game *game, const char *line){
+  size_t length = strlen(line);
+  if (game->tags_length + length + 2 > game->tags_capacity)
+  {
+    size_t capacity = game->tags_capacity > 0 ? game->tags_capacity : 256;
+    while (game->tags_length + length + 2 > capacity)
+      capacity *= 2;
+    char *tags = realloc(game->tags, capacity);
+    if (tags == NULL)
+      return;
+    game->tags = tags;
+    game->tags_capacity = capacity;
+  }
+  memcpy(game->tags + game->tags_length, line, length);
+  game->tags_length += length;
+  if (length == 0 || line[length - 1] != '\n')
+    game->tags[game->tags_length++] = '\n';
+  game->tags[game->tags_length] = '\0';
+}
+
+static void pdn_append_move(Pdn_Game *game, const char *token, size_t length){
+  if (game->move_count == game->move_capacity)
+  {
+    int capacity = game->move_capacity > 0 ? game->move_capacity * 2 : 128;
+    char (*moves)[PDN_MOVE_SIZE] = realloc(game->moves, sizeof(*moves) * capacity);
+    if (moves == NULL)
+      return;
+    game->moves = moves;
+    game->move_capacity = capacity;
+  }
+  if (length >= PDN_MOVE_SIZE)
+    length = PDN_MOVE_SIZE - 1;
+  memcpy(game->moves[game->move_count], token, length);
+  game->moves[game->move_count++][length] = '\0';
+}
+
+static bool pdn_is_result(const char *token, size_t length){
+  static const char *results[] = {"1-0", "0-1", "1/2-1/2", "2-0", "0-2", "1-1", "0-0", "*"};
+  for (size_t i = 0; i < sizeof(results) / sizeof(results[0]); i++)
+    if (strlen(results[i]) == length && strncmp(token, results[i], length) == 0)
+      return true;
+  return false;
+}
+
+bool pdn_read_game(Pdn_Reader *reader, Pdn_Game *game){
+  game->tags_length = 0;
+  if (game->tags != NULL)
+    game->tags[0] = '\0';
+  game->fen[0] = '\0';
+  game->result[0] = '\0';
+  game->move_count = 0;
+  bool any = false;
+  bool in_moves = false;
+  bool comment = false;
+  int variation = 0;
+
+  while (reader->has_line || fgets(reader->line, sizeof(reader->line), reader->in) != NULL)
+  {
+    reader->has_line = false;
+    char *line = reader->line;
+    if (!comment && variation == 0 && line[0] == '[')
+    {
+      // Теги после ходов начинают следующую партию
+      if (in_moves)
+      {
+        reader->has_line = true;
+        return true;
+      }
+      pdn_append_tags(game, line);
+      const char *value = strstr(line, "[FEN \"");
+      if (value != NULL)
+      {
+        value += 6;
+        size_t length = strcspn(value, "\"");
+        if (length >= sizeof(game->fen))
+          length = sizeof(game->fen) - 1;
+        memcpy(game->fen, value, length);
+        game->fen[length] = '\0';
+      }
+      any = true;
+      continue;
+    }
+    if (line[0] == '%')
+      continue;
+
+    for (char *c = line; *c != '\0';)
+    {
+      if (comment)
+      {
+        comment = *c++ != '}';
+        continue;
+      }
+      if (*c == '{')
+      {
+        comment = true;
+        c++;
+        continue;
+      }
+      if (*c == '(' || *c == ')')
+      {
+        variation += *c++ == '(' ? 1 : (variation > 0 ? -1 : 0);
+        continue;
+      }
+      if (*c == ';')
+        break;
+      // Лишняя '}' дала бы пустую лексему, на которой разбор не сдвигается
+      if (isspace((unsigned char)*c) || variation > 0 || *c == '}')
+      {
+        c++;
+        continue;
+      }
+      char *token = c;
+      while (*c != '\0' && !isspace((unsigned char)*c) && strchr("{}();", *c) == NULL)
+        c++;
+      size_t length = c - token;
+      if (pdn_is_result(token, length))
+      {
+        memcpy(game->result, token, length);
+        game->result[length] = '\0';
+        return true;
+      }
+      // Номер хода может быть записан слитно с ходом: 12.11-15
+      size_t skip = 0;
+      while (skip < length && isdigit((unsigned char)token[skip]))
+        skip++;
+      if (skip < length && token[skip] == '.')
+      {
+        while (skip < length && token[skip] == '.')
+          skip++;
+        token += skip;
+        length -= skip;
+      }
+      while (length > 0 && (token[length - 1] == '!' || token[length - 1] == '?'))
+        length--;
+      if (length > 0)
+      {
+        pdn_append_move(game, token, length);
+        in_moves = true;
+        any = true;
+      }
+    }
+  }
+  return any;
+}
+
+void pdn_free_game(Pdn_Game *game){
+  free(game->tags);
+  free(game->moves);
+  memset(game, 0, sizeof(*game));
+}
+
+static bool pdn_parse_square(const char **text, int *sq){
+  const char *c = *text;
+  int x, y;
+  if (isdigit((unsigned char)*c))
+  {
+    char *end;
+    long n = strtol(c, &end, 10);
+    if (n < 1 || n > SQUARES)
+      return false;
+    *sq = (int)n - 1;
+    *text = end;
+    return true;
+  }
+  x = tolower((unsigned char)c[0]) - 'a';
+  if (x < 0 || x > 7 || c[1] < '1' || c[1] > '8')
+    return false;
+  y = '8' - c[1];
+  if ((x + y) % 2 == 0)
+    return false;
+  *sq = SQ_INDEX(x, y);
+  *text = c + 2;
+  return true;
+}
+
+int pdn_find_move(const char *text, const Hod_List *list){
+  int from, to;
+  if (!pdn_parse_square(&text, &from))
+    return -1;
+  to = from;
+  while (*text == '-' || *text == 'x' || *text == 'X' || *text == ':')
+  {
+    text++;
+    if (!pdn_parse_square(&text, &to))
+      return -1;
+  }
+  if (*text != '\0' || to == from)
+    return -1;
+  return find_hod(list, SQ_X(from), SQ_Y(from), SQ_X(to), SQ_Y(to), HOD_ANY_CAPTURE);
+}
+
+static void format_pdn_move(const Hod_Info *h, bool algebraic, char *out){
+  if (algebraic)
+  {
+    format_hod(h, out);
+    out[0] = tolower(out[0]);
+    out[3] = tolower(out[3]);
+    return;
+  }
+  snprintf(out, PDN_MOVE_SIZE, "%d%c%d", SQ_INDEX(h->from_x, h->from_y) + 1, h->kills > 0 ? 'x' : '-',
+           SQ_INDEX(h->to_x, h->to_y) + 1);
+}
+
+typedef struct
+{
+  char *data;
+  size_t length;
+  size_t capacity;
+} Text_Buffer;
+
+static void text_printf(Text_Buffer *text, const char *fmt, ...){
+  for (;;)
+  {
+    va_list args;
+    va_start(args, fmt);
+    size_t room = text->capacity - text->length;
+    int n = vsnprintf(text->capacity > 0 ? text->data + text->length : NULL, room, fmt, args);
+    va_end(args);
+    if (n < 0)
+      return;
+    if ((size_t)n < room)
+    {
+      text->length += n;
+      return;
+    }
+    size_t capacity = text->capacity > 0 ? text->capacity * 2 : 4096;
+    while (capacity - text->length <= (size_t)n)
+      capacity *= 2;
+    char *data = realloc(text->data, capacity);
+    if (data == NULL)
+      return;
+    text->data = data;
+    text->capacity = capacity;
+  }
+}
+
+static void text_json_string(Text_Buffer *text, const char *value, size_t length){
+  text_printf(text, "\"");
+  for (size_t i = 0; i < length; i++)
+  {
+    unsigned char c = value[i];
+    if (c == '"' || c == '\\')
+      text_printf(text, "\\%c", c);
+    else if (c < 0x20)
+      text_printf(text, "\\u%04x", c);
+    else
+      text_printf(text, "%c", c);
+  }
+  text_printf(text, "\"");
+}
+
+typedef struct
+{
+  Hod_Info played;     // Сыгранный ход
+  Hod_Info best;       // Лучший ход по поиску
+  int best_score;      // Оценка позиции до хода для стороны, которая ходит
+  int drop;            // Потеря сыгранного хода по сравнению с лучшим
+} Annotated_Ply;
+
+typedef struct
+{
+  Pdn_Game game;
+  Text_Buffer text;    // Размеченная партия для вывода
+  bool ready;
+} Annotate_Slot;
+
+typedef struct
+{
+  Annotate_Slot *slots;
+  long capacity;
+  long next_read;      // Партий прочитано
+  long next_take;      // Партий отдано потокам
+  long next_write;     // Партий записано
+  bool end_of_input;
+  bool json;
+  int threshold;
+  pthread_mutex_t mutex;
+  pthread_cond_t work_cond;
+  pthread_cond_t ready_cond;
+  long positions;
+  long flagged;
+  long errors;
+} Annotator;
+
+static int annotate_clamp(int score){
+  return score > ANNOTATE_SCORE_CAP ? ANNOTATE_SCORE_CAP : (score < -ANNOTATE_SCORE_CAP ? -ANNOTATE_SCORE_CAP : score);
+}
+
+static void annotate_game(Annotator *an, long index, Annotate_Slot *slot){
+  const Pdn_Game *game = &slot->game;
+  Text_Buffer *text = &slot->text;
+  text->length = 0;
+  Annotated_Ply *plies = malloc(sizeof(Annotated_Ply) * (game->move_count + 1));
+  int ply_count = 0;
+  const char *error = NULL;
+  char side = '1';
+  bool algebraic = game->move_count > 0 && isalpha((unsigned char)game->moves[0][0]);
+
+  // Без тега FEN партия начинается с начальной расстановки; кто ходит
+  // первым, определяется по фишке на поле первого хода
+  if (game->fen[0] != '\0')
+  {
+    if (!parse_fen(game->fen, lodic, &side))
+      error = "неверный тег FEN";
+  }
+  else
+  {
+    initial_position(lodic);
+    const char *first = game->move_count > 0 ? game->moves[0] : "";
+    int sq;
+    if (pdn_parse_square(&first, &sq))
+      side = lodic[SQ_Y(sq)][SQ_X(sq)] == '2' ? '2' : '1';
+  }
+  count_pieces(lodic, &game_state);
+  history_reset(&game_history, position_hash(lodic, side));
+  // Зерно по номеру партии: результат не зависит от того, какой поток ее считал
+  rng_seed((uint64_t)index);
+
+  int final_score = 0;
+  for (int i = 0; error == NULL && i <= game->move_count; i++)
+  {
+    Search_Result result;
+    Hod_List list;
+    generate_hods(lodic, side, &list);
+    int score = search_position(lodic, side, &search_options, &result) ? result.score : -SEARCH_MATE;
+    if (i == game->move_count)
+    {
+      final_score = score;
+      break;
+    }
+    int found = pdn_find_move(game->moves[i], &list);
+    if (found < 0)
+    {
+      error = "недопустимый ход";
+      final_score = score;
+      break;
+    }
+    plies[ply_count].played = hod_info(&list, list.hods[found]);
+    plies[ply_count].best = result.best;
+    plies[ply_count].best_score = score;
+    make_hod(&plies[ply_count].played);
+    ply_count++;
+    side = side == '1' ? '2' : '1';
+  }
+
+  // Потеря хода - разница между лучшей оценкой до хода и оценкой после него
+  // с точки зрения сделавшего ход; сыгранный лучший ход ничего не теряет
+  int flagged = 0;
+  for (int i = 0; i < ply_count; i++)
+  {
+    int after = i + 1 < ply_count ? plies[i + 1].best_score : final_score;
+    int drop = annotate_clamp(plies[i].best_score) + annotate_clamp(after);
+    bool best = plies[i].played.from_x == plies[i].best.from_x && plies[i].played.from_y == plies[i].best.from_y &&
+                plies[i].played.to_x == plies[i].best.to_x && plies[i].played.to_y == plies[i].best.to_y &&
+                plies[i].played.captured == plies[i].best.captured;
+    plies[i].drop = best || drop < 0 ? 0 : drop;
+    flagged += plies[i].drop > an->threshold;
+  }
+
+  const char *result = game->result[0] != '\0' ? game->result : "*";
+  if (an->json)
+  {
+    text_printf(text, "{\"game\":%ld,\"tags\":{", index + 1);
+    bool first = true;
+    for (const char *line = game->tags; line != NULL && *line != '\0';)
+    {
+      const char *end = strchr(line, '\n');
+      size_t length = end != NULL ? (size_t)(end - line) : strlen(line);
+      const char *quote = memchr(line, '"', length);
+      if (line[0] == '[' && quote != NULL)
+      {
+        const char *key_end = line + 1;
+        while (key_end < quote && !isspace((unsigned char)*key_end))
+          key_end++;
+        const char *value_end = memchr(quote + 1, '"', length - (quote + 1 - line));
+        if (value_end != NULL)
+        {
+          text_printf(text, first ? "" : ",");
+          text_json_string(text, line + 1, key_end - line - 1);
+          text_printf(text, ":");
+          text_json_string(text, quote + 1, value_end - quote - 1);
+          first = false;
+        }
+      }
+      line = end != NULL ? end + 1 : NULL;
+    }
+    text_printf(text, "},\"result\":");
+    text_json_string(text, result, strlen(result));
+    text_printf(text, ",\"moves\":[");
+    for (int i = 0; i < ply_count; i++)
+    {
+      char best[PDN_MOVE_SIZE];
+      format_pdn_move(&plies[i].best, algebraic, best);
+      text_printf(text, "%s{\"ply\":%d,\"move\":", i > 0 ? "," : "", i + 1);
+      text_json_string(text, game->moves[i], strlen(game->moves[i]));
+      text_printf(text, ",\"best\":\"%s\",\"score\":%d,\"drop\":%d,\"flag\":%s}", best, plies[i].best_score,
+                  plies[i].drop, plies[i].drop > an->threshold ? "true" : "false");
+    }
+    text_printf(text, "]");
+    if (error != NULL)
+    {
+      text_printf(text, ",\"error\":");
+      text_json_string(text, error, strlen(error));
+      text_printf(text, ",\"error_ply\":%d", ply_count + 1);
+    }
+    text_printf(text, "}\n");
+  }
+  else
+  {
+    if (game->tags_length > 0)
+      text_printf(text, "%s", game->tags);
+    else
+      text_printf(text, "[Result \"%s\"]\n", result);
+    text_printf(text, "\n");
+    int column = 0;
+    for (int i = 0; i < game->move_count; i++)
+    {
+      char item[160];
+      int n = 0;
+      if (i % 2 == 0)
+        n += snprintf(item + n, sizeof(item) - n, "%d. ", i / 2 + 1);
+      n += snprintf(item + n, sizeof(item) - n, "%s", game->moves[i]);
+      if (i < ply_count && plies[i].drop > an->threshold)
+      {
+        char best[PDN_MOVE_SIZE];
+        format_pdn_move(&plies[i].best, algebraic, best);
+        n += snprintf(item + n, sizeof(item) - n, "? {потеря %d, лучше %s %+d}", plies[i].drop, best,
+                      plies[i].best_score);
+      }
+      if (i == ply_count && error != NULL)
+        n += snprintf(item + n, sizeof(item) - n, " {%s}", error);
+      if (column > 0 && column + n + 1 > 79)
+      {
+        text_printf(text, "\n");
+        column = 0;
+      }
+      text_printf(text, "%s%s", column > 0 ? " " : "", item);
+      column += n + (column > 0);
+    }
+    text_printf(text, "%s%s\n\n", column > 0 ? " " : "", result);
+  }
+  free(plies);
+
+  pthread_mutex_lock(&an->mutex);
+  an->positions += ply_count;
+  an->flagged += flagged;
+  an->errors += error != NULL;
+  pthread_mutex_unlock(&an->mutex);
+}
+
+static void *annotate_thread(void *arg){
+  Annotator *an = arg;
+  pthread_mutex_lock(&an->mutex);
+  for (;;)
+  {
+    while (an->next_take == an->next_read && !an->end_of_input)
+      pthread_cond_wait(&an->work_cond, &an->mutex);
+    if (an->next_take == an->next_read)
+      break;
+    long index = an->next_take++;
+    pthread_mutex_unlock(&an->mutex);
+    Annotate_Slot *slot = &an->slots[index % an->capacity];
+    annotate_game(an, index, slot);
+    pthread_mutex_lock(&an->mutex);
+    slot->ready = true;
+    pthread_cond_broadcast(&an->ready_cond);
+  }
+  pthread_mutex_unlock(&an->mutex);
+  return NULL;
+}
+
+int annotate_pdn(const char *input, const char *output, bool json, int threshold, int threads){
+  Pdn_Reader reader = {0};
+  reader.in = strcmp(input, "-") == 0 ? stdin : fopen(input, "r");
+  if (reader.in == NULL)
+  {
+    perror(input);
+    return 1;
+  }
+  FILE *out = strcmp(output, "-") == 0 ? stdout : fopen(output, "w");
+  if (out == NULL)
+  {
+    perror(output);
+    if (reader.in != stdin)
+      fclose(reader.in);
+    return 1;
+  }
+  if (threads <= 0)
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 1)
+    threads = 1;
+
+  Annotator an;
+  memset(&an, 0, sizeof(an));
+  // Запас слотов позволяет потокам считать дальше, пока ждется длинная партия
+  an.capacity = threads * 4;
+  an.slots = calloc(an.capacity, sizeof(Annotate_Slot));
+  an.json = json;
+  an.threshold = threshold;
+  pthread_mutex_init(&an.mutex, NULL);
+  pthread_cond_init(&an.work_cond, NULL);
+  pthread_cond_init(&an.ready_cond, NULL);
+  pthread_t *ids = malloc(sizeof(pthread_t) * threads);
+  int started = 0;
+  while (an.slots != NULL && ids != NULL && started < threads &&
+         pthread_create(&ids[started], NULL, annotate_thread, &an) == 0)
+    started++;
+  if (started == 0)
+  {
+    printf("Не удалось запустить потоки разметки\n");
+    free(an.slots);
+    free(ids);
+    return 1;
+  }
+
+  struct timespec start, finish;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pthread_mutex_lock(&an.mutex);
+  for (;;)
+  {
+    // Готовые партии пишутся строго по порядку
+    while (an.next_write < an.next_read && an.slots[an.next_write % an.capacity].ready)
+    {
+      Annotate_Slot *slot = &an.slots[an.next_write % an.capacity];
+      pthread_mutex_unlock(&an.mutex);
+      fwrite(slot->text.data, 1, slot->text.length, out);
+      pthread_mutex_lock(&an.mutex);
+      slot->ready = false;
+      an.next_write++;
+    }
+    if (!an.end_of_input && an.next_read - an.next_write < an.capacity)
+    {
+      // Слот свободен и не виден потокам, пока не увеличен next_read
+      Annotate_Slot *slot = &an.slots[an.next_read % an.capacity];
+      pthread_mutex_unlock(&an.mutex);
+      bool got = pdn_read_game(&reader, &slot->game);
+      pthread_mutex_lock(&an.mutex);
+      if (got)
+        an.next_read++;
+      else
+        an.end_of_input = true;
+      pthread_cond_broadcast(&an.work_cond);
+      continue;
+    }
+    if (an.end_of_input && an.next_write == an.next_read)
+      break;
+    pthread_cond_wait(&an.ready_cond, &an.mutex);
+  }
+  pthread_mutex_unlock(&an.mutex);
+  for (int i = 0; i < started; i++)
+    pthread_join(ids[i], NULL);
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+
+  double seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(stderr, "Партий: %ld, позиций: %ld, ошибок найдено: %ld, партий с недопустимыми ходами: %ld\n",
+          an.next_read, an.positions, an.flagged, an.errors);
+  fprintf(stderr, "Время: %.1f с, %.0f позиций/с, потоков: %d\n", seconds, seconds > 0 ? an.positions / seconds : 0.0,
+          started);
+
+  for (long i = 0; i < an.capacity; i++)
+  {
+    pdn_free_game(&an.slots[i].game);
+    free(an.slots[i].text.data);
+  }
+  free(an.slots);
+  free(ids);
+  pthread_mutex_destroy(&an.mutex);
+  pthread_cond_destroy(&an.work_cond);
+  pthread_cond_destroy(&an.ready_cond);
+  if (reader.in != stdin)
+    fclose(reader.in);
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
+
+// Обучение нейросетевой оценки. Позиции без взятий берутся из партий PDN;
+// цель позиции - смесь результата партии и ручной оценки с весом
+// NNUE_TRAIN_LAMBDA: на нескольких сотнях партий один результат слишком
+// шумный. Сеть учится в плавающей точке методом Adam с ограничениями,
+// которые переживет квантование: выходы слоев ограничены 0..1, веса второго
+// слоя - 127 / NNUE_QB, веса первого - так, чтобы накопитель int16 не
+// переполнился при 24 фишках.
+#define NNUE_TRAIN_LAMBDA 0.5f  // Доля результата партии в цели
+#define NNUE_TRAIN_BATCH 256
+#define NNUE_TRAIN_RATE 0.001f
+#define NNUE_TRAIN_W1_LIMIT 8.0f
+
+typedef struct
+{
+  uint32_t masks[4];   // Позиция в порядке pack_position
+  char side;           // Сторона на ходу
+  float outcome;       // Результат партии для стороны на ходу: 1, 0.5 или 0
+  float target;        // Цель обучения
+} Nnue_Sample;
+
+typedef struct
+{
+  float w1[NNUE_FEATURES][NNUE_HIDDEN];
+  float b1[NNUE_HIDDEN];
+  float w2[NNUE_L2][2 * NNUE_HIDDEN];
+  float b2[NNUE_L2];
+  float w3[NNUE_L2];
+  float b3;
+} Nnue_Float;
+
+#define NNUE_PARAMS (sizeof(Nnue_Float) / sizeof(float))
+
+typedef struct
+{
+  Nnue_Sample *items;
+  size_t count;
+  size_t capacity;
+} Nnue_Samples;
+
+static float nnue_sigmoid(float score){
+  return 1.0f / (1.0f + expf(-score / NNUE_WDL));
+}
+
+static float nnue_clampf(float x, float low, float high){
+  return x < low ? low : (x > high ? high : x);
+}
+
+// Позиции партии без взятий; без известного результата партия пропускается
+static void nnue_collect_game(const Pdn_Game *game, Nnue_Samples *samples){
+  float white;
+  if (strcmp(game->result, "1-0") == 0 || strcmp(game->result, "2-0") == 0)
+    white = 1.0f;
+  else if (strcmp(game->result, "0-1") == 0 || strcmp(game->result, "0-2") == 0)
+    white = 0.0f;
+  else if (strcmp(game->result, "1/2-1/2") == 0 || strcmp(game->result, "1-1") == 0)
+    white = 0.5f;
+  else
+    return;
+
+  // Начальная позиция и первая сторона - как при разметке партий
+  char position[8][8];
+  char side = '1';
+  if (game->fen[0] != '\0')
+  {
+    if (!parse_fen(game->fen, position, &side))
+      return;
+  }
+  else
+  {
+    initial_position(position);
+    const char *first = game->move_count > 0 ? game->moves[0] : "";
+    int sq;
+    if (pdn_parse_square(&first, &sq))
+      side = position[SQ_Y(sq)][SQ_X(sq)] == '2' ? '2' : '1';
+  }
+
+  for (int i = 0; i <= game->move_count; i++)
+  {
+    Hod_List list;
+    if (generate_hods(position, side, &list) == 0)
+      break;
+    if (HOD_CAPTURE(list.hods[0]) == 0)
+    {
+      if (samples->count == samples->capacity)
+      {
+        size_t capacity = samples->capacity > 0 ? samples->capacity * 2 : 4096;
+        Nnue_Sample *items = realloc(samples->items, capacity * sizeof(Nnue_Sample));
+        if (items == NULL)
+          return;
+        samples->items = items;
+        samples->capacity = capacity;
+      }
+      Nnue_Sample *s = &samples->items[samples->count++];
+      pack_position(position, s->masks);
+      s->side = side;
+      s->outcome = side == '2' ? white : 1.0f - white;
+      int hand = evaluate_masks(s->masks);
+      s->target = NNUE_TRAIN_LAMBDA * s->outcome + (1.0f - NNUE_TRAIN_LAMBDA) * nnue_sigmoid(side == '1' ? hand : -hand);
+    }
+    if (i == game->move_count)
+      break;
+    int found = pdn_find_move(game->moves[i], &list);
+    if (found < 0)
+      break;
+    apply_hod(position, &list, list.hods[found]);
+    side = side == '1' ? '2' : '1';
+  }
+}
+
+// Позиции набора --datagen: оценка поиска уже посчитана генератором
+static bool nnue_collect_data(const char *dir, Nnue_Samples *samples, long *games){
+  Data_Reader reader;
+  if (!data_reader_open(&reader, dir))
+    return false;
+  if (reader.variant != rules_variant)
+  {
+    fprintf(stderr, "Набор %s записан по другим правилам\n", dir);
+    data_reader_close(&reader);
+    return false;
+  }
+  for (int i = 0; i < reader.shard_count; i++)
+    *games += (long)reader.shard_games[i];
+  Data_Record rec;
+  while (data_reader_next(&reader, &rec))
+  {
+    if (samples->count == samples->capacity)
+    {
+      size_t capacity = samples->capacity > 0 ? samples->capacity * 2 : 4096;
+      Nnue_Sample *items = realloc(samples->items, capacity * sizeof(Nnue_Sample));
+      if (items == NULL)
+        break;
+      samples->items = items;
+      samples->capacity = capacity;
+    }
+    Nnue_Sample *s = &samples->items[samples->count++];
+    data_record_unpack(&rec, s->masks);
+    s->side = rec.flags & 1 ? '2' : '1';
+    s->outcome = ((rec.flags >> 1) & 3) * 0.5f;
+    s->target = NNUE_TRAIN_LAMBDA * s->outcome + (1.0f - NNUE_TRAIN_LAMBDA) * nnue_sigmoid(rec.score);
+  }
+  bool ok = !reader.failed;
+  data_reader_close(&reader);
+  return ok;
+}
+
+// Входы позиции с точки зрения стороны view
+static int nnue_sample_features(const Nnue_Sample *s, int view, int *features){
+  static const char pieces[4] = {'1', '3', '2', '4'};
+  int n = 0;
+  for (int k = 0; k < 4; k++)
+    for (uint32_t rest = s->masks[k]; rest != 0; rest &= rest - 1)
+      features[n++] = nnue_feature(view, pieces[k], __builtin_ctz(rest));
+  return n;
+}
+
+// Оценка сети в сотых долях простой; при grad != NULL к нему добавляется
+// градиент квадрата ошибки ожидаемого результата
+static float nnue_float_forward(const Nnue_Float *net, const Nnue_Sample *s, Nnue_Float *grad){
+  int features[2][SQUARES], count[2];
+  float acc[2][NNUE_HIDDEN], x[2 * NNUE_HIDDEN], z2[NNUE_L2], h[NNUE_L2];
+  int own = s->side == '2';
+  for (int view = 0; view < 2; view++)
+  {
+    count[view] = nnue_sample_features(s, view, features[view]);
+    memcpy(acc[view], net->b1, sizeof(net->b1));
+    for (int n = 0; n < count[view]; n++)
+      for (int j = 0; j < NNUE_HIDDEN; j++)
+        acc[view][j] += net->w1[features[view][n]][j];
+  }
+  for (int half = 0; half < 2; half++)
+    for (int j = 0; j < NNUE_HIDDEN; j++)
+      x[half * NNUE_HIDDEN + j] = nnue_clampf(acc[own ^ half][j], 0.0f, 1.0f);
+  float y = net->b3;
+  for (int o = 0; o < NNUE_L2; o++)
+  {
+    z2[o] = net->b2[o];
+    for (int i = 0; i < 2 * NNUE_HIDDEN; i++)
+      z2[o] += net->w2[o][i] * x[i];
+    h[o] = nnue_clampf(z2[o], 0.0f, 1.0f);
+    y += net->w3[o] * h[o];
+  }
+  float score = y * NNUE_SCALE;
+  if (grad == NULL)
+    return score;
+
+  float p = nnue_sigmoid(score);
+  float dy = 2.0f * (p - s->target) * p * (1.0f - p) * NNUE_SCALE / NNUE_WDL;
+  float dx[2 * NNUE_HIDDEN] = {0};
+  grad->b3 += dy;
+  for (int o = 0; o < NNUE_L2; o++)
+  {
+    grad->w3[o] += dy * h[o];
+    if (z2[o] <= 0.0f || z2[o] >= 1.0f)
+      continue;
+    float dz = dy * net->w3[o];
+    grad->b2[o] += dz;
+    for (int i = 0; i < 2 * NNUE_HIDDEN; i++)
+    {
+      grad->w2[o][i] += dz * x[i];
+      dx[i] += dz * net->w2[o][i];
+    }
+  }
+  for (int half = 0; half < 2; half++)
+  {
+    int view = own ^ half;
+    for (int j = 0; j < NNUE_HIDDEN; j++)
+    {
+      if (acc[view][j] <= 0.0f || acc[view][j] >= 1.0f)
+        continue;
+      float da = dx[half * NNUE_HIDDEN + j];
+      grad->b1[j] += da;
+      for (int n = 0; n < count[view]; n++)
+        grad->w1[features[view][n]][j] += da;
+    }
+  }
+  return score;
+}
+
+static int16_t nnue_quantize16(float x){
+  long v = lrintf(x);
+  return (int16_t)(v < INT16_MIN ? INT16_MIN : (v > INT16_MAX ? INT16_MAX : v));
+}
+
+static void nnue_quantize(const Nnue_Float *f, Nnue_Net *q){
+  int16_t row[NNUE_HIDDEN];
+  for (int n = 0; n < NNUE_FEATURES; n++)
+  {
+    for (int j = 0; j < NNUE_HIDDEN; j++)
+      row[j] = nnue_quantize16(f->w1[n][j] * NNUE_QA);
+    memcpy(q->w1[n], row, sizeof(row));
+  }
+  for (int j = 0; j < NNUE_HIDDEN; j++)
+    row[j] = nnue_quantize16(f->b1[j] * NNUE_QA);
+  memcpy(q->b1, row, sizeof(row));
+  for (int o = 0; o < NNUE_L2; o++)
+  {
+    for (int i = 0; i < 2 * NNUE_HIDDEN; i++)
+      q->w2[o][i] = (int8_t)lrintf(nnue_clampf(f->w2[o][i] * NNUE_QB, -127.0f, 127.0f));
+    q->b2[o] = (int32_t)lrintf(f->b2[o] * NNUE_QA * NNUE_QB);
+    q->w3[o] = nnue_quantize16(f->w3[o] * NNUE_QB);
+  }
+  q->b3 = (int32_t)lrintf(f->b3 * NNUE_QA * NNUE_QB);
+}
+
+static float nnue_random(float range){
+  return ((float)(rng_next() >> 40) / (float)(1 << 24) * 2.0f - 1.0f) * range;
+}
+
+int nnue_train(const char *output, char **inputs, int count, int epochs, uint64_t seed){
+  Nnue_Samples samples = {NULL, 0, 0};
+  Pdn_Game game;
+  memset(&game, 0, sizeof(game));
+  long games = 0;
+  for (int f = 0; f < count; f++)
+  {
+    struct stat st;
+    if (stat(inputs[f], &st) == 0 && S_ISDIR(st.st_mode))
+    {
+      if (!nnue_collect_data(inputs[f], &samples, &games))
+      {
+        pdn_free_game(&game);
+        free(samples.items);
+        return 1;
+      }
+      continue;
+    }
+    Pdn_Reader reader = {fopen(inputs[f], "r"), false, ""};
+    if (reader.in == NULL)
+    {
+      fprintf(stderr, "Не удалось открыть %s: %s\n", inputs[f], strerror(errno));
+      pdn_free_game(&game);
+      free(samples.items);
+      return 1;
+    }
+    while (pdn_read_game(&reader, &game))
+    {
+      nnue_collect_game(&game, &samples);
+      games++;
+    }
+    fclose(reader.in);
+  }
+  pdn_free_game(&game);
+  if (samples.count < 100)
+  {
+    fprintf(stderr, "Слишком мало позиций для обучения: %zu\n", samples.count);
+    free(samples.items);
+    return 1;
+  }
+
+  // Последние 10% перемешанных позиций не участвуют в обучении
+  rng_seed(seed);
+  Nnue_Sample *items = samples.items;
+  for (size_t i = samples.count - 1; i > 0; i--)
+  {
+    size_t j = (size_t)(rng_next() % (i + 1));
+    Nnue_Sample tmp = items[i];
+    items[i] = items[j];
+    items[j] = tmp;
+  }
+  size_t valid = samples.count / 10, train = samples.count - valid;
+  printf("Партий: %ld, позиций: %zu, для проверки: %zu\n", games, samples.count, valid);
+
+  Nnue_Float *net = calloc(1, sizeof(Nnue_Float));
+  Nnue_Float *grad = malloc(sizeof(Nnue_Float));
+  float *moment1 = calloc(NNUE_PARAMS, sizeof(float));
+  float *moment2 = calloc(NNUE_PARAMS, sizeof(float));
+  Nnue_Net *quantized = aligned_alloc(64, (sizeof(Nnue_Net) + 63) & ~(size_t)63);
+  if (net == NULL || grad == NULL || moment1 == NULL || moment2 == NULL || quantized == NULL)
+  {
+    fprintf(stderr, "Не хватает памяти для обучения\n");
+    free(net);
+    free(grad);
+    free(moment1);
+    free(moment2);
+    free(quantized);
+    free(samples.items);
+    return 1;
+  }
+  for (int n = 0; n < NNUE_FEATURES; n++)
+    for (int j = 0; j < NNUE_HIDDEN; j++)
+      net->w1[n][j] = nnue_random(0.1f);
+  for (int j = 0; j < NNUE_HIDDEN; j++)
+    net->b1[j] = 0.3f;
+  for (int o = 0; o < NNUE_L2; o++)
+  {
+    for (int i = 0; i < 2 * NNUE_HIDDEN; i++)
+      net->w2[o][i] = nnue_random(0.15f);
+    net->b2[o] = 0.3f;
+    net->w3[o] = nnue_random(0.5f);
+  }
+
+  float *params = (float *)net, *grads = (float *)grad;
+  long step = 0;
+  for (int epoch = 1; epoch <= epochs; epoch++)
+  {
+    for (size_t i = train - 1; i > 0; i--)
+    {
+      size_t j = (size_t)(rng_next() % (i + 1));
+      Nnue_Sample tmp = items[i];
+      items[i] = items[j];
+      items[j] = tmp;
+    }
+    double train_loss = 0;
+    for (size_t begin = 0; begin < train; begin += NNUE_TRAIN_BATCH)
+    {
+      size_t end = begin + NNUE_TRAIN_BATCH < train ? begin + NNUE_TRAIN_BATCH : train;
+      memset(grad, 0, sizeof(Nnue_Float));
+      for (size_t i = begin; i < end; i++)
+      {
+        float p = nnue_sigmoid(nnue_float_forward(net, &items[i], grad));
+        train_loss += (p - items[i].target) * (p - items[i].target);
+      }
+      // Adam
+      step++;
+      float rate = NNUE_TRAIN_RATE * sqrtf(1.0f - powf(0.999f, step)) / (1.0f - powf(0.9f, step));
+      for (size_t k = 0; k < NNUE_PARAMS; k++)
+      {
+        float g = grads[k] / (float)(end - begin);
+        moment1[k] = 0.9f * moment1[k] + 0.1f * g;
+        moment2[k] = 0.999f * moment2[k] + 0.001f * g * g;
+        params[k] -= rate * moment1[k] / (sqrtf(moment2[k]) + 1e-8f);
+      }
+      for (int n = 0; n < NNUE_FEATURES; n++)
+        for (int j = 0; j < NNUE_HIDDEN; j++)
+          net->w1[n][j] = nnue_clampf(net->w1[n][j], -NNUE_TRAIN_W1_LIMIT, NNUE_TRAIN_W1_LIMIT);
+      for (int o = 0; o < NNUE_L2; o++)
+        for (int i = 0; i < 2 * NNUE_HIDDEN; i++)
+          net->w2[o][i] = nnue_clampf(net->w2[o][i], -127.0f / NNUE_QB, 127.0f / NNUE_QB);
+    }
+    double valid_loss = 0;
+    for (size_t i = train; i < samples.count; i++)
+    {
+      float p = nnue_sigmoid(nnue_float_forward(net, &items[i], NULL));
+      valid_loss += (p - items[i].target) * (p - items[i].target);
+    }
+    printf("Эпоха %2d: ошибка обучения %.5f, проверки %.5f\n", epoch, train_loss / train,
+           valid > 0 ? valid_loss / valid : 0.0);
+  }
+
+  // Предсказание результата партии на проверочных позициях: ручная оценка,
+  // сеть в плавающей точке и квантованная сеть, как ее считает поиск
+  memset(quantized, 0, sizeof(Nnue_Net));
+  nnue_quantize(net, quantized);
+  double hand_loss = 0, float_loss = 0, int_loss = 0;
+  for (size_t i = train; i < samples.count; i++)
+  {
+    const Nnue_Sample *s = &items[i];
+    char position[8][8];
+    unpack_position(s->masks, position);
+    int hand = evaluate_masks(s->masks);
+    float p_hand = nnue_sigmoid(s->side == '1' ? hand : -hand);
+    float p_float = nnue_sigmoid(nnue_float_forward(net, s, NULL));
+    float p_int = nnue_sigmoid(nnue_evaluate(quantized, position, s->side));
+    hand_loss += (p_hand - s->outcome) * (p_hand - s->outcome);
+    float_loss += (p_float - s->outcome) * (p_float - s->outcome);
+    int_loss += (p_int - s->outcome) * (p_int - s->outcome);
+  }
+  if (valid > 0)
+    printf("Ошибка предсказания результата: ручная оценка %.5f, сеть %.5f, квантованная сеть %.5f\n",
+           hand_loss / valid, float_loss / valid, int_loss / valid);
+
+  bool ok = nnue_save(quantized, output);
+  if (ok)
+    printf("Веса записаны в %s\n", output);
+  else
+    fprintf(stderr, "Не удалось записать %s: %s\n", output, strerror(errno));
+  free(net);
+  free(grad);
+  free(moment1);
+  free(moment2);
+  free(quantized);
+  free(samples.items);
+  return ok ? 0 : 1;
+}
+
+// Проверка на случайных входах. Цели разбирают произвольные байты так же,
+// как их разбирает программа, а ходы каждой встреченной позиции сверяются с
+// эталонным генератором: он написан прямо по правилам, на координатах доски
+// с проверкой границ, без таблиц лучей и без снятия фишки с доски, и потому
+// медленный. С libFuzzer цель выбирается при сборке (FUZZ_TARGET), без
+// него входы дает встроенный перебор --fuzz (см. README).
+
+typedef struct
+{
+  int from;
+  int to;
+  uint32_t captured;
+  bool promotes;
+} Ref_Hod;
+
+typedef struct
+{
+  int count;
+  Ref_Hod hods[FUZZ_REF_HODS];
+} Ref_List;
+
+static bool ref_on_board(int x, int y){
+  return x >= 0 && x < 8 && y >= 0 && y < 8;
+}
+
+static bool ref_is_enemy(char piece, char side){
+  return side == '1' ? piece == '2' || piece == '4' : piece == '1' || piece == '3';
+}
+
+static void ref_add(Ref_List *list, int from, int to, uint32_t captured, bool promotes){
+  for (int i = 0; i < list->count; i++)
+    if (list->hods[i].from == from && list->hods[i].to == to && list->hods[i].captured == captured)
+      return;
+  if (list->count < FUZZ_REF_HODS)
+    list->hods[list->count++] = (Ref_Hod){from, to, captured, promotes};
+}
+
+// Продолжения взятия фишкой с (x, y). Взятые фишки стоят на доске до конца
+// хода, клетка, с которой начат ход, свободна. Возвращает, сколько концов
+// хода найдено
+static int ref_captures(char position[8][8], char side, int from, int x, int y, bool king, bool was_man,
+                        uint32_t captured, Ref_List *list){
+  bool flying = rules_variant != RULES_AMERICAN;
+  bool men_back = rules_variant != RULES_AMERICAN;
+  int forward = side == '1' ? 1 : -1, last_row = side == '1' ? 7 : 0;
+  int found = 0;
+  for (int dy = -1; dy <= 1; dy += 2)
+    for (int dx = -1; dx <= 1; dx += 2)
+    {
+      if (!king && !men_back && dy != forward)
+        continue;
+      int vx = x + dx, vy = y + dy;
+      while (king && flying && ref_on_board(vx, vy) && (position[vy][vx] == '0' || SQ_INDEX(vx, vy) == from))
+      {
+        vx += dx;
+        vy += dy;
+      }
+      if (!ref_on_board(vx, vy) || !ref_is_enemy(position[vy][vx], side) || (captured >> SQ_INDEX(vx, vy)) & 1)
+        continue;
+      uint32_t taken = captured | 1u << SQ_INDEX(vx, vy);
+      int landing_x[8], landing_y[8], landings = 0;
+      for (int lx = vx + dx, ly = vy + dy;
+           ref_on_board(lx, ly) && (position[ly][lx] == '0' || SQ_INDEX(lx, ly) == from); lx += dx, ly += dy)
+      {
+        landing_x[landings] = lx;
+        landing_y[landings++] = ly;
+        if (!(king && flying))
+          break;
+      }
+      int continued = 0;
+      for (int i = 0; i < landings; i++)
+      {
+        bool reached = !king && landing_y[i] == last_row;
+        if (reached && rules_variant == RULES_AMERICAN)
+          continue;
+        continued += ref_captures(position, side, from, landing_x[i], landing_y[i],
+                                  king || (reached && rules_variant == RULES_RUSSIAN), was_man, taken, list);
+      }
+      if (continued == 0)
+        for (int i = 0; i < landings; i++)
+          ref_add(list, from, SQ_INDEX(landing_x[i], landing_y[i]), taken,
+                  was_man && (king || landing_y[i] == last_row));
+      found += continued > 0 ? continued : landings;
+    }
+  return found;
+}
+
+// Эталонный генератор: все взятия, а если их нет - тихие ходы
+static void ref_generate(char position[8][8], char side, Ref_List *list){
+  list->count = 0;
+  for (int y = 0; y < 8; y++)
+    for (int x = 0; x < 8; x++)
+    {
+      char piece = position[y][x];
+      if ((x + y) % 2 == 1 && (piece == side || piece == side + 2))
+        ref_captures(position, side, SQ_INDEX(x, y), x, y, piece == side + 2, piece == side, 0, list);
+    }
+  if (list->count > 0)
+    return;
+  int forward = side == '1' ? 1 : -1, last_row = side == '1' ? 7 : 0;
+  for (int y = 0; y < 8; y++)
+    for (int x = 0; x < 8; x++)
+    {
+      char piece = position[y][x];
+      if ((x + y) % 2 == 0 || (piece != side && piece != side + 2))
+        continue;
+      bool king = piece == side + 2;
+      for (int dy = -1; dy <= 1; dy += 2)
+        for (int dx = -1; dx <= 1; dx += 2)
+        {
+          if (!king && dy != forward)
+            continue;
+          for (int tx = x + dx, ty = y + dy; ref_on_board(tx, ty) && position[ty][tx] == '0'; tx += dx, ty += dy)
+          {
+            ref_add(list, SQ_INDEX(x, y), SQ_INDEX(tx, ty), 0, !king && ty == last_row);
+            if (!king || rules_variant == RULES_AMERICAN)
+              break;
+          }
+        }
+    }
+}
+
+static void ref_apply(char position[8][8], const Ref_Hod *h){
+  char piece = position[SQ_Y(h->from)][SQ_X(h->from)];
+  position[SQ_Y(h->from)][SQ_X(h->from)] = '0';
+  for (int sq = 0; sq < SQUARES; sq++)
+    if ((h->captured >> sq) & 1)
+      position[SQ_Y(sq)][SQ_X(sq)] = '0';
+  position[SQ_Y(h->to)][SQ_X(h->to)] = h->promotes ? piece + 2 : piece;
+}
+
+static uint64_t ref_perft(char position[8][8], char side, int depth){
+  Ref_List list;
+  ref_generate(position, side, &list);
+  if (depth <= 1)
+    return list.count;
+  uint64_t total = 0;
+  for (int i = 0; i < list.count; i++)
+  {
+    char next[8][8];
+    memcpy(next, position, sizeof(next));
+    ref_apply(next, &list.hods[i]);
+    total += ref_perft(next, side == '1' ? '2' : '1', depth - 1);
+  }
+  return total;
+}
+
+// Печатает позицию расхождения в FEN и останавливает программу
+static void fuzz_fail(char position[8][8], char side, const char *what){
+  fprintf(stderr, "%s, правила %s, позиция %c", what,
+          rules_variant == RULES_RUSSIAN ? "russian" : (rules_variant == RULES_POOL ? "pool" : "american"),
+          side == '2' ? 'W' : 'B');
+  for (int color = 0; color < 2; color++)
+  {
+    char man = color == 0 ? '2' : '1';
+    fprintf(stderr, ":%c", color == 0 ? 'W' : 'B');
+    bool first = true;
+    for (int sq = 0; sq < SQUARES; sq++)
+    {
+      char piece = position[SQ_Y(sq)][SQ_X(sq)];
+      if (piece != man && piece != man + 2)
+        continue;
+      fprintf(stderr, "%s%s%d", first ? "" : ",", piece == man + 2 ? "K" : "", sq + 1);
+      first = false;
+    }
+  }
+  fputc('\n', stderr);
+  abort();
+}
+
+// Сверяет ходы позиции с эталоном, делает и отменяет каждый ход на доске
+// потока. Ходы остаются в list
+static void fuzz_check_position(char position[8][8], char side, Hod_List *list){
+  Ref_List ref;
+  generate_hods(position, side, list);
+  ref_generate(position, side, &ref);
+  if (ref.count > MAX_HODS)
+    fuzz_fail(position, side, "Ходов больше MAX_HODS");
+  if (list->count != ref.count)
+    fuzz_fail(position, side, "Количество ходов не совпадает с эталоном");
+  for (int i = 0; i < list->count; i++)
+  {
+    Hod h = list->hods[i];
+    int j = 0;
+    while (j < ref.count && (ref.hods[j].from != HOD_FROM(h) || ref.hods[j].to != HOD_TO(h) ||
+                             ref.hods[j].captured != list->captured[HOD_CAPTURE(h)]))
+      j++;
+    if (j == ref.count || ref.hods[j].promotes != (HOD_PROMOTES(h) != 0))
+      fuzz_fail(position, side, "Ход не совпадает с эталоном");
+    for (int k = 0; k < i; k++)
+      if (HOD_FROM(list->hods[k]) == HOD_FROM(h) && HOD_TO(list->hods[k]) == HOD_TO(h) &&
+          list->captured[HOD_CAPTURE(list->hods[k])] == list->captured[HOD_CAPTURE(h)])
+        fuzz_fail(position, side, "Ход повторяется в списке");
+  }
+
+  memcpy(lodic, position, sizeof(lodic));
+  count_pieces(lodic, &game_state);
+  history_reset(&game_history, position_hash(lodic, side));
+  GameState state = game_state;
+  for (int i = 0; i < list->count; i++)
+  {
+    char after[8][8];
+    memcpy(after, position, sizeof(after));
+    apply_hod(after, list, list->hods[i]);
+    Hod_Info info = hod_info(list, list->hods[i]);
+    Undo_Record u;
+    make_hod_record(&info, &u);
+    if (memcmp(lodic, after, sizeof(after)) != 0)
+      fuzz_fail(position, side, "make_hod и apply_hod расходятся");
+    GameState counted;
+    count_pieces(lodic, &counted);
+    if (memcmp(&game_state, &counted, sizeof(counted)) != 0 ||
+        HISTORY_AT(&game_history, game_history.count - 1) != position_hash(lodic, side == '1' ? '2' : '1'))
+      fuzz_fail(position, side, "make_hod разошелся с пересчетом хэша или фишек");
+    unmake_hod(&u);
+    if (memcmp(lodic, position, sizeof(lodic)) != 0 || memcmp(&game_state, &state, sizeof(state)) != 0 ||
+        game_history.count != 1)
+      fuzz_fail(position, side, "unmake_hod не восстановил позицию");
+  }
+}
+
+// Позиция из байтов: правила, сторона и 32 клетки. На стороне не больше 12
+// фишек, простая на последней строке становится дамкой
+static size_t fuzz_read_position(const uint8_t *data, size_t size, char position[8][8], char *side){
+  static const char cells[8] = {'0', '0', '0', '0', '1', '2', '3', '4'};
+  if (size < 1 + SQUARES)
+    return 0;
+  static const char *const variants[3] = {"american", "russian", "pool"};
+  select_rules(variants[data[0] % 3]);
+  *side = data[0] & 4 ? '2' : '1';
+  initial_position(position);
+  int pieces[2] = {0, 0};
+  for (int sq = 0; sq < SQUARES; sq++)
+  {
+    char cell = cells[data[1 + sq] & 7];
+    int color = cell == '1' || cell == '3' ? 0 : 1;
+    if (cell != '0' && pieces[color]++ >= 12)
+      cell = '0';
+    if ((cell == '1' && SQ_Y(sq) == 7) || (cell == '2' && SQ_Y(sq) == 0))
+      cell += 2;
+    position[SQ_Y(sq)][SQ_X(sq)] = cell;
+  }
+  return 1 + SQUARES;
+}
+
+static void fuzz_hods(const uint8_t *data, size_t size){
+  char position[8][8], side;
+  size_t used = fuzz_read_position(data, size, position, &side);
+  if (used == 0)
+    return;
+  // Остальные байты выбирают ходы партии из этой позиции
+  for (size_t i = used; ; i++)
+  {
+    Hod_List list;
+    fuzz_check_position(position, side, &list);
+    if (list.count == 0 || i >= size)
+      break;
+    apply_hod(position, &list, list.hods[data[i] % list.count]);
+    side = side == '1' ? '2' : '1';
+  }
+}
+
+static void fuzz_fen(const char *text){
+  char position[8][8], side;
+  if (!parse_fen(text, position, &side))
+    return;
+  // parse_fen не ограничивает число фишек: переполнение списка ходов
+  // допустимо, сверяются только позиции, где все ходы поместились
+  Ref_List ref;
+  ref_generate(position, side, &ref);
+  Hod_List list;
+  if (ref.count <= MAX_HODS)
+    fuzz_check_position(position, side, &list);
+  evaluate_position(position, side);
+  uint32_t masks[4];
+  pack_position(position, masks);
+  evaluate_masks(masks);
+
+  // Мелкий поиск: оценка и порядок ходов на позициях, которых не бывает в партии
+  Search_Options options = search_options;
+  options.depth = 2;
+  options.time_ms = 0;
+  options.max_nodes = 2000;
+  options.threads = 1;
+  Search_Result result;
+  game_history.count = 0;
+  search_position(position, side, &options, &result);
+}
+
+static void fuzz_pdn(const uint8_t *data, size_t size){
+  FILE *in = fmemopen((void *)data, size, "r");
+  if (in == NULL)
+    return;
+  Pdn_Reader reader = {in, false, ""};
+  Pdn_Game game;
+  memset(&game, 0, sizeof(game));
+  while (pdn_read_game(&reader, &game))
+  {
+    // Партия проигрывается так же, как при обучении и разметке
+    char position[8][8], side = '1';
+    if (game.fen[0] != '\0')
+    {
+      if (!parse_fen(game.fen, position, &side))
+        continue;
+    }
+    else
+      initial_position(position);
+    for (int i = 0; i < game.move_count; i++)
+    {
+      Hod_List list;
+      if (generate_hods(position, side, &list) == 0)
+        break;
+      int found = pdn_find_move(game.moves[i], &list);
+      if (found < 0)
+        break;
+      apply_hod(position, &list, list.hods[found]);
+      side = side == '1' ? '2' : '1';
+    }
+  }
+  pdn_free_game(&game);
+  fclose(in);
+}
+
+static void fuzz_input(const uint8_t *data, size_t size){
+  // Байты идут через буфер консоли кусками, как их отдает read
+  Console_Input saved = console_input;
+  memset(&console_input, 0, sizeof(console_input));
+  char start[8][8];
+  initial_position(start);
+  Hod_List list;
+  generate_hods(start, '2', &list);
+  char line[CONSOLE_LINE_SIZE];
+  size_t next = 0;
+  while (true)
+  {
+    size_t room = sizeof(console_input.buffer) - console_input.length;
+    size_t n = size - next < room ? size - next : room;
+    memcpy(console_input.buffer + console_input.length, data + next, n);
+    console_input.length += (int)n;
+    next += n;
+    console_input.eof = next == size;
+    if (!console_take_line(line, sizeof(line)))
+      break;
+    if (strlen(line) == 2)
+    {
+      Position where;
+      if (koordinaty(toupper((unsigned char)line[0]), line[1], &where.x, &where.y, &where.x_8, &where.y_8) &&
+          (where.x_8 < 0 || where.x_8 > 7 || where.y_8 < 0 || where.y_8 > 7 || where.x < 0 || where.x >= SIZE ||
+           where.y < 0 || where.y >= BOARD_SIZE))
+        fuzz_fail(start, '2', "koordinaty вернула клетку вне доски");
+    }
+    console_is_navigation(line);
+    int found = pdn_find_move(line, &list);
+    if (found >= list.count)
+      fuzz_fail(start, '2', "pdn_find_move вернула номер вне списка");
+    if (console_input.eof && console_input.length == 0)
+      break;
+  }
+  console_input = saved;
+}
+
+void fuzz_one(int target, const uint8_t *data, size_t size){
+  int variant = rules_variant;
+  if (target == FUZZ_HODS)
+    fuzz_hods(data, size);
+  else if (target == FUZZ_INPUT)
+    fuzz_input(data, size);
+  else if (target == FUZZ_PDN)
+    fuzz_pdn(data, size);
+  else
+  {
+    // Текст цели FEN заканчивается нулем, как строка командной строки
+    char *text = malloc(size + 1);
+    if (text == NULL)
+      return;
+    memcpy(text, data, size);
+    text[size] = '\0';
+    fuzz_fen(text);
+    free(text);
+  }
+  select_rules(variant == RULES_RUSSIAN ? "russian" : (variant == RULES_POOL ? "pool" : "american"));
+}
+
+#ifdef FUZZ_TARGET
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size){
+  fuzz_one(FUZZ_TARGET, data, size);
+  return 0;
+}
+#endif
+
+// Образцы для мутаций встроенного перебора
+static const char *const fuzz_fen_samples[] = {
+  "W:W21-32:B1-12", "B:WK3,K7,21,22:BK30,1,5", "[FEN \"W:W18,K25:B10,14\"]", "W:WK1,K32,18,14:BK4,K29,11,19,20"};
+static const char *const fuzz_pdn_samples[] = {
+  "[Event \"a\"]\n[Result \"1-0\"]\n1. 11-15 23-19 2. 8-11 22-17 {c} 3. 9-13 (3. 4-8) 17x10 1-0\n",
+  "[FEN \"W:W18,K25:B10,14\"]\n1. 18x9 14-18 2. 25-22 18x25 0-1\n\n[Event \"b\"]\n1. c3-d4 f6-g5 *\n"};
+static const char *const fuzz_input_samples[] = {"b3\n1\nundo\nback 2\r\nC3-D4\n11x18x25\nhint\n", "  A1 \n9\nforward\nh8"};
+static const char fuzz_tokens[] = "0123456789:-xXK,\"[] \n{}()WBabcdefgh*";
+
+static size_t fuzz_mutate(uint8_t *data, size_t size, const uint8_t *other, size_t other_size){
+  int steps = 1 + (int)(rng_next() % 8);
+  for (int s = 0; s < steps; s++)
+  {
+    size_t at = size > 0 ? (size_t)(rng_next() % size) : 0;
+    uint8_t byte = rng_next() % 2 ? (uint8_t)rng_next() : (uint8_t)fuzz_tokens[rng_next() % (sizeof(fuzz_tokens) - 1)];
+    switch (rng_next() % 4)
+    {
+    case 0: // Замена байта
+      if (size > 0)
+        data[at] = byte;
+      break;
+    case 1: // Вставка
+      if (size < FUZZ_MAX_INPUT)
+      {
+        memmove(data + at + 1, data + at, size - at);
+        data[at] = byte;
+        size++;
+      }
+      break;
+    case 2: // Удаление
+      if (size > 0)
+      {
+        memmove(data + at, data + at + 1, size - at - 1);
+        size--;
+      }
+      break;
+    default: // Склейка с куском другого входа
+      if (other_size > 0)
+      {
+        size_t from = (size_t)(rng_next() % other_size);
+        size_t n = 1 + (size_t)(rng_next() % (other_size - from));
+        if (at + n > FUZZ_MAX_INPUT)
+          n = FUZZ_MAX_INPUT - at;
+        memcpy(data + at, other + from, n);
+        if (at + n > size)
+          size = at + n;
+      }
+      break;
+    }
+  }
+  return size;
+}
+
+int run_fuzz(const char *target, uint64_t runs, uint64_t seed){
+  const char *const *samples;
+  int sample_count, id;
+  if (strcmp(target, "fen") == 0)
+  {
+    id = FUZZ_FEN;
+    samples = fuzz_fen_samples;
+    sample_count = sizeof(fuzz_fen_samples) / sizeof(fuzz_fen_samples[0]);
+  }
+  else if (strcmp(target, "pdn") == 0)
+  {
+    id = FUZZ_PDN;
+    samples = fuzz_pdn_samples;
+    sample_count = sizeof(fuzz_pdn_samples) / sizeof(fuzz_pdn_samples[0]);
+  }
+  else if (strcmp(target, "input") == 0)
+  {
+    id = FUZZ_INPUT;
+    samples = fuzz_input_samples;
+    sample_count = sizeof(fuzz_input_samples) / sizeof(fuzz_input_samples[0]);
+  }
+  else if (strcmp(target, "hods") == 0)
+  {
+    id = FUZZ_HODS;
+    samples = NULL;
+    sample_count = 0;
+  }
+  else
+  {
+    printf("Неизвестная цель: %s (fen, pdn, hods, input)\n", target);
+    return 1;
+  }
+
+  uint8_t *data = malloc(FUZZ_MAX_INPUT), *last = malloc(FUZZ_MAX_INPUT);
+  if (data == NULL || last == NULL)
+  {
+    free(data);
+    free(last);
+    return 1;
+  }
+  size_t last_size = 0;
+  struct timespec start, finish;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint64_t run = 0; run < runs; run++)
+  {
+    // Вход - мутация образца или предыдущего входа, чтобы мутации накапливались
+    rng_seed(seed + run);
+    size_t size;
+    if (samples == NULL)
+    {
+      size = 1 + SQUARES + (size_t)(rng_next() % 200);
+      for (size_t i = 0; i < size; i++)
+        data[i] = (uint8_t)rng_next();
+    }
+    else if (last_size > 0 && rng_next() % 2)
+    {
+      memcpy(data, last, last_size);
+      const char *other = samples[rng_next() % sample_count];
+      size = fuzz_mutate(data, last_size, (const uint8_t *)other, strlen(other));
+    }
+    else
+    {
+      const char *sample = samples[rng_next() % sample_count];
+      const char *other = samples[rng_next() % sample_count];
+      size = strlen(sample);
+      memcpy(data, sample, size);
+      size = fuzz_mutate(data, size, (const uint8_t *)other, strlen(other));
+    }
+    memcpy(last, data, size);
+    last_size = size;
+    fuzz_one(id, data, size);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  double seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+  printf("Цель %s: проверено входов %llu за %.1f с, расхождений нет\n", target, (unsigned long long)runs, seconds);
+  free(data);
+  free(last);
+  return 0;
+}
+
+int perft_suite(int depth){
+  // Опубликованные значения perft начальной позиции американских шашек
+  static const uint64_t american_start[] = {7, 49, 302, 1469, 7361, 36768, 179740, 845931, 3963680, 18391564};
+  static const char *const positions[] = {
+    NULL, "W:W21,22,23,25,26,K15:B5,6,9,10,13,K28", "B:WK1,K32,18,14:BK4,K29,11,19,20",
+    "W:W17,18,19,24,27,28:B2,3,10,11,12,14", "W:W25,26,27:BK22,K10,7,8"};
+  static const char *const variants[3] = {"american", "russian", "pool"};
+  int variant = rules_variant, failures = 0;
+  for (int v = 0; v < 3; v++)
+  {
+    select_rules(variants[v]);
+    for (size_t p = 0; p < sizeof(positions) / sizeof(positions[0]); p++)
+    {
+      char position[8][8], side = '2';
+      if (positions[p] == NULL)
+        initial_position(position);
+      else
+        parse_fen(positions[p], position, &side);
+      for (int d = 1; d <= depth; d++)
+      {
+        uint64_t fast = perft(position, side, d), slow = ref_perft(position, side, d);
+        bool ok = fast == slow;
+        if (v == RULES_AMERICAN && positions[p] == NULL && d <= (int)(sizeof(american_start) / sizeof(american_start[0])))
+          ok = ok && fast == american_start[d - 1];
+        if (!ok)
+        {
+          printf("%s %s, глубина %d: perft %llu, эталон %llu\n", variants[v],
+                 positions[p] != NULL ? positions[p] : "начальная позиция", d, (unsigned long long)fast,
+                 (unsigned long long)slow);
+          failures++;
+        }
+      }
+    }
+  }
+  select_rules(variants[variant]);
+  printf(failures == 0 ? "perft совпал с эталоном во всех позициях до глубины %d\n" : "Расхождений perft: %d\n",
+         failures == 0 ? depth : failures);
+  return failures == 0 ? 0 : 1;
+}
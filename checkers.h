@@ -0,0 +1,1300 @@
+/**
+ * @file checkers.h
+ * @brief Типы, константы и функции библиотеки игры в шашки
+ *
+ * Библиотеку собирают все цели: программа main.c, цели libFuzzer и тесты
+ * сборки (см. Makefile).
+ */
+#ifndef CHECKERS_H
+#define CHECKERS_H
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SIZE 35                       /**< Ширина игрового поля в символах */
+#define BOARD_SIZE 18                 /**< Высота игрового поля в символах */
+#define MAX_MOVES 12                  /**< Максимальное количество возможных ходов для анализа */
+#define MAX_HODS 128                  /**< Вместимость списка ходов одной позиции */
+#define RULES_AMERICAN 0              /**< Американские шашки: короткие дамки, простые бьют только вперед */
+#define RULES_RUSSIAN 1               /**< Русские шашки: летающие дамки, превращение во время взятия */
+#define RULES_POOL 2                  /**< Пул: летающие дамки, превращение только в конце хода */
+#define PROMOTE_END_MOVE 0            /**< Дошедшая при взятии фишка становится дамкой, ход окончен */
+#define PROMOTE_CONTINUE_KING 1       /**< Фишка становится дамкой и продолжает бить как дамка */
+#define PROMOTE_AT_END 2              /**< Фишка продолжает бить как простая, дамкой становится в конце */
+#define HOD_ANY_CAPTURE 0xFFFFFFFFu   /**< Для find_hod: подходит ход с любыми взятыми фишками */
+#define SERVER_LINE_SIZE 256          /**< Максимальная длина команды клиента */
+#define CONSOLE_LINE_SIZE 256         /**< Максимальная длина строки консольного ввода */
+#define CONSOLE_HINT_LINES 3          /**< Линий в подсказке консольной партии */
+#define CONSOLE_MOVED 0               /**< Итог хода в консоли: ход сделан */
+#define CONSOLE_NAVIGATE 1            /**< Позиция изменена командой undo, redo, back, forward или play */
+#define CONSOLE_RESIGN 2              /**< Игрок сдался */
+#define CONSOLE_QUIT 3                /**< Ввод закончился или игрок вышел */
+#define SERVER_OUT_SIZE 2048          /**< Размер буфера ответов одной сессии */
+#define SERVER_HINT_LINES 8           /**< Наибольшее N в команде сервера hint N */
+#define SERVER_HINT_PV 24             /**< Полуходов варианта в ответе HINT */
+#define SERVER_HINT_SIZE 1344         /**< Размер готового ответа на hint в сессии */
+#define SERVER_QUEUE_SIZE 1024        /**< Емкость очереди задач пула поиска */
+#define SQUARES 32                    /**< Количество темных (игровых) клеток */
+#define SQ_INDEX(x, y) ((y) * 4 + ((x) >> 1))                       /**< Номер темной клетки 0-31 */
+#define SQ_Y(sq) ((sq) >> 2)                                         /**< Строка логического поля */
+#define SQ_X(sq) (((sq) & 3) * 2 + ((SQ_Y(sq) & 1) == 0))            /**< Столбец логического поля */
+#define CENTER_MASK ((1u << SQ_INDEX(4, 3)) | (1u << SQ_INDEX(3, 4))) /**< Центральные клетки оценки */
+#define MAX_DRAW_MOVES 100            /**< Наибольший предел ходов без взятий и ходов простыми */
+#define HISTORY_SIZE (2 * MAX_DRAW_MOVES + 2) /**< Вместимость истории позиций партии */
+#define HISTORY_AT(h, i) ((h)->hashes[((h)->start + (i)) % HISTORY_SIZE]) /**< i-я позиция истории от самой старой */
+#define MAX_PLY 64                    /**< Наибольшая длина пути поиска в полуходах */
+#define SEARCH_FRAMES (2 * MAX_PLY)   /**< Кадров поиска на поток; ProbCut занимает кадр без нового полухода */
+#define SEARCH_INFINITY 32000         /**< Граница окна поиска */
+#define SEARCH_MATE 30000             /**< Оценка выигрыша; выигрыш на n-м полуходе стоит SEARCH_MATE - n */
+#define PROBCUT_MIN_DEPTH 5           /**< Наименьшая глубина узла, где пробуется ProbCut */
+#define PROBCUT_REDUCTION 4           /**< На сколько мельче предсказывающий поиск ProbCut */
+#define PROBCUT_THRESHOLD 1.5         /**< Запас отсечения ProbCut в стандартных отклонениях */
+#define SELFPLAY_RANDOM_PLIES 4       /**< Случайных полуходов в начале партии самоигры */
+#define MAX_MULTIPV 32                /**< Наибольшее количество линий анализа */
+#define TT_BOUND_UPPER 1              /**< Оценка в таблице - верхняя граница */
+#define TT_BOUND_LOWER 2              /**< Оценка в таблице - нижняя граница */
+#define TT_BOUND_EXACT 3              /**< Оценка в таблице точная */
+#define PDN_LINE_SIZE 4096            /**< Максимальная длина строки файла PDN */
+#define PDN_MOVE_SIZE 32              /**< Максимальная длина записи одного хода PDN */
+#define ANNOTATE_SCORE_CAP 3000       /**< Оценки выигрыша при подсчете потерь обрезаются до этой */
+#define NNUE_FEATURES 128             /**< Входов сети: простые и дамки своей и чужой стороны на 32 клетках */
+#define NNUE_HIDDEN 64                /**< Нейронов первого слоя на каждую сторону */
+#define NNUE_L2 16                    /**< Нейронов второго слоя */
+#define NNUE_QA 127                   /**< Масштаб первого слоя: активация 1.0 = 127 */
+#define NNUE_QB 64                    /**< Масштаб весов второго и третьего слоя */
+#define NNUE_SCALE 400                /**< Оценка в сотых долях простой при выходе сети 1.0 */
+#define NNUE_WDL 200                  /**< Оценка, при которой ожидаемый результат sigmoid(1) */
+#define SPLIT_MIN_DEPTH 4             /**< Наименьшая глубина узла, где поиск делится между потоками */
+#define SPLIT_MAX_PLY 8               /**< Делятся только узлы ближе к корню */
+#define SPLIT_MAX_THREADS 32          /**< Наибольшее количество потоков одного поиска */
+#define SPLIT_CONTEXTS 256            /**< Контекстов поддеревьев у одного поиска */
+#define SPLIT_DEQUE_SIZE 256          /**< Емкость очереди задач потока, степень двойки */
+#define SPLIT_MAX_MASTERS 64          /**< Наибольшее количество одновременных разделяемых поисков */
+#define TREE_DEFAULT_PLY 4            /**< Предел полуходов дерева поиска по умолчанию */
+#define TREE_DEFAULT_NODES 100000     /**< Предел узлов дерева поиска по умолчанию */
+#define DATAGEN_RANDOM_PLIES 8        /**< Случайных полуходов в начале партии генератора позиций */
+#define DATAGEN_INDEX_SECONDS 5       /**< Как часто генератор позиций обновляет индекс */
+#define DATAGEN_DEFAULT_DEDUP_MB 256  /**< Память таблицы повторов генератора по умолчанию */
+#define FUZZ_FEN 0                    /**< Цель fuzz_one: позиция FEN, ходы и оценка разобранной позиции */
+#define FUZZ_PDN 1                    /**< Цель fuzz_one: чтение PDN и проигрывание партий */
+#define FUZZ_HODS 2                   /**< Цель fuzz_one: генератор ходов против эталонного и отмена ходов */
+#define FUZZ_INPUT 3                  /**< Цель fuzz_one: строки консоли, координаты и ходы */
+#define FUZZ_MAX_INPUT 4096           /**< Наибольший вход встроенного перебора --fuzz */
+#define FUZZ_REF_HODS 1024            /**< Вместимость списка эталонного генератора ходов */
+
+
+/**
+ * @struct GameState
+ * @brief Состояние игры для отслеживания количества фишек
+ */
+
+// Структура нужна для отслеживания конца игры
+typedef struct
+{
+  int count_white;         /**< Количество белых фишек */
+  int count_black;         /**< Количество черных фишек */
+  int count_white_king;    /**< Количество белых дамок */
+  int count_black_king;    /**< Количество черных дамок */
+} GameState;
+
+/**
+ * @struct Position
+ * @brief Координаты фишки на поле
+ */
+typedef struct
+{
+  short x;                  /**< Ряд (A,B,C) на графическом поле */
+  short y;                  /**< Строка (1,2,3) на графическом поле */
+  short x_8;                /**< Координата x на логическом поле (0-7) */
+  short y_8;                /**< Координата y на логическом поле (0-7) */
+  bool damka;               /**< Флаг, является ли фишка дамкой */
+} Position;
+
+
+/**
+ * @brief Упакованный ход
+ *
+ * Биты 0-4 - начальное поле, 5-9 - конечное поле (номера SQ_INDEX), 10 -
+ * превращение простой в дамку, 11-18 - номер маски взятых фишек в списке
+ * ходов (0 - ход без взятия). Номер ссылается на список, поэтому ходы можно
+ * переставлять внутри списка, не трогая маски.
+ */
+typedef uint32_t Hod;
+
+#define HOD_PACK(from, to, promotes, capture) \
+  ((Hod)(from) | (Hod)(to) << 5 | (Hod)(promotes) << 10 | (Hod)(capture) << 11) /**< Упаковывает ход */
+#define HOD_FROM(h) ((int)((h) & 31))                                          /**< Начальное поле хода */
+#define HOD_TO(h) ((int)(((h) >> 5) & 31))                                     /**< Конечное поле хода */
+#define HOD_PROMOTES(h) ((int)(((h) >> 10) & 1))                               /**< Ход превращает в дамку */
+#define HOD_CAPTURE(h) ((int)((h) >> 11))                                      /**< Номер маски взятых фишек */
+
+/**
+ * @struct Hod_List
+ * @brief Все допустимые ходы одной стороны
+ *
+ * Выровнен по строке кэша: ходы типичной позиции занимают одну строку.
+ */
+typedef struct
+{
+  _Alignas(64) int count;            /**< Количество ходов */
+  int capture_count;                 /**< Занятых масок взятых фишек, считая нулевую */
+  Hod hods[MAX_HODS];                /**< Упакованные ходы */
+  uint32_t captured[MAX_HODS + 1];   /**< Маски взятых фишек по номерам из ходов; captured[0] = 0 */
+} Hod_List;
+
+/**
+ * @struct Hod_Info
+ * @brief Распакованный ход: координаты и взятые фишки
+ */
+typedef struct
+{
+  short from_x;          /**< Координата x начальной клетки (0-7) */
+  short from_y;          /**< Координата y начальной клетки (0-7) */
+  short to_x;            /**< Координата x конечной клетки (0-7) */
+  short to_y;            /**< Координата y конечной клетки (0-7) */
+  short kills;           /**< Количество взятых фишек */
+  bool promotes;         /**< Простая становится дамкой */
+  uint32_t captured;     /**< Взятые фишки, биты по SQ_INDEX */
+} Hod_Info;
+
+/**
+ * @brief Генератор ходов для выбранных правил
+ * @param lodic Логическое представление доски
+ * @param side Сторона: '1' - фишки сверху (компьютер), '2' - снизу (игрок)
+ * @param[out] list Список ходов; если есть взятия, в нем только взятия
+ * @return Количество ходов
+ */
+typedef int (*Hod_Generator)(char lodic[8][8], char side, Hod_List *list);
+
+/**
+ * @struct PositionBatch
+ * @brief Пакет позиций для массовой оценки в виде структуры массивов
+ *
+ * Каждая позиция задана четырьмя 32-битными масками темных клеток (бит sq
+ * соответствует SQ_INDEX). Сторона "our" - та, для которой считается оценка
+ * (в логической доске это фишки '1' и '3').
+ */
+typedef struct
+{
+  size_t count;            /**< Количество позиций */
+  uint32_t *our_men;       /**< Простые фишки оцениваемой стороны */
+  uint32_t *our_kings;     /**< Дамки оцениваемой стороны */
+  uint32_t *their_men;     /**< Простые фишки противника */
+  uint32_t *their_kings;   /**< Дамки противника */
+  int32_t *scores;         /**< [out] Оценки позиций */
+} PositionBatch;
+
+/**
+ * @struct Piece_Config
+ * @brief Состав фишек позиции для комбинаторной индексации
+ */
+typedef struct
+{
+  short top_men;       /**< Простые фишки, идущие вниз ('1') */
+  short top_kings;     /**< Дамки верхней стороны ('3') */
+  short bottom_men;    /**< Простые фишки, идущие вверх ('2') */
+  short bottom_kings;  /**< Дамки нижней стороны ('4') */
+} Piece_Config;
+
+/**
+ * @struct Game_History
+ * @brief Хэши позиций партии начиная с последнего необратимого хода
+ *
+ * Взятие и ход простой фишкой необратимы: позиции до них больше не могут
+ * повториться, поэтому на таком ходе история начинается заново и ее длина
+ * ограничена правилом ничьей.
+ *
+ * Без предела ходов история может переполниться, тогда самые старые позиции
+ * отбрасываются. Хэши лежат в кольце (позиции читаются через HISTORY_AT),
+ * поэтому отбросить позиции - значит сдвинуть start.
+ */
+typedef struct
+{
+  int start;                       /**< Клетка самой старой позиции, меньше HISTORY_SIZE */
+  int count;                       /**< Количество позиций в истории */
+  uint64_t hashes[HISTORY_SIZE];   /**< Кольцо хэшей */
+} Game_History;
+
+/**
+ * @struct Undo_Record
+ * @brief Все, что нужно, чтобы отменить ход make_hod за постоянное время
+ *
+ * Ход меняет в истории позиций начало, длину и одну клетку кольца, поэтому
+ * запись хранит прежние значения только этих полей, а не копию истории.
+ */
+typedef struct
+{
+  Hod_Info hod;                 /**< Сделанный ход */
+  char piece;                   /**< Фишка на начальной клетке до хода */
+  bool reversible;              /**< Ход не начал историю заново */
+  uint32_t captured_kings;      /**< Какие из взятых фишек были дамками, биты по SQ_INDEX */
+  GameState game_state;         /**< Счетчики фишек до хода */
+  int history_start;            /**< Начало истории до хода */
+  int history_count;            /**< Длина истории до хода */
+  uint64_t history_slot;        /**< Прежнее значение клетки кольца, занятой ходом */
+} Undo_Record;
+
+/**
+ * @struct Search_Options
+ * @brief Ограничения и режимы поиска хода
+ */
+typedef struct
+{
+  int depth;               /**< Наибольшая глубина итеративного углубления */
+  long time_ms;            /**< Время на ход в миллисекундах, 0 - без ограничения */
+  bool pvs;                /**< Не первые ходы проверяются нулевым окном */
+  bool lmr;                /**< Поздние тихие ходы считаются на меньшую глубину */
+  bool probcut;            /**< Узлы отсекаются по предсказанию мелкого поиска */
+  uint64_t max_nodes;      /**< Бюджет узлов на ход, 0 - без ограничения */
+  int threads;             /**< Потоков на одну позицию, 0 и 1 - поиск в вызывающем потоке */
+  const bool *cancel;      /**< Поиск прерывается, когда флаг поднят; NULL - не прерывается */
+} Search_Options;
+
+/**
+ * @struct Probcut_Model
+ * @brief Связь мелкого и глубокого поиска для ProbCut
+ *
+ * Оценка поиска на глубину d приближается как a * v + b, где v - оценка на
+ * глубину d - PROBCUT_REDUCTION; ошибка приближения имеет стандартное
+ * отклонение sigma. Параметры получаются --probcut-calibrate по партиям
+ * самоигры.
+ */
+typedef struct
+{
+  double a;                /**< Наклон */
+  double b;                /**< Сдвиг */
+  double sigma;            /**< Стандартное отклонение ошибки */
+} Probcut_Model;
+
+/**
+ * @struct Search_Move
+ * @brief Ход в главном варианте поиска
+ */
+typedef struct
+{
+  signed char from;        /**< SQ_INDEX начальной клетки, -1 - хода нет */
+  signed char to;          /**< SQ_INDEX конечной клетки */
+  uint32_t captured;       /**< Взятые фишки */
+} Search_Move;
+
+/**
+ * @struct Search_Line
+ * @brief Одна линия анализа: ход, оценка и главный вариант
+ */
+typedef struct
+{
+  Hod_Info move;                  /**< Первый ход линии */
+  int score;                      /**< Оценка для стороны, которая ходит */
+  int pv_length;                  /**< Длина главного варианта */
+  Search_Move pv[MAX_PLY];        /**< Главный вариант, начиная с move */
+} Search_Line;
+
+/**
+ * @struct Search_Result
+ * @brief Итог поиска хода
+ */
+typedef struct
+{
+  Hod_Info best;           /**< Лучший ход */
+  int score;               /**< Оценка для стороны, которая ходит */
+  int depth;               /**< Последняя полностью просчитанная глубина */
+  uint64_t nodes;          /**< Просмотрено позиций */
+  long ms;                 /**< Затраченное время в миллисекундах */
+} Search_Result;
+
+/**
+ * @struct Pdn_Game
+ * @brief Партия, прочитанная из файла PDN
+ */
+typedef struct
+{
+  char *tags;                       /**< Строки тегов как в файле */
+  size_t tags_length;               /**< Длина строк тегов */
+  size_t tags_capacity;             /**< Размер буфера тегов */
+  char fen[128];                    /**< Значение тега FEN или пустая строка */
+  char result[16];                  /**< Результат из записи ходов или пустая строка */
+  int move_count;                   /**< Количество ходов */
+  int move_capacity;                /**< Вместимость массива ходов */
+  char (*moves)[PDN_MOVE_SIZE];     /**< Ходы в записи партии (11-15, 11x18, c3-d4) */
+} Pdn_Game;
+
+/**
+ * @struct Pdn_Reader
+ * @brief Потоковое чтение партий из файла PDN
+ */
+typedef struct
+{
+  FILE *in;                         /**< Входной файл */
+  bool has_line;                    /**< В line уже прочитана строка следующей партии */
+  char line[PDN_LINE_SIZE];         /**< Строка, прочитанная наперед */
+} Pdn_Reader;
+
+/**
+ * @struct Data_Record
+ * @brief Позиция самоигры с оценкой поиска и результатом партии, 16 байт
+ *
+ * Фишки хранятся по занятым клеткам: маска занятых темных клеток и по биту
+ * на каждую занятую клетку в порядке возрастания номера - чья это фишка и
+ * дамка ли она. Больше 24 фишек на доске не бывает.
+ */
+typedef struct
+{
+  uint32_t occupied;                /**< Занятые темные клетки, биты по SQ_INDEX */
+  uint8_t owner[3];                 /**< Бит на занятую клетку: 1 - фишка стороны '2' */
+  uint8_t kings[3];                 /**< Бит на занятую клетку: 1 - дамка */
+  int16_t score;                    /**< Оценка поиска для стороны на ходу */
+  uint8_t flags;                    /**< Бит 0 - ходит '2'; биты 1-2 - результат хода: 0, 1 ничья, 2 */
+  uint8_t depth;                    /**< Глубина поиска */
+  uint16_t ply;                     /**< Полуход партии */
+} Data_Record;
+
+/**
+ * @struct Data_Reader
+ * @brief Потоковое чтение набора позиций самоигры по шардам
+ *
+ * Читаются только записи, учтенные в индексе: хвост шарда, дописанный после
+ * последней записи индекса, пропускается.
+ */
+typedef struct
+{
+  char *dir;                        /**< Каталог набора */
+  int variant;                      /**< Правила набора */
+  int shard_count;                  /**< Шардов в индексе */
+  uint64_t *shard_records;          /**< Записей каждого шарда по индексу */
+  uint64_t *shard_games;            /**< Партий каждого шарда по индексу */
+  int shard;                        /**< Читаемый шард */
+  int fd;                           /**< Файл читаемого шарда или -1 */
+  uint64_t left;                    /**< Осталось прочитать записей шарда */
+  Data_Record *buffer;              /**< Прочитанные записи */
+  size_t buffered;                  /**< Записей в буфере */
+  size_t next;                      /**< Следующая запись буфера */
+  bool failed;                      /**< Чтение прервано ошибкой */
+} Data_Reader;
+
+/**
+ * @struct Session
+ * @brief Игровая сессия серверного режима
+ *
+ * Хранит только то, что нужно для продолжения партии: логическую доску,
+ * счетчики фишек, историю позиций, буферы ввода-вывода и ответ на hint.
+ * Графическое поле в сессии не хранится, поэтому сессия занимает около 5.3 КБ
+ * (история 1.6 КБ, буферы 2.3 КБ, ответ на hint 1.3 КБ).
+ */
+typedef struct Session
+{
+  int fd;                          /**< Сокет клиента, -1 после отключения */
+  char lodic[8][8];                /**< Логическое представление доски партии */
+  GameState game_state;            /**< Счетчики фишек партии */
+  Game_History history;            /**< Позиции партии для правил ничьей */
+  bool player_is_white;            /**< Клиент играет белыми */
+  bool is_player_turn;             /**< Сейчас ход клиента */
+  bool started;                    /**< Партия начата командой new */
+  bool busy;                       /**< Сессия ждет ответа пула поиска */
+  bool computer_moved;             /**< Пул поиска нашел ход компьютера */
+  short hint_lines;                /**< Задача пула - подсказка из стольких линий, 0 - ход компьютера */
+  char computer_hod[8];            /**< Ход компьютера в виде C3-D4 */
+  char hint_reply[SERVER_HINT_SIZE]; /**< Ответ пула поиска на hint, отправляется потоком событий */
+  uint64_t seed;                   /**< Зерно случайности партии */
+  uint64_t rng_state;              /**< Состояние генератора случайных чисел партии */
+  int log_fd;                      /**< Файл журнала партии или -1 */
+  int in_len;                      /**< Заполнено байт во входном буфере */
+  int out_len;                     /**< Заполнено байт в выходном буфере */
+  int out_off;                     /**< Уже отправлено байт выходного буфера */
+  struct Session *next_done;       /**< Очередь сессий с готовым ходом */
+  char in_buf[SERVER_LINE_SIZE];   /**< Входной буфер команд */
+  char out_buf[SERVER_OUT_SIZE];   /**< Выходной буфер ответов */
+} Session;
+
+// Состояние партии хранится отдельно для каждого потока: в серверном режиме
+// рабочие потоки загружают сюда сессию, считают ход и сохраняют ее обратно.
+extern _Thread_local bool is_player_turn;            // Флаг, ход игрока
+extern _Thread_local bool player_is_white;           // Флаг, игрок играет за белых
+extern char player_piece;                            // Фишка игрока
+extern char computer_piece;                          // Фишка компьютера
+extern _Thread_local GameState game_state;           // Состояние поля
+
+// Функции
+/**
+ * @brief Преобразует логические координаты в графические символы
+ * @param i_x Логическая координата x (0-7)
+ * @param i_y Логическая координата y (0-7)
+ * @param[out] x Символьное обозначение столбца (A-H)
+ * @param[out] y Символьное обозначение строки (1-8)
+ * @return true если преобразование успешно, false в противном случае
+ */
+bool reverse_graph_out_koordinaty(short i_x, short i_y, char *x, char *y);
+
+/**
+ * @brief Очищает фишку на графическом поле
+ * @param board Игровое поле
+ * @param x Координата x на графическом поле
+ * @param y Координата y на графическом поле
+ */
+void wash_piece(char board[BOARD_SIZE][SIZE + 1], short x, short y);
+
+/**
+ * @brief Преобразует логические координаты в графические
+ * @param i_x Логическая координата x (0-7)
+ * @param i_y Логическая координата y (0-7)
+ * @param[out] x Графическая координата x
+ * @param[out] y Графическая координата y
+ */
+void reverse_graph_koordinaty(short i_x, short i_y, short *x, short *y);
+
+/**
+ * @brief Инициализирует начальное расположение фишек
+ * @param board Игровое поле
+ * @param white_on_bottom Флаг, белые фишки внизу
+ */
+void setup_pieces(char board[BOARD_SIZE][SIZE + 1], bool white_on_bottom);
+
+/**
+ * @brief Инициализирует пустое игровое поле
+ * @param board Игровое поле
+ */
+void initialize_board(char board[BOARD_SIZE][SIZE + 1]);
+
+/**
+ * @brief Выводит игровое поле в консоль
+ * @param board Игровое поле
+ */
+void print_board(const char board[BOARD_SIZE][SIZE + 1]);
+
+/**
+ * @brief Основной игровой цикл
+ * @param board Игровое поле
+ */
+void play_game(char board[BOARD_SIZE][SIZE + 1]);
+
+/**
+ * @brief Подсвечивает выбранную фишку
+ * @param x Координата x на графическом поле
+ * @param y Координата y на графическом поле
+ * @param board Игровое поле
+ */
+void highlight_piece(short x, short y, char board[BOARD_SIZE][SIZE + 1]);
+
+/**
+ * @brief Выводит информацию о текущем ходе
+ */
+void print_turn();
+
+/**
+ * @brief Проверяет условие окончания игры
+ * @return true если игра окончена, false в противном случае
+ */
+bool check_game_over();
+
+/**
+ * @brief Меняет текущего игрока
+ */
+void switch_turn();
+
+/**
+ * @brief Обрабатывает ход игрока
+ *
+ * Кроме выбора фишки и хода принимает команды hint, undo, redo, back,
+ * forward, play, resign и quit. Подсказка считается в потоке поиска и
+ * прерывается следующей строкой ввода. В анализе и после конца партии
+ * принимаются только команды.
+ * @param board Игровое поле
+ * @return CONSOLE_MOVED, CONSOLE_NAVIGATE, CONSOLE_RESIGN или CONSOLE_QUIT
+ */
+int player_move(char board[BOARD_SIZE][SIZE + 1]);
+
+/**
+ * @brief Делает ход компьютера, принимая команды игрока во время поиска
+ *
+ * Поиск идет в отдельном потоке. Команда move прерывает его, и компьютер
+ * играет лучший ход последней законченной итерации; команды перехода по
+ * партии (undo, back и другие) прерывают поиск без хода. Строки, которые
+ * не являются командами, остаются в буфере ввода до хода игрока.
+ * @param board Игровое поле
+ * @param[out] forced Ход сделан по прерванному поиску
+ * @return CONSOLE_MOVED, CONSOLE_NAVIGATE, CONSOLE_RESIGN или CONSOLE_QUIT
+ */
+int computer_think(char board[BOARD_SIZE][SIZE + 1], bool *forced);
+
+/**
+ * @brief Читает строку консоли
+ *
+ * Консольная партия читает стандартный ввод напрямую через poll, минуя
+ * буфер stdio, поэтому все строки партии читаются этой функцией.
+ * @param[out] line Строка без перевода строки и пробелов по краям
+ * @param size Размер буфера строки
+ * @return false в конце ввода
+ */
+bool console_read_line(char *line, size_t size);
+
+/**
+ * @brief Преобразует символьные координаты в числовые
+ * @param x Символьное обозначение столбца (A-H)
+ * @param y Символьное обозначение строки (1-8)
+ * @param[out] i_x Графическая координата x
+ * @param[out] i_y Графическая координата y
+ * @param[out] i_x_8 Логическая координата x (0-7)
+ * @param[out] i_y_8 Логическая координата y (0-7)
+ * @return true если преобразование успешно, false в противном случае
+ */
+bool koordinaty(char x, char y, short *i_x, short *i_y, short *i_x_8, short *i_y_8);
+
+/**
+ * @brief Подсвечивает возможные ходы
+ * @param board Игровое поле
+ * @param x Координата x на графическом поле
+ * @param y Координата y на графическом поле
+ * @param not_chose Флаг выбора
+ */
+void light(char board[BOARD_SIZE][SIZE + 1], short x, short y, bool not_chose);
+
+/**
+ * @brief Обрабатывает ход компьютера
+ * @param board Игровое поле
+ * @return true если ход выполнен успешно, false в противном случае
+ */
+bool computer_move(char board[BOARD_SIZE][SIZE + 1]);
+
+/**
+ * @brief Выбирает ход компьютера, не изменяя текущую доску
+ *
+ * Ход ищется search_position с ограничениями search_options. Порядок
+ * корневых ходов перемешивается генератором случайных чисел потока, поэтому
+ * при ограничении по глубине решение зависит только от позиции и зерна.
+ * @param[out] best Лучший ход
+ * @return Оценка лучшего хода или -SEARCH_INFINITY, если ходов нет
+ */
+int computer_best_move(Hod_Info *best);
+
+/**
+ * @brief Ищет лучший ход альфа-бета поиском с итеративным углублением
+ *
+ * Не первые ходы проверяются нулевым окном с пересчетом при улучшении
+ * альфы (PVS), поздние тихие ходы считаются с сокращенной глубиной и
+ * пересчитываются на полную глубину, если сокращенный поиск поднял альфу
+ * (LMR). С ProbCut узлы вне главного варианта отсекаются, если мелкий
+ * поиск с нулевым окном уверенно предсказывает выход за окно. Повторения
+ * ищутся по пути поиска и по game_history потока. С options->threads > 1
+ * узлы главного варианта у корня делятся между потоками общего пула;
+ * результат от количества потоков не зависит.
+ * @param lodic Логическое представление доски
+ * @param side Сторона, которая ходит: '1' или '2'
+ * @param options Ограничения поиска
+ * @param[out] result Лучший ход, оценка и статистика
+ * @return true если ход найден, false если ходов нет
+ */
+bool search_position(char lodic[8][8], char side, const Search_Options *options, Search_Result *result);
+
+/**
+ * @brief Ищет несколько лучших ходов с оценками и главными вариантами
+ *
+ * На каждой глубине линии ищутся по очереди: следующая линия - лучший ход
+ * среди еще не выбранных. Таблица переходов общая, поэтому каждая следующая
+ * линия почти целиком берет оценки из нее, а не считается заново.
+ * @param lodic Логическое представление доски
+ * @param side Сторона, которая ходит: '1' или '2'
+ * @param options Ограничения поиска
+ * @param lines Количество линий (не больше MAX_MULTIPV)
+ * @param[out] out Линии от лучшей к худшей
+ * @param[out] result Лучший ход, оценка и статистика
+ * @return Количество найденных линий, 0 если ходов нет
+ */
+int search_multipv(char lodic[8][8], char side, const Search_Options *options, int lines, Search_Line *out,
+                   Search_Result *result);
+
+/**
+ * @brief Записывает ход главного варианта в виде C3-D4 или C3:E5
+ * @param m Ход
+ * @param[out] out Буфер для записи хода (не меньше 6 байт)
+ */
+void format_search_move(Search_Move m, char *out);
+
+/**
+ * @brief Разбирает позицию в формате FEN из PDN
+ *
+ * Принимается строка вида W:W21,22,K30:B1-12 или тег [FEN "..."]. Номера
+ * полей стандартные: черные начинают на полях 1-12 (фишки '1' сверху),
+ * белые на 21-32 (фишки '2' снизу), K обозначает дамку.
+ * @param text Текст позиции
+ * @param[out] lodic Логическое представление доски
+ * @param[out] side Сторона, которая ходит: '1' - черные, '2' - белые
+ * @return true если позиция разобрана, false в противном случае
+ */
+bool parse_fen(const char *text, char lodic[8][8], char *side);
+
+/**
+ * @brief Печатает несколько лучших ходов позиции
+ * @param fen Позиция в формате FEN
+ * @param lines Количество линий
+ * @return Код завершения программы
+ */
+int analyze_position(const char *fen, int lines);
+
+/**
+ * @brief Читает следующую партию из файла PDN
+ *
+ * Комментарии {...}, варианты (...) и номера ходов пропускаются. Партия
+ * заканчивается результатом или тегами следующей партии.
+ * @param reader Читатель файла
+ * @param[out] game Партия; буферы переиспользуются между вызовами
+ * @return true если партия прочитана, false в конце файла
+ */
+bool pdn_read_game(Pdn_Reader *reader, Pdn_Game *game);
+
+/**
+ * @brief Освобождает буферы партии
+ * @param game Партия
+ */
+void pdn_free_game(Pdn_Game *game);
+
+/**
+ * @brief Находит ход записи PDN среди допустимых ходов
+ * @param text Ход: номера полей (11-15, 11x18x25) или клетки (c3-d4, c3:e5:g3)
+ * @param list Допустимые ходы позиции
+ * @return Номер хода в списке или -1
+ */
+int pdn_find_move(const char *text, const Hod_List *list);
+
+/**
+ * @brief Размечает ошибки во всех партиях файла PDN
+ *
+ * Каждая позиция партии считается поиском с ограничениями search_options;
+ * ход помечается, если он теряет больше threshold по сравнению с лучшим.
+ * Партии считаются в threads потоках, у каждого своя таблица переходов,
+ * результат пишется в порядке партий во входном файле.
+ * @param input Входной файл PDN ("-" - стандартный ввод)
+ * @param output Выходной файл ("-" - стандартный вывод)
+ * @param json true - JSON по строке на партию, false - PDN с комментариями
+ * @param threshold Порог потери в сотых долях простой
+ * @param threads Количество потоков (0 - по числу процессоров)
+ * @return Код завершения программы
+ */
+int annotate_pdn(const char *input, const char *output, bool json, int threshold, int threads);
+
+/**
+ * @brief Подключает общую таблицу переходов в разделяемой памяти POSIX
+ *
+ * Первый процесс создает объект name размером size_mb, остальные
+ * подключаются к нему с тем размером, который уже есть. После подключения
+ * все потоки процесса ищут в этой таблице вместо своих.
+ * @param name Имя объекта, например "/checkers-tt"
+ * @param size_mb Размер таблицы при создании в МБ
+ * @return true, если таблица подключена
+ */
+bool shared_tt_open(const char *name, int size_mb);
+
+/**
+ * @brief Удаляет объект общей таблицы; подключенные процессы продолжают работать
+ * @param name Имя объекта
+ * @return true, если объект удален
+ */
+bool shared_tt_unlink(const char *name);
+
+/**
+ * @brief Загружает кэш анализа с диска и включает запись новых результатов
+ *
+ * Файл отображается в память только для чтения; поиск берет из него
+ * результаты глубиной от CACHE_MIN_DEPTH. Отсутствующий файл - пустой кэш.
+ * @param path Путь к файлу кэша
+ * @return true, если файл загружен или его еще нет
+ */
+bool disk_cache_open(const char *path);
+
+/**
+ * @brief Добавляет глубокие результаты этого запуска в файл кэша
+ *
+ * Файл переписывается целиком через временный и rename, поэтому процессы,
+ * читающие старый файл, не ломаются. Вызывается при выходе через atexit.
+ */
+void disk_cache_save(void);
+
+/**
+ * @brief Сливает файлы кэша в один, из повторов остается самый глубокий
+ * @param output Выходной файл, может совпадать с одним из входных
+ * @param inputs Входные файлы
+ * @param count Количество входных файлов
+ * @return Код завершения программы
+ */
+int disk_cache_merge(const char *output, char **inputs, int count);
+
+/**
+ * @brief Начинает запись дерева поиска в файл
+ *
+ * Дерево пишет поток, первым начавший поиск: узлы не глубже max_ply, пока
+ * записано меньше max_nodes узлов. Файл дописывается при выходе через
+ * atexit(tree_dump_close).
+ * @param path Файл дерева
+ * @param max_ply Наибольший полуход записываемых узлов
+ * @param max_nodes Предел записанных узлов
+ * @return true, если файл создан
+ */
+bool tree_dump_open(const char *path, int max_ply, uint64_t max_nodes);
+
+/**
+ * @brief Дописывает в файл дерева оставшиеся узлы и закрывает его
+ */
+void tree_dump_close(void);
+
+/**
+ * @brief Переводит дерево поиска в DOT или JSON
+ *
+ * Формат выбирается по расширению выходного файла: .dot для Graphviz,
+ * .json - массив поисков, у каждого вложенное дерево узлов.
+ * @param input Файл, записанный --tree-dump
+ * @param output Выходной файл .dot или .json
+ * @return Код завершения программы
+ */
+int tree_dump_convert(const char *input, const char *output);
+
+/**
+ * @brief Загружает веса нейросетевой оценки
+ *
+ * После загрузки evaluate_position и листья поиска считаются сетью, без нее
+ * остается ручная оценка evaluate_masks.
+ * @param path Файл весов, записанный nnue_train
+ * @return true, если веса загружены
+ */
+bool nnue_load(const char *path);
+
+/**
+ * @brief Обучает нейросетевую оценку по партиям PDN и записывает веса
+ *
+ * Из партий берутся позиции без взятий. Цель позиции - смесь результата
+ * партии и ручной оценки (для набора --datagen - оценки поиска), сеть
+ * учится в плавающей точке и квантуется при записи; печатается ошибка на
+ * отложенных 10% позиций для сети и для ручной оценки.
+ * @param output Файл весов
+ * @param inputs Файлы PDN или каталоги наборов --datagen
+ * @param count Количество файлов
+ * @param epochs Проходов по позициям
+ * @param seed Зерно начальных весов и порядка позиций
+ * @return Код завершения программы
+ */
+int nnue_train(const char *output, char **inputs, int count, int epochs, uint64_t seed);
+
+/**
+ * @brief Симметричная оценка позиции для стороны, которая ходит
+ * @param lodic Логическое представление доски
+ * @param side Сторона, для которой считается оценка: '1' или '2'
+ * @return Оценка в сотых долях простой фишки
+ */
+int evaluate_position(char lodic[8][8], char side);
+
+/**
+ * @brief Статическая оценка позиции по маскам темных клеток
+ *
+ * Простая 100, дамка 150, продвижение простой 4 за строку, простая на своей
+ * первой строке 10, фигура в центре 20, простая со свободным путем в дамки
+ * EVAL_RUNAWAY.
+ * @param masks Маски в порядке pack_position
+ * @return Оценка для стороны '1' - '3'
+ */
+int evaluate_masks(const uint32_t masks[4]);
+
+/**
+ * @brief Замеряет глубину, достигаемую поиском за фиксированное время
+ *
+ * Одни и те же позиции считаются обычным альфа-бета поиском, с PVS, с
+ * PVS и LMR и дополнительно с ProbCut.
+ * @param time_ms Время на позицию в миллисекундах
+ */
+void bench_search(long time_ms);
+
+/**
+ * @brief Замеряет ускорение разделяемого поиска
+ *
+ * Позиции bench_search считаются до одной глубины в 1 (обычный поиск),
+ * 2, 4, 8, 16 и 32 потоках. Печатаются время, узлы, ускорение к одному
+ * потоку и совпадение ходов, оценок и узлов с поиском в двух потоках.
+ * @param depth Глубина поиска
+ */
+void bench_threads(int depth);
+
+/**
+ * @brief Играет партии между двумя настройками поиска
+ *
+ * Каждое начало (SELFPLAY_RANDOM_PLIES случайных полуходов по зерну)
+ * играется дважды со сменой цветов. Партии делятся между потоками.
+ * @param games Количество партий (округляется вверх до четного)
+ * @param first Настройки первого игрока
+ * @param second Настройки второго игрока
+ * @param threads Количество потоков (0 - по числу процессоров)
+ * @param seed Зерно начал партий
+ * @param pdn_path Файл, куда партии записываются в PDN по порядку, или NULL
+ */
+void run_selfplay(int games, const Search_Options *first, const Search_Options *second, int threads, uint64_t seed,
+                  const char *pdn_path);
+
+/**
+ * @brief Подбирает модель ProbCut по позициям из партий самоигры
+ *
+ * В каждой позиции без взятий сравниваются оценки поиска на глубину
+ * PROBCUT_MIN_DEPTH + 1 и на PROBCUT_REDUCTION меньше, параметры находятся
+ * линейной регрессией и записываются в probcut_model.
+ * @param games Количество партий
+ * @param threads Количество потоков (0 - по числу процессоров)
+ * @param seed Зерно начал партий
+ */
+void calibrate_probcut(int games, int threads, uint64_t seed);
+
+/**
+ * @brief Пишет позиции самоигры для обучения оценки
+ *
+ * Потоки играют партии со случайными началами (DATAGEN_RANDOM_PLIES
+ * полуходов) и поиском search_options. Позиции без взятий с оценкой поиска
+ * и результатом партии дописываются в свой шард каждого потока; повторы
+ * позиций, в том числе уже записанных в каталог раньше, отбрасываются по
+ * хэшу. Индекс обновляется раз в DATAGEN_INDEX_SECONDS секунд и в конце.
+ * @param dir Каталог набора (создается при необходимости)
+ * @param positions Сколько новых позиций записать
+ * @param threads Количество потоков (0 - по числу процессоров)
+ * @param seed Зерно начал партий
+ * @param dedup_mb Память таблицы повторов в МБ
+ * @return 0 при успехе, иначе код ошибки
+ */
+int run_datagen(const char *dir, uint64_t positions, int threads, uint64_t seed, int dedup_mb);
+
+/**
+ * @brief Открывает набор позиций самоигры для чтения
+ * @param[out] r Читатель
+ * @param dir Каталог набора
+ * @return false, если индекс не прочитан
+ */
+bool data_reader_open(Data_Reader *r, const char *dir);
+
+/**
+ * @brief Читает следующую позицию набора
+ * @param r Читатель
+ * @param[out] out Запись
+ * @return false в конце набора или при ошибке (тогда поднят r->failed)
+ */
+bool data_reader_next(Data_Reader *r, Data_Record *out);
+
+/**
+ * @brief Закрывает набор позиций
+ * @param r Читатель
+ */
+void data_reader_close(Data_Reader *r);
+
+/**
+ * @brief Распаковывает позицию записи в маски pack_position
+ * @param rec Запись
+ * @param[out] masks Маски: простые '1', дамки '3', простые '2', дамки '4'
+ */
+void data_record_unpack(const Data_Record *rec, uint32_t masks[4]);
+
+/**
+ * @brief Печатает состав набора позиций, читая его целиком
+ * @param dir Каталог набора
+ * @return 0 при успехе, иначе код ошибки
+ */
+int data_info(const char *dir);
+
+/**
+ * @brief Проверяет разбор ввода и генератор ходов на одном входе
+ *
+ * Вход произвольный: для FUZZ_HODS из него строится позиция и
+ * последовательность ходов, остальные цели разбирают его как текст. Ходы
+ * каждой позиции сверяются с медленным эталонным генератором, каждый ход
+ * делается и отменяется. При расхождении печатает позицию и вызывает
+ * abort(), так что вход сохраняют libFuzzer и санитайзеры.
+ * @param target FUZZ_FEN, FUZZ_PDN, FUZZ_HODS или FUZZ_INPUT
+ * @param data Вход
+ * @param size Длина входа
+ */
+void fuzz_one(int target, const uint8_t *data, size_t size);
+
+/**
+ * @brief Встроенный перебор случайных входов для сборок без libFuzzer
+ *
+ * Входы - мутации небольшого набора правильных образцов цели: замена,
+ * вставка и удаление байтов, склейка двух входов.
+ * @param target Имя цели: fen, pdn, hods или input
+ * @param runs Количество входов
+ * @param seed Зерно мутаций
+ * @return Код завершения программы
+ */
+int run_fuzz(const char *target, uint64_t runs, uint64_t seed);
+
+/**
+ * @brief Считает perft набора позиций всех правил и сверяет с эталоном
+ *
+ * Для каждой позиции perft генератора ходов сравнивается с perft
+ * эталонного генератора, для начальной позиции американских шашек - еще и с
+ * опубликованными значениями. Для прогона в сборках с ASan и UBSan.
+ * @param depth Наибольшая глубина
+ * @return 0, если все совпало
+ */
+int perft_suite(int depth);
+
+/**
+ * @brief Записывает заголовок журнала партии
+ * @param fd Файл журнала (-1 - журнал не ведется)
+ * @param seed Зерно партии
+ * @param player_white Игрок играет белыми
+ */
+void replay_write_header(int fd, uint64_t seed, bool player_white);
+
+/**
+ * @brief Оценивает текущее состояние доски для компьютера
+ * @param lodic Логическое представление доски
+ * @param is_white Флаг, играет ли компьютер белыми
+ * @return Оценка состояния доски
+ */
+int evaluate_board_pc(char lodic[8][8], bool is_white);
+
+/**
+ * @brief Генераторы ходов для каждого варианта правил
+ *
+ * Собираются из одного шаблона с правилами-константами, поэтому внутри
+ * цикла генерации нет проверок варианта.
+ */
+int generate_hods_american(char lodic[8][8], char side, Hod_List *list);
+int generate_hods_russian(char lodic[8][8], char side, Hod_List *list);
+int generate_hods_pool(char lodic[8][8], char side, Hod_List *list);
+
+/**
+ * @brief Выбирает правила игры
+ * @param name Название: american, russian или pool
+ * @return true если правила найдены, false в противном случае
+ */
+bool select_rules(const char *name);
+
+/**
+ * @brief Расставляет фишки в начальную позицию
+ * @param[out] lodic Логическое представление доски
+ */
+void initial_position(char lodic[8][8]);
+
+/**
+ * @brief Пересчитывает количество фишек по доске
+ * @param lodic Логическое представление доски
+ * @param[out] gs Состояние игры
+ */
+void count_pieces(char lodic[8][8], GameState *gs);
+
+/**
+ * @brief Считает количество позиций на заданной глубине (perft)
+ * @param lodic Логическое представление доски
+ * @param side Сторона, которая ходит
+ * @param depth Глубина
+ * @return Количество листовых позиций
+ */
+uint64_t perft(char lodic[8][8], char side, int depth);
+
+/**
+ * @brief Определяет исход партии для стороны, которая сейчас ходит
+ *
+ * Партия проиграна стороной без фишек или без допустимых ходов. Ничья
+ * наступает при третьем повторении позиции и после draw_moves ходов каждой
+ * стороны без взятий и ходов простыми фишками.
+ * @return 0 если игра продолжается, 1 если победили белые, 2 если победили черные, 3 если ничья
+ */
+int game_result();
+
+/**
+ * @brief Выполняет ход на текущей доске
+ *
+ * Единая точка изменения партии: обновляет доску, счетчики фишек,
+ * историю позиций и последний ход.
+ * @param h Допустимый ход из генератора
+ */
+void make_hod(const Hod_Info *h);
+
+/**
+ * @brief Выполняет ход, как make_hod, и записывает, как его отменить
+ * @param h Допустимый ход из генератора
+ * @param[out] u Запись для unmake_hod; может совпадать с записью, из которой взят h
+ */
+void make_hod_record(const Hod_Info *h, Undo_Record *u);
+
+/**
+ * @brief Отменяет последний ход, сделанный make_hod_record
+ *
+ * Восстанавливает доску, счетчики фишек и историю позиций, не пересчитывая
+ * их. Отменять можно только в обратном порядке.
+ * @param u Запись хода
+ */
+void unmake_hod(const Undo_Record *u);
+
+/**
+ * @brief Считает хэш Зобриста позиции
+ * @param lodic Логическое представление доски
+ * @param side Сторона, которая ходит: '1' или '2'
+ * @return 64-битный хэш
+ */
+uint64_t position_hash(char lodic[8][8], char side);
+
+/**
+ * @brief Проверяет, можно ли после хода повторить предыдущие позиции
+ * @param lodic Логическое представление доски до хода
+ * @param h Ход
+ * @return true для хода дамкой без взятий
+ */
+bool hod_is_reversible(char lodic[8][8], const Hod_Info *h);
+
+/**
+ * @brief Начинает историю с одной позиции
+ * @param h История позиций
+ * @param hash Хэш начальной позиции
+ */
+void history_reset(Game_History *h, uint64_t hash);
+
+/**
+ * @brief Добавляет позицию после хода в историю
+ * @param h История позиций
+ * @param hash Хэш позиции после хода
+ * @param reversible Ход обратим (см. hod_is_reversible)
+ */
+void history_push(Game_History *h, uint64_t hash, bool reversible);
+
+/**
+ * @brief Считает, сколько раз позиция встречалась в истории
+ * @param h История позиций
+ * @param hash Хэш позиции
+ * @return Количество вхождений
+ */
+int history_repetitions(const Game_History *h, uint64_t hash);
+
+/**
+ * @brief Проверяет, закончится ли партия ничьей после хода, не добавляя его
+ *
+ * Используется поиском: история не копируется и не изменяется.
+ * @param h История позиций до хода
+ * @param hash Хэш позиции после хода
+ * @param reversible Ход обратим
+ * @return 0 - нет ничьей, 1 - третье повторение, 2 - нет прогресса draw_moves ходов
+ */
+int history_draw_after(const Game_History *h, uint64_t hash, bool reversible);
+
+/**
+ * @brief Проверяет, наступила ли ничья в текущей позиции истории
+ * @param h История позиций
+ * @return 0 - нет ничьей, 1 - третье повторение, 2 - нет прогресса draw_moves ходов
+ */
+int history_draw(const Game_History *h);
+
+/**
+ * @brief Возвращает символ графического поля для клетки логической доски
+ * @param cell Клетка логической доски
+ * @param white_on_bottom Флаг, белые фишки внизу (игрок играет белыми)
+ * @return Символ фишки для вывода
+ */
+char piece_symbol(char cell, bool white_on_bottom);
+
+/**
+ * @brief Записывает компактное текстовое представление логической доски
+ * @param lodic Логическое представление доски
+ * @param white_on_bottom Флаг, белые фишки внизу
+ * @param[out] out Буфер для текста (не меньше 256 байт)
+ * @return Количество записанных символов
+ */
+int format_position(char lodic[8][8], bool white_on_bottom, char *out);
+
+/**
+ * @brief Выполняет ход игрока без диалога с пользователем
+ *
+ * Проверяет обязательное взятие и допустимость хода. Для серии взятий
+ * указывается клетка, на которой фишка заканчивает ход.
+ * @param from_x Логическая координата x фишки (0-7)
+ * @param from_y Логическая координата y фишки (0-7)
+ * @param to_x Логическая координата x клетки назначения (0-7)
+ * @param to_y Логическая координата y клетки назначения (0-7)
+ * @param captured Маска взятых фишек или HOD_ANY_CAPTURE
+ * @return true если ход допустим и выполнен, false в противном случае
+ */
+bool apply_player_move(short from_x, short from_y, short to_x, short to_y, uint32_t captured);
+
+/**
+ * @brief Записывает ход в виде C3-D4 (тихий ход) или C3:E5 (взятие)
+ * @param h Ход
+ * @param[out] out Буфер для записи хода (не меньше 6 байт)
+ */
+void format_hod(const Hod_Info *h, char *out);
+
+/**
+ * @brief Ищет ход в списке
+ * @param list Список ходов
+ * @param from_x Логическая координата x начальной клетки
+ * @param from_y Логическая координата y начальной клетки
+ * @param to_x Логическая координата x конечной клетки
+ * @param to_y Логическая координата y конечной клетки
+ * @param captured Маска взятых фишек или HOD_ANY_CAPTURE
+ * @return Номер хода в списке или -1, если ход не найден
+ */
+int find_hod(const Hod_List *list, short from_x, short from_y, short to_x, short to_y, uint32_t captured);
+
+/**
+ * @brief Распаковывает ход из списка
+ * @param list Список, из которого взят ход
+ * @param h Упакованный ход
+ * @return Координаты и взятые фишки хода
+ */
+Hod_Info hod_info(const Hod_List *list, Hod h);
+
+/**
+ * @brief Делает ход на доске: снимает взятые фишки и переставляет ходящую
+ * @param lodic Логическое представление доски до хода; заменяется доской после хода
+ * @param list Список, из которого взят ход
+ * @param h Упакованный ход
+ */
+void apply_hod(char lodic[8][8], const Hod_List *list, Hod h);
+
+/**
+ * @brief Задает зерно генератора случайных чисел текущего потока
+ * @param seed Зерно
+ */
+void rng_seed(uint64_t seed);
+
+/**
+ * @brief Следующее случайное число генератора текущего потока (splitmix64)
+ * @return Случайное 64-битное число
+ */
+uint64_t rng_next();
+
+/**
+ * @brief Пишет строку в журнал партии
+ * @param fd Файл журнала (-1 - журнал не ведется)
+ * @param fmt Формат строки как у printf
+ */
+void replay_write(int fd, const char *fmt, ...);
+
+/**
+ * @brief Записывает ход в журнал партии
+ * @param fd Файл журнала (-1 - журнал не ведется)
+ * @param who "player", "computer" или "forced" (ход компьютера по прерванному поиску)
+ * @param h Ход
+ * @param ms Время на ход в миллисекундах
+ */
+void replay_write_hod(int fd, const char *who, const Hod_Info *h, long ms);
+
+/**
+ * @brief Воспроизводит партию по журналу и сверяет ходы компьютера
+ * @param path Путь к журналу
+ * @return 0 если все ходы совпали, иначе код ошибки
+ */
+int replay_game(const char *path);
+
+/**
+ * @brief Упаковывает логическую доску в маски темных клеток
+ * @param lodic Логическое представление доски
+ * @param[out] masks Маски: простые '1', дамки '3', простые '2', дамки '4'
+ */
+void pack_position(char lodic[8][8], uint32_t masks[4]);
+
+/**
+ * @brief Восстанавливает логическую доску по маскам темных клеток
+ * @param masks Маски в порядке pack_position
+ * @param[out] lodic Логическое представление доски
+ */
+void unpack_position(const uint32_t masks[4], char lodic[8][8]);
+
+/**
+ * @brief Оценивает пакет позиций
+ *
+ * При depth == 0 считается статическая оценка evaluate_masks векторным
+ * ядром, лучшим из поддерживаемых процессором. При depth > 0 каждая
+ * позиция считается search_position на глубину depth за сторону "our",
+ * -SEARCH_INFINITY если ходов нет. Пакет делится между threads потоками.
+ * @param batch Пакет позиций, результат пишется в batch->scores
+ * @param depth Глубина: 0 - статическая оценка, больше 0 - глубина поиска
+ * @param threads Количество потоков (0 - по числу процессоров)
+ */
+void evaluate_batch(PositionBatch *batch, int depth, int threads);
+
+/**
+ * @brief Замеряет скорость статической пакетной оценки
+ * @param count Размер пакета
+ * @param threads Количество потоков (0 - по числу процессоров)
+ * @return true, если все ядра и evaluate_position совпали со скалярной оценкой
+ */
+bool bench_evaluate_batch(size_t count, int threads);
+
+/**
+ * @brief Определяет состав фишек позиции
+ * @param masks Маски в порядке pack_position
+ * @param[out] cfg Состав фишек
+ */
+void piece_config_of(const uint32_t masks[4], Piece_Config *cfg);
+
+/**
+ * @brief Количество различных расстановок с данным составом фишек
+ *
+ * Простые фишки не могут стоять на своей строке превращения, поэтому
+ * индекс плотный: каждое число от 0 до размера соответствует ровно одной
+ * допустимой расстановке.
+ * @param cfg Состав фишек
+ * @return Размер индекса
+ */
+uint64_t position_index_size(const Piece_Config *cfg);
+
+/**
+ * @brief Переводит расстановку в плотный индекс внутри ее состава фишек
+ * @param masks Маски в порядке pack_position
+ * @return Индекс или UINT64_MAX, если простая фишка стоит на строке превращения
+ */
+uint64_t position_index(const uint32_t masks[4]);
+
+/**
+ * @brief Восстанавливает расстановку по индексу
+ * @param cfg Состав фишек
+ * @param index Индекс от 0 до position_index_size(cfg)
+ * @param[out] masks Маски в порядке pack_position
+ */
+void position_from_index(const Piece_Config *cfg, uint64_t index, uint32_t masks[4]);
+
+/**
+ * @brief Проверяет индексацию на всем составе фишек и замеряет скорость
+ * @param cfg Состав фишек
+ */
+void bench_position_index(const Piece_Config *cfg);
+
+/**
+ * @brief Запускает сервер, обслуживающий множество партий в одном процессе
+ *
+ * Адрес с символом '/' трактуется как путь к Unix-сокету, иначе как
+ * [хост:]порт TCP. Ходы компьютера считаются в пуле из workers потоков.
+ * @param address Адрес для прослушивания
+ * @param workers Количество потоков пула поиска
+ * @param max_sessions Максимальное количество одновременных сессий
+ * @param seed Зерно, из которого выводятся зерна сессий
+ * @param record_dir Каталог журналов сессий или NULL
+ * @return Код завершения программы
+ */
+int run_server(const char *address, int workers, int max_sessions, uint64_t seed, const char *record_dir);
+
+extern int rules_variant;                            // Выбранные правила
+extern _Thread_local uint64_t rng_state;             // Генератор случайных чисел партии
+extern _Thread_local Hod_Info last_hod;              // Последний сделанный ход
+extern int replay_fd;                                // Журнал партии в консольной игре
+extern int draw_moves;                               // Ходов каждой стороны без прогресса до ничьей, 0 - без ограничения
+extern _Thread_local Game_History game_history;      // Позиции партии с последнего необратимого хода
+extern Search_Options search_options;                // Ограничения поиска хода компьютера
+extern Probcut_Model probcut_model;                  // Модель ProbCut: --probcut-calibrate 200 --seed 2
+extern int tt_size_mb;                               // Размер таблицы переходов потока в МБ, 0 - без таблицы
+extern Hod_Generator generate_hods;                  // Генератор ходов выбранных правил
+extern _Thread_local char lodic[8][8];               // Логическое поле для просчета ходов
+extern _Thread_local char board[BOARD_SIZE][SIZE + 1]; // Интерфейс поля
+
+#endif
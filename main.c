@@ -1,1467 +1,448 @@
 /**
- * @file checkers.c
- * @brief Программа для игры в шашки между человеком и компьютером
- * 
- * Программа реализует классическую игру в шашки с консольным интерфейсом.
- * Поддерживаются стандартные правила игры, включая превращение в дамки и обязательное взятие.
+ * @file main.c
+ * @brief Командная строка программы игры в шашки
+ *
+ * Разбирает параметры и запускает консольную партию или один из режимов
+ * библиотеки checkers.c.
  */
-#include <stdio.h>
-#include <string.h>
-#include <stdbool.h>
-#include <ctype.h>
-#include <stdlib.h>
-#include <time.h>
-
-#define SIZE 35                       /**< Ширина игрового поля в символах */
-#define BOARD_SIZE 18                 /**< Высота игрового поля в символах */
-#define MAX_MOVES 12                  /**< Максимальное количество возможных ходов для анализа */
-
-
-/**
- * @struct GameState
- * @brief Состояние игры для отслеживания количества фишек
- */
-
-// Структура нужна для отслеживания конца игры
-typedef struct
-{
-  int count_white;         /**< Количество белых фишек */
-  int count_black;         /**< Количество черных фишек */
-  int count_white_king;    /**< Количество белых дамок */
-  int count_black_king;    /**< Количество черных дамок */
-} GameState;
-
-/**
- * @struct Position
- * @brief Координаты фишки на поле
- */
-typedef struct
-{
-  short x;                  /**< Ряд (A,B,C) на графическом поле */
-  short y;                  /**< Строка (1,2,3) на графическом поле */
-  short x_8;                /**< Координата x на логическом поле (0-7) */
-  short y_8;                /**< Координата y на логическом поле (0-7) */
-  bool damka;               /**< Флаг, является ли фишка дамкой */
-} Position;
-
-
-/**
- * @struct Valid_Hod
- * @brief Валидные ходы для фишки
- */
-typedef struct
-{
-  bool l_h;     /**< Ход слева-вверх */
-  short lh_y;   /**< Координата y для хода слева-вверх */
-  short lh_x;   /**< Координата x для хода слева-вверх */
-  bool r_h;     /**< Ход справа-вверх */
-  short rh_y;   /**< Координата y для хода справа-вверх */
-  short rh_x;   /**< Координата x для хода справа-вверх */
-  bool l_s;     /**< Ход слева-вниз */
-  short ls_y;   /**< Координата y для хода слева-вниз */
-  short ls_x;   /**< Координата x для хода слева-вниз */
-  bool r_s;     /**< Ход справа-вниз */
-  short rs_y;   /**< Координата y для хода справа-вниз */
-  short rs_x;   /**< Координата x для хода справа-вниз */
-} Valid_Hod;
-
-/**
- * @struct Valid_Kill
- * @brief Валидные взятия для фишки
- */
-typedef struct {
-    bool kill_l_h;   /**< Взятие слева-вверх */
-    short kill_lh_y; /**< Координата y для взятия слева-вверх */
-    short kill_lh_x; /**< Координата x для взятия слева-вверх */
-    bool kill_r_h;   /**< Взятие справа-вверх */
-    short kill_rh_y; /**< Координата y для взятия справа-вверх */
-    short kill_rh_x; /**< Координата x для взятия справа-вверх */
-    bool kill_l_s;   /**< Взятие слева-вниз */
-    short kill_ls_y; /**< Координата y для взятия слева-вниз */
-    short kill_ls_x; /**< Координата x для взятия слева-вниз */
-    bool kill_r_s;   /**< Взятие справа-вниз */
-    short kill_rs_y; /**< Координата y для взятия справа-вниз */
-    short kill_rs_x; /**< Координата x для взятия справа-вниз */
-} Valid_Kill;
-
-bool is_player_turn = false;           // Флаг, ход игрока
-bool player_is_white = false;          // Флаг, игрок играет за белых
-char player_piece;                     // Фишка игрока
-char computer_piece;                   // Фишка компьютера
-GameState game_state = {12, 12, 0, 0}; // Состояние поля
-
-// Функции
-/**
- * @brief Преобразует логические координаты в графические символы
- * @param i_x Логическая координата x (0-7)
- * @param i_y Логическая координата y (0-7)
- * @param[out] x Символьное обозначение столбца (A-H)
- * @param[out] y Символьное обозначение строки (1-8)
- * @return true если преобразование успешно, false в противном случае
- */
-bool reverse_graph_out_koordinaty(short i_x, short i_y, char *x, char *y);
-
-/**
- * @brief Очищает фишку на графическом поле
- * @param board Игровое поле
- * @param x Координата x на графическом поле
- * @param y Координата y на графическом поле
- */
-void wash_piece(char board[BOARD_SIZE][SIZE + 1], short x, short y);
-
-/**
- * @brief Преобразует логические координаты в графические
- * @param i_x Логическая координата x (0-7)
- * @param i_y Логическая координата y (0-7)
- * @param[out] x Графическая координата x
- * @param[out] y Графическая координата y
- */
-void reverse_graph_koordinaty(short i_x, short i_y, short *x, short *y);
-
-/**
- * @brief Получает возможные взятия для фишки
- * @param where Позиция фишки
- * @param[out] velian Структура с возможными взятиями
- * @param lodic Логическое представление доски
- * @return Количество возможных взятий
- */
-int get_valid_kill(Position where, Valid_Kill *velian, char lodic[8][8]);
-
-/**
- * @brief Получает возможные ходы для фишки
- * @param pos Позиция фишки
- * @param[out] moves Структура с возможными ходами
- * @param lodic Логическое представление доски
- * @return Количество возможных ходов
- */
-int get_valid_moves(Position pos, Valid_Hod *moves, char lodic[8][8]);
-
-/**
- * @brief Инициализирует начальное расположение фишек
- * @param board Игровое поле
- * @param white_on_bottom Флаг, белые фишки внизу
- */
-void setup_pieces(char board[BOARD_SIZE][SIZE + 1], bool white_on_bottom);
-
-/**
- * @brief Инициализирует пустое игровое поле
- * @param board Игровое поле
- */
-void initialize_board(char board[BOARD_SIZE][SIZE + 1]);
-
-/**
- * @brief Выводит игровое поле в консоль
- * @param board Игровое поле
- */
-void print_board(const char board[BOARD_SIZE][SIZE + 1]);
-
-/**
- * @brief Основной игровой цикл
- * @param board Игровое поле
- */
-void play_game(char board[BOARD_SIZE][SIZE + 1]);
-
-/**
- * @brief Подсвечивает выбранную фишку
- * @param x Координата x на графическом поле
- * @param y Координата y на графическом поле
- * @param board Игровое поле
- */
-void highlight_piece(short x, short y, char board[BOARD_SIZE][SIZE + 1]);
-
-/**
- * @brief Выводит информацию о текущем ходе
- */
-void print_turn();
-
-/**
- * @brief Проверяет условие окончания игры
- * @return true если игра окончена, false в противном случае
- */
-bool check_game_over();
-
-/**
- * @brief Меняет текущего игрока
- */
-void switch_turn();
-
-/**
- * @brief Обрабатывает ход игрока
- * @param board Игровое поле
- * @return true если ход выполнен успешно, false в противном случае
- */
-bool player_move(char board[BOARD_SIZE][SIZE + 1]);
-
-/**
- * @brief Преобразует символьные координаты в числовые
- * @param x Символьное обозначение столбца (A-H)
- * @param y Символьное обозначение строки (1-8)
- * @param[out] i_x Графическая координата x
- * @param[out] i_y Графическая координата y
- * @param[out] i_x_8 Логическая координата x (0-7)
- * @param[out] i_y_8 Логическая координата y (0-7)
- * @return true если преобразование успешно, false в противном случае
- */
-bool koordinaty(char x, char y, short *i_x, short *i_y, short *i_x_8, short *i_y_8);
-
-/**
- * @brief Перемещает фишку на новую позицию
- * @param where Текущая позиция фишки
- * @param x Новая координата x
- * @param y Новая координата y
- */
-void Hod(Position *where, int x, int y);
-
-/**
- * @brief Подсвечивает возможные ходы
- * @param board Игровое поле
- * @param x Координата x на графическом поле
- * @param y Координата y на графическом поле
- * @param not_chose Флаг выбора
- */
-void light(char board[BOARD_SIZE][SIZE + 1], short x, short y, bool not_chose);
-
-/**
- * @brief Превращает фишку в дамку при достижении последней линии
- * @param where Позиция фишки
- * @param lodic Логическое представление доски
- */
-void becameQueen(Position where, char lodic[8][8]);
-
-/**
- * @brief Обрабатывает ход компьютера
- * @param board Игровое поле
- * @return true если ход выполнен успешно, false в противном случае
- */
-bool computer_move(char board[BOARD_SIZE][SIZE + 1]);
-
-/**
- * @brief Оценивает текущее состояние доски для компьютера
- * @param lodic Логическое представление доски
- * @param is_white Флаг, играет ли компьютер белыми
- * @return Оценка состояния доски
- */
-int evaluate_board_pc(char lodic[8][8], bool is_white);
-
-/**
- * @brief Находит лучшую последовательность взятий
- * @param pos Текущая позиция
- * @param vks Возможные взятия
- * @param vks_count Количество возможных взятий
- * @param mx_score Текущая максимальная оценка
- * @param lodic Логическое представление доски
- * @param[out] best_lodic Лучшее состояние доски
- * @param[out] best_game_state Лучшее состояние игры
- * @return Максимальная оценка
- */
-int get_best_sequent_kills(Position pos, Valid_Kill vks, int vks_count, int mx_score, char lodic[8][8], char best_lodic[8][8], GameState *best_game_state);
-
-/**
- * @brief Вычисляет возможные ходы со взятием
- * @param pos Текущая позиция
- * @param lodic Логическое представление доски
- * @param[out] move_i Количество возможных ходов
- * @param[out] move_buffer Буфер для хранения возможных ходов
- * @param[out] lodic_buffer Буфер для состояний доски
- * @param[out] game_states Буфер для состояний игры
- */
-void calculate_kill_moves(Position pos, char lodic[8][8], int *move_i, short move_buffer[10][2], char lodic_buffer[10][8][8], GameState *game_states);
+#include "checkers.h"
 
 /**
  * @brief Главная функция программы
+ * @param argc Количество аргументов командной строки
+ * @param argv Аргументы командной строки
  * @return Код завершения программы
  */
-int main();
-char lodic[8][8];
-
-char board[BOARD_SIZE][SIZE + 1] = { // Интерфейс поля
-    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
-    {'|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', '8'},
-    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
-    {'|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '7'},
-    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
-    {'|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', '6'},
-    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
-    {'|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '5'},
-    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
-    {'|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', '4'},
-    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
-    {'|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '3'},
-    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
-    {'|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', '2'},
-    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
-    {'|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '*', ' ', '|', ' ', ' ', ' ', '|', ' ', '1'},
-    {'+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', '-', '-', '-', '+', ' ', ' '},
-    {' ', ' ', 'A', ' ', ' ', ' ', 'B', ' ', ' ', ' ', 'C', ' ', ' ', ' ', 'D', ' ', ' ', ' ', 'E', ' ', ' ', ' ', 'F', ' ', ' ', ' ', 'G', ' ', ' ', ' ', 'H', ' ', ' ', ' ', ' '}};
-
-// Функция для начала игры
-int main()
+int main(int argc, char *argv[])
 {
   char choice[10];
   bool valid_choice = false; // Флаг поднимаеться когда игрок выберает цвет фишек
-
-  printf("\nДобро пожаловать в игру шашки!\n"); // Преветсвие
-
-  while (!valid_choice)
-  {
-    printf("\nВыберите цвет фишек:\n");
-    printf("1. White (белые)\n");
-    printf("2. Black (черные)\n");
-    printf("Ваш выбор: ");
-
-    if (fgets(choice, sizeof(choice), stdin) == NULL)
-    {
-      printf("Ошибка ввода!\n");
-      continue;
-    }
-
-    // Удаляем символ перевода строки
-    choice[strcspn(choice, "\n")] = '\0';
-
-    // Приводим к нижнему регистру для сравнения
-    for (int i = 0; choice[i]; i++)
-    {
-      choice[i] = tolower(choice[i]);
-    }
-
-    // initialize_board(board); // Создаем доску
-
-    if (strcmp(choice, "white") == 0)
-    {
-      setup_pieces(board, true);
-      printf("\nВы выбрали белые фишки (O). Вы ходите первым.\n");
-      player_is_white = true;
-      player_piece = 'O';
-      computer_piece = '0';
-      is_player_turn = true;
-      valid_choice = true;
-    }
-    else if (strcmp(choice, "black") == 0)
-    {
-      setup_pieces(board, false);
-      printf("\nВы выбрали черные фишки (0). Компьютер ходит первым.\n");
-      player_is_white = false;
-      player_piece = '0';
-      computer_piece = 'O';
-      is_player_turn = false;
-      valid_choice = true;
-    }
-    else
-      printf("Некорректный ввод. Пожалуйста, введите 'White' или 'Black'.\n");
-  }
-
-  print_board(board);
-
-  play_game(board);
-
-  return 0;
-}
-
-void initialize_board(char board[BOARD_SIZE][SIZE + 1])
-{ // Инициализация поля
-  for (int i = 0; i < BOARD_SIZE; i++)
+  const char *server_address = NULL;
+  int workers = 0;
+  int max_sessions = 10000;
+  long bench_eval = 0;
+  long bench_search_ms = 0;
+  int bench_threads_depth = 0;
+  int selfplay_games = 0;
+  int calibrate_games = 0;
+  uint64_t datagen_positions = 0;
+  int dedup_mb = DATAGEN_DEFAULT_DEDUP_MB;
+  const char *analyze_fen = NULL;
+  int multipv = 3;
+  const char *annotate_path = NULL;
+  const char *output_path = "-";
+  bool annotate_json = false;
+  int annotate_threshold = 100;
+  int perft_depth = 0;
+  int perft_suite_depth = 0;
+  const char *fuzz_target = NULL;
+  uint64_t fuzz_runs = 0;
+  Piece_Config index_check;
+  bool check_index = false;
+  const char *record_path = NULL;
+  const char *replay_path = NULL;
+  const char *shared_hash_name = NULL;
+  const char *cache_path = NULL;
+  const char *tree_path = NULL;
+  int tree_ply = TREE_DEFAULT_PLY;
+  uint64_t tree_nodes = TREE_DEFAULT_NODES;
+  const char *nnue_path = NULL;
+  const char *train_output = NULL;
+  char **train_inputs = NULL;
+  int train_count = 0;
+  int epochs = 10;
+  bool seed_given = false;
+  uint64_t seed = 0;
+
+  for (int i = 1; i < argc; i++)
   {
-    for (int j = 0; j < SIZE; j++)
+    if (strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+      server_address = argv[++i];
+    else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+      workers = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--max-sessions") == 0 && i + 1 < argc)
+      max_sessions = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--bench-eval") == 0 && i + 1 < argc)
+      bench_eval = atol(argv[++i]);
+    else if (strcmp(argv[i], "--bench-search") == 0 && i + 1 < argc)
+      bench_search_ms = atol(argv[++i]);
+    else if (strcmp(argv[i], "--bench-threads") == 0 && i + 1 < argc)
+      bench_threads_depth = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
     {
-      if (board[i][j] == '*' || board[i][j] == 'O' || board[i][j] == '0' ||
-          board[i][j] == 'Q' || board[i][j] == 'K')
+      search_options.threads = atoi(argv[++i]);
+      if (search_options.threads < 1 || search_options.threads > SPLIT_MAX_THREADS)
       {
-        board[i][j] = '*';
+        printf("Количество потоков поиска должно быть от 1 до %d\n", SPLIT_MAX_THREADS);
+        return 1;
       }
     }
-  }
-}
-
-void print_board(const char board[BOARD_SIZE][SIZE + 1])
-{ // Печать интерфейса поля
-  printf("\n");
-  printf("0 - Фишка черного игрока\n");
-  printf("O - Фишка белого игрока\n");
-  printf("W, B - Дамки\n");
-  printf("Текущее состояние доски:\n");
-  printf("Белые: %d (%d дамок), Черные: %d (%d дамок)\n", game_state.count_white, game_state.count_white_king,
-         game_state.count_black, game_state.count_black_king);
-
-  for (int i = 0; i < BOARD_SIZE; i++)
-  {
-    for (int j = 0; j < SIZE; j++)
-      printf("%c", board[i][j]);
-    printf("\n");
-  }
-}
-
-void setup_pieces(char board[BOARD_SIZE][SIZE + 1], bool white_on_bottom)
-{ // Располежение поля в стороны игрока
-  if (white_on_bottom)
-  {
-    for (int i = 11; i < BOARD_SIZE - 1; i += 2)
+    else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
     {
-      for (int j = 2; j < SIZE - 2; j += 8)
+      search_options.depth = atoi(argv[++i]);
+      if (search_options.depth < 1 || search_options.depth >= MAX_PLY)
       {
-        if (i % 4 == 1)
-        {
-          if (j + 4 < SIZE - 2)
-            board[i][j + 4] = 'O';
-        }
-        else
-          board[i][j] = 'O';
+        printf("Глубина поиска должна быть от 1 до %d\n", MAX_PLY - 1);
+        return 1;
       }
     }
-
-    for (int i = 1; i < 6; i += 2)
+    else if (strcmp(argv[i], "--movetime") == 0 && i + 1 < argc)
     {
-      for (int j = 2; j < SIZE - 2; j += 8)
-      {
-        if (i % 4 == 1)
-        {
-          if (j + 4 < SIZE - 2)
-            board[i][j + 4] = '0';
-        }
-        else
-          board[i][j] = '0';
-      }
+      // Со временем на ход глубина не ограничивается, но партия перестает
+      // быть воспроизводимой: глубина зависит от скорости машины
+      search_options.time_ms = atol(argv[++i]);
+      if (search_options.time_ms > 0)
+        search_options.depth = MAX_PLY - 1;
     }
-  }
-  else
-  {
-    for (int i = 11; i < BOARD_SIZE - 1; i += 2)
+    else if (strcmp(argv[i], "--no-pvs") == 0)
+      search_options.pvs = false;
+    else if (strcmp(argv[i], "--no-lmr") == 0)
+      search_options.lmr = false;
+    else if (strcmp(argv[i], "--probcut") == 0)
+      search_options.probcut = true;
+    else if (strcmp(argv[i], "--no-probcut") == 0)
+      search_options.probcut = false;
+    else if (strcmp(argv[i], "--probcut-model") == 0 && i + 1 < argc)
     {
-      for (int j = 2; j < SIZE - 2; j += 8)
+      if (sscanf(argv[++i], "%lf,%lf,%lf", &probcut_model.a, &probcut_model.b, &probcut_model.sigma) != 3 ||
+          probcut_model.a <= 0 || probcut_model.sigma < 0)
       {
-        if (i % 4 == 1)
-        {
-          if (j + 4 < SIZE - 2)
-            board[i][j + 4] = '0';
-        }
-        else
-          board[i][j] = '0';
+        printf("Модель ProbCut задается как a,b,sigma (a > 0, sigma >= 0)\n");
+        return 1;
       }
     }
-
-    for (int i = 1; i <= 6; i += 2)
+    else if (strcmp(argv[i], "--probcut-calibrate") == 0 && i + 1 < argc)
+      calibrate_games = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--selfplay") == 0 && i + 1 < argc)
+      selfplay_games = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--datagen") == 0 && i + 1 < argc)
+      datagen_positions = strtoull(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--dedup") == 0 && i + 1 < argc)
     {
-      for (int j = 2; j < SIZE - 2; j += 8)
+      dedup_mb = atoi(argv[++i]);
+      if (dedup_mb < 1)
       {
-        if (i % 4 == 1)
-        {
-          if (j + 4 < SIZE - 2)
-            board[i][j + 4] = 'O';
-        }
-        else
-          board[i][j] = 'O';
+        printf("Память таблицы повторов должна быть не меньше 1 МБ\n");
+        return 1;
       }
     }
-  }
-}
-
-void play_game(char board[BOARD_SIZE][SIZE + 1]){
-  bool has_moves = true;
-  while (true)
-  {
-    print_turn();
-
-    if (check_game_over())
-      break;
-
-    if (is_player_turn)
-      has_moves = player_move(board);
-
-    else
-      has_moves = computer_move(board);
-    if (!has_moves) break;
-
-    switch_turn();
-    for (short x = 0; x < 8; x++)
-      for (short y = 0; y < 8; y++)
-      {
-        short bx, by;
-        reverse_graph_koordinaty(x, y, &bx, &by);
-        if (player_is_white)
-          board[by][bx] = (lodic[y][x] == '0' ? '*' : (lodic[y][x] == '1' ? '0' : (lodic[y][x] == '2' ? 'O' : (lodic[y][x] == '3' ? 'B' : (lodic[y][x] == '4' ? 'W' : ' ')))));
-        else
-          board[by][bx] = (lodic[y][x] == '0' ? '*' : (lodic[y][x] == '1' ? 'O' : (lodic[y][x] == '2' ? '0' : (lodic[y][x] == '3' ? 'W' : (lodic[y][x] == '4' ? 'B' : ' ')))));
-      }
-    print_board(board);
-  }
-  printf("Конец. Парам-парам-пам");
-}
-
-bool player_move(char board[BOARD_SIZE][SIZE + 1]){
-  printf("\nВаш ход. Введите координаты фишки (например, B3): ");
-
-  char x, y;
-  Position where;
-  Valid_Hod motion;
-  Valid_Kill veliam;
-
-  short can_kill[12][2];
-  int can_kill_i = 0;
-  bool no_moves = true;
-  memset(can_kill, 0, 12 * 2 * sizeof(short));
-  for (int y = 0; y < 8; y++)
-    for (int x = y % 2 == 0; x < 8; x += 2)
+    else if (strcmp(argv[i], "--data-info") == 0 && i + 1 < argc)
+      return data_info(argv[++i]);
+    else if (strcmp(argv[i], "--analyze") == 0 && i + 1 < argc)
+      analyze_fen = argv[++i];
+    else if (strcmp(argv[i], "--multipv") == 0 && i + 1 < argc)
     {
-      if (lodic[y][x] != '2' && lodic[y][x] != '4')
-        continue;
-      Position pos;
-      pos.x_8 = x;
-      pos.y_8 = y;
-      reverse_graph_koordinaty(x, y, &pos.x, &pos.y);
-      Valid_Kill vks;
-      int vks_count = get_valid_kill(pos, &vks, lodic);
-      int vhs_count = get_valid_moves(pos, &motion, lodic);
-      if (vhs_count > 0)
-        no_moves = false;
-      if (vks_count > 0)
+      multipv = atoi(argv[++i]);
+      if (multipv < 1 || multipv > MAX_MULTIPV)
       {
-        no_moves = false;
-        can_kill[can_kill_i][0] = x;
-        can_kill[can_kill_i][1] = y;
-        can_kill_i++;
+        printf("Количество линий должно быть от 1 до %d\n", MAX_MULTIPV);
+        return 1;
       }
     }
-  int killer_i = -1;
-  if (no_moves) return false;
-  // Ввод координат фишки
-  while (true)
-  {
-    if (scanf(" %c%c", &x, &y) != 2)
+    else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc)
+      tt_size_mb = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--shared-hash") == 0 && i + 1 < argc)
+      shared_hash_name = argv[++i];
+    else if (strcmp(argv[i], "--unlink-shared-hash") == 0 && i + 1 < argc)
+      return shared_tt_unlink(argv[++i]) ? 0 : 1;
+    else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+      cache_path = argv[++i];
+    else if (strcmp(argv[i], "--merge-cache") == 0 && i + 2 < argc)
+      return disk_cache_merge(argv[i + 1], argv + i + 2, argc - i - 2);
+    else if (strcmp(argv[i], "--tree-dump") == 0 && i + 1 < argc)
+      tree_path = argv[++i];
+    else if (strcmp(argv[i], "--tree-depth") == 0 && i + 1 < argc)
     {
-      printf("Ошибка ввода. Попробуйте еще раз: ");
-      while (getchar() != '\n')
-        ;
-      continue;
-    }
-
-    x = toupper(x);
-
-    if (!koordinaty(x, y, &where.x, &where.y, &where.x_8, &where.y_8))
-    {
-      printf("Неверные координаты! Попробуйте еще раз: ");
-      continue;
-    }
-
-    char piece = board[where.y][where.x];
-    if ((player_is_white && (piece != 'O' && piece != 'W')) ||
-        (!player_is_white && (piece != '0' && piece != 'B')))
-    {
-      printf("Это не ваша фишка! Попробуйте еще раз: ");
-      continue;
-    }
-
-    if (can_kill_i > 0)
-    {
-      bool correct_pos = false;
-      for (int i = 0; i <= can_kill_i; i++)
-        if (can_kill[i][0] == where.x_8 && can_kill[i][1] == where.y_8)
-        {
-          killer_i = i;
-          correct_pos = true;
-          break;
-        }
-      if (!correct_pos)
+      tree_ply = atoi(argv[++i]);
+      if (tree_ply < 0 || tree_ply >= MAX_PLY)
       {
-        printf("Вы обязаны рубить! Пожалуйста, выберите фишку, которая рубит фишку протвиника в этом ходу\n");
-        continue;
+        printf("Предел полуходов дерева должен быть от 0 до %d\n", MAX_PLY - 1);
+        return 1;
       }
     }
-
-    highlight_piece(where.x, where.y, board);
-
-    if (killer_i != -1)
+    else if (strcmp(argv[i], "--tree-nodes") == 0 && i + 1 < argc)
+      tree_nodes = strtoull(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--tree-convert") == 0 && i + 2 < argc)
+      return tree_dump_convert(argv[i + 1], argv[i + 2]);
+    else if (strcmp(argv[i], "--nnue") == 0 && i + 1 < argc)
+      nnue_path = argv[++i];
+    else if (strcmp(argv[i], "--epochs") == 0 && i + 1 < argc)
+      epochs = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--nnue-train") == 0 && i + 2 < argc)
     {
-      Position pos;
-      pos.x_8 = can_kill[killer_i][0];
-      pos.y_8 = can_kill[killer_i][1];
-      reverse_graph_koordinaty(can_kill[killer_i][0], can_kill[killer_i][1], &pos.x, &pos.y);
-      short available_kills[10][2];
-      int move_i = 0;
-      char lodic_buffer[10][8][8];
-      GameState game_states[10];
-      calculate_kill_moves(pos, lodic, &move_i, available_kills, lodic_buffer, game_states);
-      int kol = 1;
-      char out_x = 0, out_y = 0;
-      short big_x = 0, big_y = 0;
-      for (int i = 0; i < move_i; i++)
-      {
-        reverse_graph_koordinaty(available_kills[i][0], available_kills[i][1], &big_x, &big_y);
-        light(board, big_x, big_y, true);
-      }
-      highlight_piece(pos.x, pos.y, board);
-      for (int i = 0; i < move_i; i++)
-      {
-        reverse_graph_out_koordinaty(available_kills[i][0], available_kills[i][1], &out_x, &out_y);
-        printf("%d. %c%c\n", kol, out_x, out_y);
-        kol++;
-        reverse_graph_koordinaty(available_kills[i][0], available_kills[i][1], &big_x, &big_y);
-        light(board, big_x, big_y, false);
-      }
-      int vsbor = 1;
-      while (true)
-      {
-        printf("Введите номер хода:\n");
-        scanf("%d", &vsbor);
-        if (vsbor < 1 || vsbor > move_i)
-        {
-          printf("Ошибка ввода");
-          continue;
-        }
-        break;
-      }
-      where.x_8 = available_kills[vsbor - 1][0];
-      where.y_8 = available_kills[vsbor - 1][1];
-      reverse_graph_koordinaty(where.x_8, where.y_8, &where.x, &where.y);
-      memcpy(lodic, lodic_buffer[vsbor - 1], 8 * 8 * sizeof(char));
-      game_state = game_states[vsbor - 1];
+      // Остальные параметры - файлы партий
+      train_output = argv[i + 1];
+      train_inputs = argv + i + 2;
+      train_count = argc - i - 2;
+      break;
     }
-    else
+    else if (strcmp(argv[i], "--annotate") == 0 && i + 1 < argc)
+      annotate_path = argv[++i];
+    else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+      output_path = argv[++i];
+    else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
     {
-      int sum = get_valid_moves(where, &motion, lodic);
-      if (get_valid_moves(where, &motion, lodic) > 0) 
-      {
-        printf("\nМожно походить в:\n");
-
-        short go_x = 0, go_y = 0;
-        int output[4][2] = {0};
-        int off[4][2] = {0};
-        short id = -1;
-
-        bool not_chose = true;
-
-        if (motion.l_h == true)
-        {
-          id++;
-          reverse_graph_koordinaty(motion.lh_x, motion.lh_y, &go_x, &go_y);
-          light(board, go_x, go_y, not_chose);
-          output[id][0] = motion.lh_x;
-          output[id][1] = motion.lh_y;
-          off[0][0] = go_x;
-          off[0][1] = go_y;
-        }
-
-        if (motion.r_h == true)
-        {
-          id++;
-          reverse_graph_koordinaty(motion.rh_x, motion.rh_y, &go_x, &go_y);
-          light(board, go_x, go_y, not_chose);
-          output[id][0] = motion.rh_x;
-          output[id][1] = motion.rh_y;
-          off[1][0] = go_x;
-          off[1][1] = go_y;
-        }
-
-        if (motion.l_s == true)
-        {
-          id++;
-          reverse_graph_koordinaty(motion.ls_x, motion.ls_y, &go_x, &go_y);
-          light(board, go_x, go_y, not_chose);
-          output[id][0] = motion.ls_x;
-          output[id][1] = motion.ls_y;
-          off[2][0] = go_x;
-          off[2][1] = go_y;
-        }
-
-        if (motion.r_s == true)
-        {
-          id++;
-          reverse_graph_koordinaty(motion.rs_x, motion.rs_y, &go_x, &go_y);
-          light(board, go_x, go_y, not_chose);
-          output[id][0] = motion.rs_x;
-          output[id][1] = motion.rs_y;
-          off[3][0] = go_x;
-          off[3][1] = go_y;
-        }
-
-        highlight_piece(where.x, where.y, board);
-
-        int kol = 1;
-        char out_x = 0, out_y = 0;
-        for (int i = 0; i < sum; i++)
-        {
-          reverse_graph_out_koordinaty(output[i][0], output[i][1], &out_x, &out_y);
-          printf("%d. %c%c\n", kol, out_x, out_y);
-          kol++;
-          not_chose = false;
-        }
-        for (int i = 0; i < 4; i++)
-        {
-          light(board, off[i][0], off[i][1], not_chose);
-        }
-        int vsbor = 1;
-
-        while (true)
-        {
-          printf("Введите номер хода:\n");
-          scanf("%d", &vsbor);
-          if (vsbor < 1 || vsbor >= kol)
-          {
-            printf("Ошибка ввода\n");
-            continue;
-          }
-          break;
-        }
-        int hod_x = output[vsbor - 1][0];
-        int hod_y = output[vsbor - 1][1];
-        Hod(&where, hod_x, hod_y);
-        reverse_graph_koordinaty(where.x_8, where.y_8, &where.x, &where.y);
-      }
-      else
+      i++;
+      annotate_json = strcmp(argv[i], "json") == 0;
+      if (!annotate_json && strcmp(argv[i], "pdn") != 0)
       {
-        printf("Этой фишкой походить нельзя");
+        printf("Неизвестный формат: %s (pdn, json)\n", argv[i]);
+        return 1;
       }
     }
-    becameQueen(where, lodic);
-    break;
-  }
-  return true;
-}
-
-void Hod(Position *where, int x, int y){
-  char bslo = lodic[where->y_8][where->x_8];
-  lodic[where->y_8][where->x_8] = '0';
-  where->x_8 = x;
-  where->y_8 = y;
-  lodic[where->y_8][where->x_8] = bslo;
-}
-
-bool reverse_graph_out_koordinaty(short i_x, short i_y, char *x, char *y){
-  // Вычисляем координаты lodic из графических координат
-  *x = 'A' + i_x;
-  *y = '8' - i_y;
-  return true;
-}
-
-void reverse_graph_koordinaty(short i_x, short i_y, short *x, short *y){
-  *x = (i_x * 4) + 2;
-  *y = 1 + (i_y * 2);
-}
-
-char lodic[8][8] = { // для просчета ходов.
-    {' ', '1', ' ', '1', ' ', '1', ' ', '1'},
-    {'1', ' ', '1', ' ', '1', ' ', '1', ' '},
-    {' ', '1', ' ', '1', ' ', '1', ' ', '1'},
-    {'0', ' ', '0', ' ', '0', ' ', '0', ' '},
-    {' ', '0', ' ', '0', ' ', '0', ' ', '0'},
-    {'2', ' ', '2', ' ', '2', ' ', '2', ' '},
-    {' ', '2', ' ', '2', ' ', '2', ' ', '2'},
-    {'2', ' ', '2', ' ', '2', ' ', '2', ' '}};
-
-int get_valid_moves(Position where, Valid_Hod *motion, char lodic[8][8]){
-  // Инициализация всех возможных ходов как недопустимых
-  motion->l_h = false;
-  motion->r_h = false;
-  motion->l_s = false;
-  motion->r_s = false;
-
-  int count = 0;
-
-  char piece = lodic[where.y_8][where.x_8];
-
-  // Проверка ходов для обычной фишки
-  if (piece == '1' || piece == '2' || piece == '3' || piece == '4')
-  {
-    // Проверка хода влево-вниз
-    if (where.y_8 + 1 < 8 && where.x_8 - 1 >= 0 &&
-        lodic[where.y_8 + 1][where.x_8 - 1] == '0')
+    else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+      annotate_threshold = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc)
     {
-      if (piece == '2')
-      {
-        motion->l_s = false;
-      }
-      else
-      {
-        motion->l_s = true;
-        motion->ls_y = where.y_8 + 1;
-        motion->ls_x = where.x_8 - 1;
-        count++;
-      }
+      // Бюджет узлов, в отличие от времени, дает одинаковый результат на любой машине
+      search_options.max_nodes = strtoull(argv[++i], NULL, 10);
+      if (search_options.max_nodes > 0)
+        search_options.depth = MAX_PLY - 1;
     }
-    // Проверка хода вправо-вниз
-    if (where.y_8 + 1 < 8 && where.x_8 + 1 < 8 &&
-        lodic[where.y_8 + 1][where.x_8 + 1] == '0')
+    else if (strcmp(argv[i], "--perft") == 0 && i + 1 < argc)
+      perft_depth = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--perft-suite") == 0 && i + 1 < argc)
+      perft_suite_depth = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--fuzz") == 0 && i + 2 < argc)
     {
-      if (piece == '2')
-      {
-        motion->r_s = false;
-      }
-      else
-      {
-        motion->r_s = true;
-        motion->rs_y = where.y_8 + 1;
-        motion->rs_x = where.x_8 + 1;
-        count++;
-      }
+      fuzz_target = argv[i + 1];
+      fuzz_runs = strtoull(argv[i + 2], NULL, 10);
+      i += 2;
     }
-
-    // Проверка хода влево-вниз
-    if (where.y_8 - 1 >= 0 && where.x_8 - 1 >= 0 &&
-        lodic[where.y_8 - 1][where.x_8 - 1] == '0')
+    else if (strcmp(argv[i], "--index-check") == 0 && i + 1 < argc)
     {
-      if (piece == '1')
-        motion->l_h = false;
-      else
+      check_index = sscanf(argv[++i], "%hd,%hd,%hd,%hd", &index_check.top_men, &index_check.top_kings,
+                           &index_check.bottom_men, &index_check.bottom_kings) == 4;
+      if (!check_index)
       {
-        motion->l_h = true;
-        motion->lh_y = where.y_8 - 1;
-        motion->lh_x = where.x_8 - 1;
-        count++;
+        printf("Состав фишек задается как простые,дамки,простые,дамки (например, 2,1,2,1)\n");
+        return 1;
       }
     }
-
-    // Проверка хода вправо-вниз
-    if (where.y_8 - 1 >= 0 && where.x_8 + 1 < 8 &&
-        lodic[where.y_8 - 1][where.x_8 + 1] == '0')
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
     {
-      if (piece == '1')
-        motion->r_h = false;
-      else
-      {
-        motion->r_h = true;
-        motion->rh_y = where.y_8 - 1;
-        motion->rh_x = where.x_8 + 1;
-        count++;
-      }
+      seed = strtoull(argv[++i], NULL, 10);
+      seed_given = true;
     }
-  }
-
-  return count;
-}
-
-int get_valid_kill(Position where, Valid_Kill *velian, char lodic[8][8]){ // Клетки которые можно срубить
-  // Инициализация всех возможных ходов как недопустимых
-  velian->kill_l_h = false;
-  velian->kill_r_h = false;
-  velian->kill_l_s = false;
-  velian->kill_r_s = false;
-
-  int count = 0;
-
-  char piece = lodic[where.y_8][where.x_8];
-
-  if (piece == '1' || piece == '2' || piece == '3' || piece == '4')
-  {
-    if (is_player_turn)
+    else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+      record_path = argv[++i];
+    else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+      replay_path = argv[++i];
+    else if (strcmp(argv[i], "--draw-moves") == 0 && i + 1 < argc)
     {
-      if ((where.y_8 + 1 < 8 && where.x_8 - 1 >= 0) &&
-          ((lodic[where.y_8 + 1][where.x_8 - 1] == '1') || (lodic[where.y_8 + 1][where.x_8 - 1] == '3')) &&
-          (where.y_8 + 2 < 8 && where.x_8 - 2 >= 0) &&
-          (lodic[where.y_8 + 2][where.x_8 - 2] == '0'))
-      {
-        velian->kill_l_s = true;
-        velian->kill_ls_y = where.y_8 + 2;
-        velian->kill_ls_x = where.x_8 - 2;
-        count++;
-      }
-      if ((where.y_8 + 1 < 8 && where.x_8 + 1 < 8) &&
-          ((lodic[where.y_8 + 1][where.x_8 + 1] == '1') || (lodic[where.y_8 + 1][where.x_8 + 1] == '3')) &&
-          (where.y_8 + 2 < 8 && where.x_8 + 2 < 8) &&
-          (lodic[where.y_8 + 2][where.x_8 + 2] == '0'))
+      draw_moves = atoi(argv[++i]);
+      if (draw_moves < 0 || draw_moves > MAX_DRAW_MOVES)
       {
-        velian->kill_r_s = true;
-        velian->kill_rs_y = where.y_8 + 2;
-        velian->kill_rs_x = where.x_8 + 2;
-        count++;
+        printf("Предел ходов без прогресса должен быть от 0 до %d\n", MAX_DRAW_MOVES);
+        return 1;
       }
-      if ((where.y_8 - 1 >= 0 && where.x_8 - 1 >= 0) &&
-          ((lodic[where.y_8 - 1][where.x_8 - 1] == '1') || (lodic[where.y_8 - 1][where.x_8 - 1] == '3')) &&
-          (where.y_8 - 2 >= 0 && where.x_8 - 2 >= 0) &&
-          (lodic[where.y_8 - 2][where.x_8 - 2] == '0'))
-      {
-        velian->kill_l_h = true;
-        velian->kill_lh_y = where.y_8 - 2;
-        velian->kill_lh_x = where.x_8 - 2;
-        count++;
-      }
-      if ((where.y_8 - 1 >= 0 && where.x_8 + 1 < 8) &&
-          ((lodic[where.y_8 - 1][where.x_8 + 1] == '1') || (lodic[where.y_8 - 1][where.x_8 + 1] == '3')) &&
-          (where.y_8 - 2 >= 0 && where.x_8 + 2 < 8) &&
-          (lodic[where.y_8 - 2][where.x_8 + 2] == '0'))
+    }
+    else if (strcmp(argv[i], "--variant") == 0 && i + 1 < argc)
+    {
+      if (!select_rules(argv[++i]))
       {
-        velian->kill_r_h = true;
-        velian->kill_rh_y = where.y_8 - 2;
-        velian->kill_rh_x = where.x_8 + 2;
-        count++;
+        printf("Неизвестные правила: %s (american, russian, pool)\n", argv[i]);
+        return 1;
       }
     }
     else
     {
-      if ((where.y_8 + 1 < 8 && where.x_8 - 1 >= 0) &&
-          ((lodic[where.y_8 + 1][where.x_8 - 1] == '2') || (lodic[where.y_8 + 1][where.x_8 - 1] == '4')) &&
-          (where.y_8 + 2 < 8 && where.x_8 - 2 >= 0) &&
-          (lodic[where.y_8 + 2][where.x_8 - 2] == '0'))
-      {
-        velian->kill_l_s = true;
-        velian->kill_ls_y = where.y_8 + 2;
-        velian->kill_ls_x = where.x_8 - 2;
-        count++;
-      }
-
-      if ((where.y_8 + 1 < 8 && where.x_8 + 1 < 8) &&
-          ((lodic[where.y_8 + 1][where.x_8 + 1] == '2') || (lodic[where.y_8 + 1][where.x_8 + 1] == '4')) &&
-          (where.y_8 + 2 < 8 && where.x_8 + 2 < 8) &&
-          (lodic[where.y_8 + 2][where.x_8 + 2] == '0'))
-      {
-        velian->kill_r_s = true;
-        velian->kill_rs_y = where.y_8 + 2;
-        velian->kill_rs_x = where.x_8 + 2;
-        count++;
-      }
-
-      if ((where.y_8 - 1 >= 0 && where.x_8 - 1 >= 0) &&
-          ((lodic[where.y_8 - 1][where.x_8 - 1] == '2') || (lodic[where.y_8 - 1][where.x_8 - 1] == '4')) &&
-          (where.y_8 - 2 >= 0 && where.x_8 - 2 >= 0) &&
-          (lodic[where.y_8 - 2][where.x_8 - 2] == '0'))
-      {
-        velian->kill_l_h = true;
-        velian->kill_lh_y = where.y_8 - 2;
-        velian->kill_lh_x = where.x_8 - 2;
-        count++;
-      }
-
-      if ((where.y_8 - 1 >= 0 && where.x_8 + 1 < 8) &&
-          ((lodic[where.y_8 - 1][where.x_8 + 1] == '2') || (lodic[where.y_8 - 1][where.x_8 + 1] == '4')) &&
-          (where.y_8 - 2 >= 0 && where.x_8 + 2 < 8) &&
-          (lodic[where.y_8 - 2][where.x_8 + 2] == '0'))
-      {
-        velian->kill_r_h = true;
-        velian->kill_rh_y = where.y_8 - 2;
-        velian->kill_rh_x = where.x_8 + 2;
-        count++;
-      }
+      printf("Неизвестный параметр: %s\n", argv[i]);
+      printf("Использование: %s [--variant american|russian|pool] [--draw-moves N]\n"
+             "       [--seed N] [--record файл] [--replay файл]\n"
+             "       [--depth N] [--movetime мс] [--no-pvs] [--no-lmr] [--threads N]\n"
+             "       [--bench-search мс] [--bench-threads глубина]\n"
+             "       [--probcut|--no-probcut] [--probcut-model a,b,sigma] [--probcut-calibrate N]\n"
+             "       [--selfplay N [--workers N] [--output партии.pdn]] [--analyze FEN [--multipv N]] [--hash МБ]\n"
+             "       [--datagen N --output каталог [--workers N] [--dedup МБ]] [--data-info каталог]\n"
+             "       [--shared-hash /имя] [--unlink-shared-hash /имя]\n"
+             "       [--cache файл] [--merge-cache выход вход...]\n"
+             "       [--tree-dump файл [--tree-depth N] [--tree-nodes N]] [--tree-convert дерево выход.dot|.json]\n"
+             "       [--nnue веса] [[--epochs N] --nnue-train веса партии.pdn|каталог...]\n"
+             "       [--annotate файл.pdn [--output файл] [--format pdn|json] [--threshold N]\n"
+             "        [--nodes N] [--workers N]]\n"
+             "       [--server адрес [--workers N] [--max-sessions N]]\n"
+             "       [--bench-eval N] [--perft N] [--perft-suite N] [--fuzz fen|pdn|hods|input N]\n"
+             "       [--index-check m,k,m,k]\n", argv[0]);
+      return 1;
     }
   }
 
-  return count;
-}
-
-bool koordinaty(char x, char y, short *i_x, short *i_y, short *i_x_8, short *i_y_8){ // Расположение фишки на поле
-  if (x < 'A' || x > 'H' || y < '1' || y > '8')
-    return false;
-
-  short in_x = (short)(x - 'A');
-
-  short in_y = (short)(y - '0');
-
-  *i_x_8 = in_x;
-  *i_y_8 = 8 - in_y;
-  reverse_graph_koordinaty(*i_x_8, *i_y_8, i_x, i_y);
-
-  return true;
-}
-
-void print_turn(){ // Печать флага чей сейчас ход
-  printf("\nСейчас ход: %s\n", is_player_turn ? "игрока" : "компьютера");
-}
-
-void switch_turn(){ // Поменять ход
-  is_player_turn = !is_player_turn;
-}
+  // Без явного зерна берем время, но печатаем его, чтобы партию можно было повторить
+  if (!seed_given)
+    seed = (uint64_t)time(NULL);
 
-void highlight_piece(short x, short y, char board[BOARD_SIZE][SIZE + 1]){ // Выделить клетку
-  if (x > 1)
-    board[y][x - 1] = '#';
-  if (x < SIZE - 2)
-    board[y][x + 1] = '#';
-  print_board(board);
+  if (shared_hash_name != NULL && !shared_tt_open(shared_hash_name, tt_size_mb))
+    return 1;
+  if (cache_path != NULL)
+  {
+    if (!disk_cache_open(cache_path))
+      return 1;
+    atexit(disk_cache_save);
+  }
+  if (tree_path != NULL)
+  {
+    if (!tree_dump_open(tree_path, tree_ply, tree_nodes))
+      return 1;
+    atexit(tree_dump_close);
+  }
+  if (nnue_path != NULL && !nnue_load(nnue_path))
+    return 1;
+  if (train_output != NULL)
+    return nnue_train(train_output, train_inputs, train_count, epochs > 0 ? epochs : 1, seed_given ? seed : 1);
 
-  if (x > 1)
-    board[y][x - 1] = ' ';
-  if (x < SIZE - 2)
-    board[y][x + 1] = ' ';
-}
+  if (perft_suite_depth > 0)
+    return perft_suite(perft_suite_depth);
+  if (fuzz_target != NULL)
+    return run_fuzz(fuzz_target, fuzz_runs, seed_given ? seed : 1);
 
-bool check_game_over(){ // Проверка оканчания игры
-  if (game_state.count_white + game_state.count_white_king == 0)
+  if (perft_depth > 0)
   {
-    printf("\nЧерные победили! У белых не осталось фишек.\n");
-    return true;
+    char start[8][8];
+    initial_position(start);
+    for (int depth = 1; depth <= perft_depth; depth++)
+    {
+      struct timespec t0, t1;
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      uint64_t nodes = perft(start, '2', depth);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      printf("perft %2d: %12llu  %.3f с\n", depth, (unsigned long long)nodes,
+             (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    }
+    return 0;
   }
 
-  if (game_state.count_black + game_state.count_black_king == 0)
+  if (check_index)
   {
-    printf("\nБелые победили! У черных не осталось фишек.\n");
-    return true;
+    bench_position_index(&index_check);
+    return 0;
   }
 
-  // нет ходов
-  return false;
-}
-
-void wash_piece(char board[BOARD_SIZE][SIZE + 1], short x, short y){
-  board[y][x] = '*';
-}
+  if (analyze_fen != NULL)
+    return analyze_position(analyze_fen, multipv);
 
-void light(char board[BOARD_SIZE][SIZE + 1], short x, short y, bool not_chose){
+  if (annotate_path != NULL)
+    return annotate_pdn(annotate_path, output_path, annotate_json, annotate_threshold, workers);
 
-  if (not_chose)
+  if (calibrate_games > 0)
   {
-    board[y][x - 1] = '(';
-    board[y][x + 1] = ')';
+    calibrate_probcut(calibrate_games, workers, seed);
+    return 0;
   }
-  else
-  {
-    board[y][x - 1] = ' ';
-    board[y][x + 1] = ' ';
-  }
-}
 
-void becameQueen(Position where, char lodic[8][8]){
-  if (player_is_white)
+  if (datagen_positions > 0)
   {
-    if (where.y_8 == 0 && is_player_turn)
-    {
-      if (board[where.y][where.x] != 'W')
-      {
-        where.damka = true;
-        board[where.y][where.x] = 'W';
-        lodic[where.y_8][where.x_8] = '4';
-        game_state.count_white_king++;
-        game_state.count_white--;
-        return;
-      }
-    }
-    if (where.y_8 == 7 && !is_player_turn)
+    if (strcmp(output_path, "-") == 0)
     {
-      if (board[where.y][where.x] != 'B')
-      {
-        where.damka = true;
-        board[where.y][where.x] = 'B';
-        lodic[where.y_8][where.x_8] = '3';
-        game_state.count_black_king++;
-        game_state.count_black--;
-        return;
-      }
+      printf("Для --datagen нужен каталог набора: --output каталог\n");
+      return 1;
     }
+    return run_datagen(output_path, datagen_positions, workers, seed, dedup_mb);
   }
-  else
+
+  if (selfplay_games > 0)
   {
-    if (where.y_8 == 0 && is_player_turn)
-    {
-      if (board[where.y][where.x] != 'B')
-      {
-        where.damka = true;
-        board[where.y][where.x] = 'B';
-        lodic[where.y_8][where.x_8] = '4';
-        game_state.count_black_king++;
-        game_state.count_black--;
-        return;
-      }
-    }
-    if (where.y_8 == 7 && !is_player_turn)
-    {
-      if (board[where.y][where.x] != 'W')
-      {
-        where.damka = true;
-        board[where.y][where.x] = 'W';
-        lodic[where.y_8][where.x_8] = '3';
-        game_state.count_white_king++;
-        game_state.count_white--;
-        return;
-      }
-    }
+    // Второй игрок отличается от первого только включенным ProbCut
+    Search_Options second = search_options;
+    second.probcut = !search_options.probcut;
+    run_selfplay(selfplay_games, &search_options, &second, workers, seed,
+                 strcmp(output_path, "-") == 0 ? NULL : output_path);
+    return 0;
   }
-}
 
-void calculate_kill_moves(Position pos, char lodic[8][8], int *move_i, short move_buffer[10][2], char lodic_buffer[10][8][8], GameState *game_states){
-  Valid_Kill vks;
-  int vks_count = get_valid_kill(pos, &vks, lodic);
-  if (vks_count == 0)
+  if (bench_search_ms > 0)
   {
-    move_buffer[*move_i][0] = pos.x_8;
-    move_buffer[*move_i][1] = pos.y_8;
-    memcpy(lodic_buffer[*move_i], lodic, sizeof(char) * 8 * 8);
-    game_states[*move_i] = game_state;
-    (*move_i)++;
-    return;
+    bench_search(bench_search_ms);
+    return 0;
   }
-  GameState gs_copy = game_state;
-  if (vks.kill_l_h)
+
+  if (bench_threads_depth > 0)
   {
-    Position new_pos = pos;
-    new_pos.x_8 = vks.kill_lh_x;
-    new_pos.y_8 = vks.kill_lh_y;
-    char piece = lodic[pos.y_8 - 1][pos.x_8 - 1];
-    if (piece == '1')
-      if (!player_is_white)
-        game_state.count_white--;
-      else
-        game_state.count_black--;
-    else if (piece == '3')
-      if (!player_is_white)
-        game_state.count_white_king--;
-      else
-        game_state.count_black_king--;
-    reverse_graph_koordinaty(new_pos.x_8, new_pos.y_8, &new_pos.x, &new_pos.y);
-    Valid_Kill new_vks;
-    char lodic_copy[8][8];
-    memcpy(lodic_copy, lodic, sizeof(char) * 8 * 8);
-    lodic_copy[pos.y_8 - 1][pos.x_8 - 1] = '0';
-    lodic_copy[new_pos.y_8][new_pos.x_8] = lodic[pos.y_8][pos.x_8];
-    lodic_copy[pos.y_8][pos.x_8] = '0';
-    calculate_kill_moves(new_pos, lodic_copy, move_i, move_buffer, lodic_buffer, game_states);
-    game_state = gs_copy;
+    bench_threads(bench_threads_depth < MAX_PLY ? bench_threads_depth : MAX_PLY - 1);
+    return 0;
   }
-  if (vks.kill_r_h)
+
+  if (bench_eval > 0)
+    return bench_evaluate_batch((size_t)bench_eval, workers) ? 0 : 1;
+
+  if (server_address != NULL)
   {
-    Position new_pos = pos;
-    new_pos.x_8 = vks.kill_rh_x;
-    new_pos.y_8 = vks.kill_rh_y;
-    char piece = lodic[pos.y_8 - 1][pos.x_8 + 1];
-    if (piece == '1')
-      if (!player_is_white)
-        game_state.count_white--;
-      else
-        game_state.count_black--;
-    else if (piece == '3')
-      if (!player_is_white)
-        game_state.count_white_king--;
-      else
-        game_state.count_black_king--;
-    reverse_graph_koordinaty(new_pos.x_8, new_pos.y_8, &new_pos.x, &new_pos.y);
-    Valid_Kill new_vks;
-    char lodic_copy[8][8];
-    memcpy(lodic_copy, lodic, sizeof(char) * 8 * 8);
-    lodic_copy[pos.y_8 - 1][pos.x_8 + 1] = '0';
-    lodic_copy[new_pos.y_8][new_pos.x_8] = lodic[pos.y_8][pos.x_8];
-    lodic_copy[pos.y_8][pos.x_8] = '0';
-    calculate_kill_moves(new_pos, lodic_copy, move_i, move_buffer, lodic_buffer, game_states);
-    game_state = gs_copy;
+    if (workers <= 0)
+      workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    return run_server(server_address, workers > 0 ? workers : 1, max_sessions > 0 ? max_sessions : 1,
+                      seed, record_path);
   }
-  if (vks.kill_l_s)
+
+  if (replay_path != NULL)
+    return replay_game(replay_path);
+
+  rng_seed(seed);
+  if (record_path != NULL)
   {
-    Position new_pos = pos;
-    new_pos.x_8 = vks.kill_ls_x;
-    new_pos.y_8 = vks.kill_ls_y;
-    char piece = lodic[pos.y_8 + 1][pos.x_8 - 1];
-    if (piece == '1')
-      if (!player_is_white)
-        game_state.count_white--;
-      else
-        game_state.count_black--;
-    else if (piece == '3')
-      if (!player_is_white)
-        game_state.count_white_king--;
-      else
-        game_state.count_black_king--;
-    reverse_graph_koordinaty(new_pos.x_8, new_pos.y_8, &new_pos.x, &new_pos.y);
-    Valid_Kill new_vks;
-    char lodic_copy[8][8];
-    memcpy(lodic_copy, lodic, sizeof(char) * 8 * 8);
-    lodic_copy[pos.y_8 + 1][pos.x_8 - 1] = '0';
-    lodic_copy[new_pos.y_8][new_pos.x_8] = lodic[pos.y_8][pos.x_8];
-    lodic_copy[pos.y_8][pos.x_8] = '0';
-    calculate_kill_moves(new_pos, lodic_copy, move_i, move_buffer, lodic_buffer, game_states);
-    game_state = gs_copy;
+    replay_fd = open(record_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (replay_fd < 0)
+    {
+      perror(record_path);
+      return 1;
+    }
   }
-  if (vks.kill_r_s)
+
+  printf("\nДобро пожаловать в игру шашки!\n"); // Преветсвие
+
+  while (!valid_choice)
   {
-    Position new_pos = pos;
-    new_pos.x_8 = vks.kill_rs_x;
-    new_pos.y_8 = vks.kill_rs_y;
-    char piece = lodic[pos.y_8 + 1][pos.x_8 + 1];
-    if (piece == '1')
-      if (!player_is_white)
-        game_state.count_white--;
-      else
-        game_state.count_black--;
-    else if (piece == '3')
-      if (!player_is_white)
-        game_state.count_white_king--;
-      else
-        game_state.count_black_king--;
-    reverse_graph_koordinaty(new_pos.x_8, new_pos.y_8, &new_pos.x, &new_pos.y);
-    Valid_Kill new_vks;
-    char lodic_copy[8][8];
-    memcpy(lodic_copy, lodic, sizeof(char) * 8 * 8);
-    lodic_copy[pos.y_8 + 1][pos.x_8 + 1] = '0';
-    lodic_copy[new_pos.y_8][new_pos.x_8] = lodic[pos.y_8][pos.x_8];
-    lodic_copy[pos.y_8][pos.x_8] = '0';
-    calculate_kill_moves(new_pos, lodic_copy, move_i, move_buffer, lodic_buffer, game_states);
-    game_state = gs_copy;
-  }
-}
+    printf("\nВыберите цвет фишек:\n");
+    printf("1. White (белые)\n");
+    printf("2. Black (черные)\n");
+    printf("Ваш выбор: ");
 
-bool computer_move(char board[BOARD_SIZE][SIZE + 1]){
-  int mx_score = -1;
-  char best_lodic[8][8];
-  GameState best_gs = game_state;
-  bool has_to_kill = false;
-  bool no_moves = true;
-  for (int y = 0; y < 8; y++)
-    for (int x = y % 2 == 0; x < 8; x += 2)
+    if (!console_read_line(choice, sizeof(choice)))
     {
-      if (lodic[y][x] != '1' && lodic[y][x] != '3')
-        continue;
-      Position pos;
-      pos.x_8 = x;
-      pos.y_8 = y;
-      reverse_graph_koordinaty(x, y, &pos.x, &pos.y);
-      Valid_Kill vks;
-      int vks_count = get_valid_kill(pos, &vks, lodic);
+      printf("Ошибка ввода!\n");
+      return 1;
+    }
 
-      if (vks_count > 0)
-      {
-        char local_best_lodic[8][8];
-        GameState best_game_state;
-        int new_score = get_best_sequent_kills(pos, vks, vks_count, -1, lodic, local_best_lodic, &best_game_state);
-        if (new_score > mx_score || !has_to_kill)
-        {
-          mx_score = new_score;
-          memcpy(best_lodic, local_best_lodic, sizeof(char) * 8 * 8);
-          best_gs = best_game_state;
-          no_moves = false;
-        }
-        has_to_kill = true;
-        continue;
-      }
-      if (has_to_kill)
-        continue;
-      Valid_Hod vhs;
-      int vhs_count = get_valid_moves(pos, &vhs, lodic);
-      if (vhs_count == 0)
-        continue;
-      if (vhs.l_h)
-      {
-        char lodic_copy[8][8];
-        memcpy(lodic_copy, lodic, sizeof(char) * 8 * 8);
-        lodic_copy[y][x] = '0';
-        lodic_copy[vhs.lh_y][vhs.lh_x] = '1';
-        Position new_pos;
-        new_pos.x_8 = vhs.lh_x;
-        new_pos.y_8 = vhs.lh_y;
-        reverse_graph_koordinaty(new_pos.x_8, new_pos.y_8, &new_pos.x, &new_pos.y);
-        GameState gs_copy = game_state;
-        becameQueen(new_pos, lodic_copy);
-        int score = evaluate_board_pc(lodic_copy, !player_is_white);
-        if (score > mx_score)
-        {
-          mx_score = score;
-          memcpy(best_lodic, lodic_copy, sizeof(char) * 8 * 8);
-          best_gs = game_state;
-          no_moves = false;
-        }
-        game_state = gs_copy;
-      }
-      if (vhs.r_h)
-      {
-        char lodic_copy[8][8];
-        memcpy(lodic_copy, lodic, sizeof(char) * 8 * 8);
-        lodic_copy[y][x] = '0';
-        lodic_copy[vhs.rh_y][vhs.rh_x] = '1';
-        Position new_pos;
-        new_pos.x_8 = vhs.rh_x;
-        new_pos.y_8 = vhs.rh_y;
-        reverse_graph_koordinaty(new_pos.x_8, new_pos.y_8, &new_pos.x, &new_pos.y);
-        GameState gs_copy = game_state;
-        becameQueen(new_pos, lodic_copy);
-        int score = evaluate_board_pc(lodic_copy, !player_is_white);
-        if (score > mx_score)
-        {
-          mx_score = score;
-          memcpy(best_lodic, lodic_copy, sizeof(char) * 8 * 8);
-          best_gs = game_state;
-          no_moves = false;
-        }
-        game_state = gs_copy;
-      }
-      if (vhs.l_s)
-      {
-        char lodic_copy[8][8];
-        memcpy(lodic_copy, lodic, sizeof(char) * 8 * 8);
-        lodic_copy[y][x] = '0';
-        lodic_copy[vhs.ls_y][vhs.ls_x] = '1';
-        Position new_pos;
-        new_pos.x_8 = vhs.ls_x;
-        new_pos.y_8 = vhs.ls_y;
-        reverse_graph_koordinaty(new_pos.x_8, new_pos.y_8, &new_pos.x, &new_pos.y);
-        GameState gs_copy = game_state;
-        becameQueen(new_pos, lodic_copy);
-        int score = evaluate_board_pc(lodic_copy, !player_is_white);
-        if (score > mx_score)
-        {
-          mx_score = score;
-          memcpy(best_lodic, lodic_copy, sizeof(char) * 8 * 8);
-          best_gs = game_state;
-          no_moves = false;
-        }
-        game_state = gs_copy;
-      }
-      if (vhs.r_s)
-      {
-        char lodic_copy[8][8];
-        memcpy(lodic_copy, lodic, sizeof(char) * 8 * 8);
-        lodic_copy[y][x] = '0';
-        lodic_copy[vhs.rs_y][vhs.rs_x] = '1';
-        Position new_pos;
-        new_pos.x_8 = vhs.rs_x;
-        new_pos.y_8 = vhs.rs_y;
-        reverse_graph_koordinaty(new_pos.x_8, new_pos.y_8, &new_pos.x, &new_pos.y);
-        GameState gs_copy = game_state;
-        becameQueen(new_pos, lodic_copy);
-        int score = evaluate_board_pc(lodic_copy, !player_is_white);
-        if (score > mx_score)
-        {
-          mx_score = score;
-          memcpy(best_lodic, lodic_copy, sizeof(char) * 8 * 8);
-          best_gs = game_state;
-          no_moves = false;
-        }
-        game_state = gs_copy;
-      }
+    // Приводим к нижнему регистру для сравнения
+    for (int i = 0; choice[i]; i++)
+    {
+      choice[i] = tolower(choice[i]);
     }
-  memcpy(lodic, best_lodic, sizeof(char) * 8 * 8);
-  game_state = best_gs;
-  return !no_moves;
-  // for (short x = 0; x < 8; x++)
-  //   for (short y = 0; y < 8; y++)
-  //   {
-  //     short bx, by;
-  //     reverse_graph_koordinaty(x, y, &bx, &by);
-  //     board[by][bx] = (lodic[y][x] == '0' ? '*' : (lodic[y][x] == '1' ? '0' : (lodic[y][x] == '2' ? 'O' : ' ')));
-  //   }
-}
 
-int evaluate_board_pc(char lodic[8][8], bool is_white){
-  int score = 0;
-  int our_count = is_white ? game_state.count_white : game_state.count_black;
-  int opponent_count = is_white ? game_state.count_black : game_state.count_white;
-  int inc = (our_count - opponent_count) * 10;
-  score += inc > 0 ? inc : 0;
-  our_count = is_white ? game_state.count_white_king : game_state.count_black_king;
-  opponent_count = is_white ? game_state.count_black_king : game_state.count_white_king;
-  inc = (our_count - opponent_count) * 15;
-  score += inc > 0 ? inc : 0;
-  score += (lodic[3][4] == '1') * 2;
-  score += (lodic[4][3] == '1') * 2;
-  score += (lodic[3][3] == '1') * 2;
-  score += (lodic[4][4] == '1') * 2;
-  return score;
-}
+    // initialize_board(board); // Создаем доску
 
-int get_best_sequent_kills(Position pos, Valid_Kill vks, int vks_count, int mx_score, char lodic[8][8], char best_lodic[8][8], GameState *best_game_state){
-  if (vks_count == 0)
-  {
-    int new_score = evaluate_board_pc(lodic, !player_is_white);
-    if (new_score > mx_score)
+    if (strcmp(choice, "white") == 0)
     {
-      mx_score = new_score;
-      memcpy(best_lodic, lodic, sizeof(char) * 8 * 8);
-      *best_game_state = game_state;
+      setup_pieces(board, true);
+      printf("\nВы выбрали белые фишки (O). Вы ходите первым.\n");
+      player_is_white = true;
+      player_piece = 'O';
+      computer_piece = '0';
+      is_player_turn = true;
+      valid_choice = true;
     }
-    return mx_score;
-  }
-  GameState game_state_copy = game_state;
-  if (vks.kill_l_h)
-  {
-    Position new_pos = pos;
-    new_pos.x_8 = vks.kill_lh_x;
-    new_pos.y_8 = vks.kill_lh_y;
-    char piece = lodic[pos.y_8 - 1][pos.x_8 - 1];
-    if (piece == '2')
-      if (player_is_white)
-        game_state.count_white--;
-      else
-        game_state.count_black--;
-    else if (piece == '4')
-      if (player_is_white)
-        game_state.count_white_king--;
-      else
-        game_state.count_black_king--;
-    reverse_graph_koordinaty(new_pos.x_8, new_pos.y_8, &new_pos.x, &new_pos.y);
-    Valid_Kill new_vks;
-    char lodic_copy[8][8];
-    memcpy(lodic_copy, lodic, sizeof(char) * 8 * 8);
-    lodic_copy[pos.y_8 - 1][pos.x_8 - 1] = '0';
-    lodic_copy[pos.y_8][pos.x_8] = '0';
-    lodic_copy[new_pos.y_8][new_pos.x_8] = '1';
-    becameQueen(new_pos, lodic_copy);
-    int new_vks_count = get_valid_kill(new_pos, &new_vks, lodic_copy);
-    mx_score = get_best_sequent_kills(new_pos, new_vks, new_vks_count, mx_score, lodic_copy, best_lodic, best_game_state);
-    game_state = game_state_copy;
-  }
-  if (vks.kill_r_h)
-  {
-    Position new_pos = pos;
-    new_pos.x_8 = vks.kill_rh_x;
-    new_pos.y_8 = vks.kill_rh_y;
-    char piece = lodic[pos.y_8 - 1][pos.x_8 + 1];
-    if (piece == '2')
-      if (player_is_white)
-        game_state.count_white--;
-      else
-        game_state.count_black--;
-    else if (piece == '4')
-      if (player_is_white)
-        game_state.count_white_king--;
-      else
-        game_state.count_black_king--;
-    reverse_graph_koordinaty(new_pos.x_8, new_pos.y_8, &new_pos.x, &new_pos.y);
-    Valid_Kill new_vks;
-    char lodic_copy[8][8];
-    memcpy(lodic_copy, lodic, sizeof(char) * 8 * 8);
-    lodic_copy[pos.y_8 - 1][pos.x_8 + 1] = '0';
-    lodic_copy[pos.y_8][pos.x_8] = '0';
-    lodic_copy[new_pos.y_8][new_pos.x_8] = '1';
-    becameQueen(new_pos, lodic_copy);
-    int new_vks_count = get_valid_kill(new_pos, &new_vks, lodic_copy);
-    mx_score = get_best_sequent_kills(new_pos, new_vks, new_vks_count, mx_score, lodic_copy, best_lodic, best_game_state);
-    game_state = game_state_copy;
-  }
-  if (vks.kill_l_s)
-  {
-    Position new_pos = pos;
-    new_pos.x_8 = vks.kill_ls_x;
-    new_pos.y_8 = vks.kill_ls_y;
-    char piece = lodic[pos.y_8 + 1][pos.x_8 - 1];
-    if (piece == '2')
-      if (player_is_white)
-        game_state.count_white--;
-      else
-        game_state.count_black--;
-    else if (piece == '4')
-      if (player_is_white)
-        game_state.count_white_king--;
-      else
-        game_state.count_black_king--;
-    reverse_graph_koordinaty(new_pos.x_8, new_pos.y_8, &new_pos.x, &new_pos.y);
-    Valid_Kill new_vks;
-    char lodic_copy[8][8];
-    memcpy(lodic_copy, lodic, sizeof(char) * 8 * 8);
-    lodic_copy[pos.y_8 + 1][pos.x_8 - 1] = '0';
-    lodic_copy[pos.y_8][pos.x_8] = '0';
-    lodic_copy[new_pos.y_8][new_pos.x_8] = '1';
-    becameQueen(new_pos, lodic_copy);
-    int new_vks_count = get_valid_kill(new_pos, &new_vks, lodic_copy);
-    mx_score = get_best_sequent_kills(new_pos, new_vks, new_vks_count, mx_score, lodic_copy, best_lodic, best_game_state);
-    game_state = game_state_copy;
-  }
-  if (vks.kill_r_s)
-  {
-    Position new_pos = pos;
-    new_pos.x_8 = vks.kill_rs_x;
-    new_pos.y_8 = vks.kill_rs_y;
-    char piece = lodic[pos.y_8 + 1][pos.x_8 + 1];
-    if (piece == '2')
-      if (player_is_white)
-        game_state.count_white--;
-      else
-        game_state.count_black--;
-    else if (piece == '4')
-      if (player_is_white)
-        game_state.count_white_king--;
-      else
-        game_state.count_black_king--;
-    reverse_graph_koordinaty(new_pos.x_8, new_pos.y_8, &new_pos.x, &new_pos.y);
-    Valid_Kill new_vks;
-    char lodic_copy[8][8];
-    memcpy(lodic_copy, lodic, sizeof(char) * 8 * 8);
-    lodic_copy[pos.y_8 + 1][pos.x_8 + 1] = '0';
-    lodic_copy[pos.y_8][pos.x_8] = '0';
-    lodic_copy[new_pos.y_8][new_pos.x_8] = '1';
-    becameQueen(new_pos, lodic_copy);
-    int new_vks_count = get_valid_kill(new_pos, &new_vks, lodic_copy);
-    mx_score = get_best_sequent_kills(new_pos, new_vks, new_vks_count, mx_score, lodic_copy, best_lodic, best_game_state);
-    game_state = game_state_copy;
+    else if (strcmp(choice, "black") == 0)
+    {
+      setup_pieces(board, false);
+      printf("\nВы выбрали черные фишки (0). Компьютер ходит первым.\n");
+      player_is_white = false;
+      player_piece = '0';
+      computer_piece = 'O';
+      is_player_turn = false;
+      valid_choice = true;
+    }
+    else
+      printf("Некорректный ввод. Пожалуйста, введите 'White' или 'Black'.\n");
   }
-  return mx_score;
-}
\ No newline at end of file
+
+  printf("Зерно партии: %llu\n", (unsigned long long)seed);
+  replay_write_header(replay_fd, seed, player_is_white);
+  history_reset(&game_history, position_hash(lodic, is_player_turn ? '2' : '1'));
+
+  print_board(board);
+
+  play_game(board);
+  if (replay_fd >= 0)
+    close(replay_fd);
+
+  return 0;
+}